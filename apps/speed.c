@@ -129,7 +129,7 @@
 #define BUFSIZE (1024*16+1)
 #define MAX_MISALIGNMENT 63
 
-#define ALGOR_NUM       30
+#define ALGOR_NUM       31
 #define SIZE_NUM        6
 #define PRIME_NUM       3
 #define RSA_NUM         7
@@ -207,6 +207,7 @@ static int AES_cbc_256_encrypt_loop(void *args);
 static int AES_ige_192_encrypt_loop(void *args);
 static int AES_ige_256_encrypt_loop(void *args);
 static int CRYPTO_gcm128_aad_loop(void *args);
+static int RAND_bytes_loop(void *args);
 static int EVP_Update_loop(void *args);
 static int EVP_Digest_loop(void *args);
 #ifndef OPENSSL_NO_RSA
@@ -240,7 +241,7 @@ static const char *names[ALGOR_NUM] = {
     "aes-128 cbc", "aes-192 cbc", "aes-256 cbc",
     "camellia-128 cbc", "camellia-192 cbc", "camellia-256 cbc",
     "evp", "sha256", "sha512", "whirlpool",
-    "aes-128 ige", "aes-192 ige", "aes-256 ige", "ghash"
+    "aes-128 ige", "aes-192 ige", "aes-256 ige", "ghash", "rand"
 };
 
 static double results[ALGOR_NUM][SIZE_NUM];
@@ -367,7 +368,7 @@ const OPTIONS speed_options[] = {
      "Time decryption instead of encryption (only EVP)"},
     {"mr", OPT_MR, '-', "Produce machine readable output"},
     {"mb", OPT_MB, '-',
-     "Enable (tls1.1) multi-block mode on evp_cipher requested with -evp"},
+     "Enable (tls1.1) multi-block or (tls1.2) AEAD record mode on evp_cipher"},
     {"misalign", OPT_MISALIGN, 'n', "Amount to mis-align buffers"},
     {"elapsed", OPT_ELAPSED, '-',
      "Measure time in real time instead of CPU user time"},
@@ -414,6 +415,7 @@ const OPTIONS speed_options[] = {
 #define D_IGE_192_AES   27
 #define D_IGE_256_AES   28
 #define D_GHASH         29
+#define D_RAND          30
 static OPT_PAIR doit_choices[] = {
 #ifndef OPENSSL_NO_MD2
     {"md2", D_MD2},
@@ -479,6 +481,7 @@ static OPT_PAIR doit_choices[] = {
     {"cast5", D_CBC_CAST},
 #endif
     {"ghash", D_GHASH},
+    {"rand", D_RAND},
     {NULL}
 };
 
@@ -852,6 +855,17 @@ static int CRYPTO_gcm128_aad_loop(void *args)
     return count;
 }
 
+static int RAND_bytes_loop(void *args)
+{
+    loopargs_t *tempargs = *(loopargs_t **) args;
+    unsigned char *buf = tempargs->buf;
+    int count;
+
+    for (count = 0; COND(c[D_RAND][testnum]); count++)
+        RAND_bytes(buf, lengths[testnum]);
+    return count;
+}
+
 static long save_count = 0;
 static int decrypt = 0;
 static int EVP_Update_loop(void *args)
@@ -1680,6 +1694,7 @@ int speed_main(int argc, char **argv)
     c[D_IGE_192_AES][0] = count;
     c[D_IGE_256_AES][0] = count;
     c[D_GHASH][0] = count;
+    c[D_RAND][0] = count;
 
     for (i = 1; i < SIZE_NUM; i++) {
         long l0, l1;
@@ -1698,6 +1713,7 @@ int speed_main(int argc, char **argv)
         c[D_SHA512][i] = c[D_SHA512][0] * 4 * l0 / l1;
         c[D_WHIRLPOOL][i] = c[D_WHIRLPOOL][0] * 4 * l0 / l1;
         c[D_GHASH][i] = c[D_GHASH][0] * 4 * l0 / l1;
+        c[D_RAND][i] = c[D_RAND][0] * 4 * l0 / l1;
 
         l0 = (long)lengths[i - 1];
 
@@ -2091,6 +2107,16 @@ int speed_main(int argc, char **argv)
         for (i = 0; i < loopargs_len; i++)
             CRYPTO_gcm128_release(loopargs[i].gcm_ctx);
     }
+    if (doit[D_RAND]) {
+        for (testnum = 0; testnum < SIZE_NUM; testnum++) {
+            print_message(names[D_RAND], c[D_RAND][testnum],
+                          lengths[testnum]);
+            Time_F(START);
+            count = run_benchmark(async_jobs, RAND_bytes_loop, loopargs);
+            d = Time_F(STOP);
+            print_result(D_RAND, testnum, count, d);
+        }
+    }
 #ifndef OPENSSL_NO_CAMELLIA
     if (doit[D_CBC_128_CML]) {
         if (async_jobs > 0) {
@@ -2281,9 +2307,14 @@ int speed_main(int argc, char **argv)
 
     if (doit[D_EVP]) {
         if (multiblock && evp_cipher) {
-            if (!
-                (EVP_CIPHER_flags(evp_cipher) &
-                 EVP_CIPH_FLAG_TLS1_1_MULTIBLOCK)) {
+            /*
+             * Of the AEAD ciphers only those used in TLS 1.2 without any
+             * further per-mode setup (tag length etc.) are supported
+             */
+            if (!(EVP_CIPHER_flags(evp_cipher)
+                  & EVP_CIPH_FLAG_TLS1_1_MULTIBLOCK)
+                && EVP_CIPHER_mode(evp_cipher) != EVP_CIPH_GCM_MODE
+                && EVP_CIPHER_nid(evp_cipher) != NID_chacha20_poly1305) {
                 BIO_printf(bio_err, "%s is not multi-block capable\n",
                            OBJ_nid2ln(EVP_CIPHER_nid(evp_cipher)));
                 goto end;
@@ -3109,7 +3140,8 @@ static void multiblock_speed(const EVP_CIPHER *evp_cipher)
 {
     static int mblengths[] =
         { 8 * 1024, 2 * 8 * 1024, 4 * 8 * 1024, 8 * 8 * 1024, 8 * 16 * 1024 };
-    int j, count, num = OSSL_NELEM(mblengths);
+    int j, count, num = OSSL_NELEM(mblengths), aead;
+    size_t eivlen = 0;
     const char *alg_name;
     unsigned char *inp, *out, no_key[32], no_iv[16];
     EVP_CIPHER_CTX *ctx;
@@ -3119,7 +3151,16 @@ static void multiblock_speed(const EVP_CIPHER *evp_cipher)
     out = app_malloc(mblengths[num - 1] + 1024, "multiblock output buffer");
     ctx = EVP_CIPHER_CTX_new();
     EVP_EncryptInit_ex(ctx, evp_cipher, NULL, no_key, no_iv);
-    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_MAC_KEY, sizeof(no_key), no_key);
+    aead = !(EVP_CIPHER_flags(evp_cipher) & EVP_CIPH_FLAG_TLS1_1_MULTIBLOCK);
+    if (!aead) {
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_MAC_KEY, sizeof(no_key),
+                            no_key);
+    } else if (EVP_CIPHER_mode(evp_cipher) == EVP_CIPH_GCM_MODE) {
+        /* The implicit part of the nonce as used by TLS 1.2 */
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IV_FIXED,
+                            EVP_GCM_TLS_FIXED_IV_LEN, no_iv);
+        eivlen = EVP_GCM_TLS_EXPLICIT_IV_LEN;
+    }
     alg_name = OBJ_nid2ln(EVP_CIPHER_nid(evp_cipher));
 
     for (j = 0; j < num; j++) {
@@ -3137,6 +3178,36 @@ static void multiblock_speed(const EVP_CIPHER *evp_cipher)
             aad[10] = 2;
             aad[11] = 0;        /* length */
             aad[12] = 0;
+            if (aead) {
+                /*
+                 * Encrypt |len| bytes as a run of full size TLS 1.2 records
+                 * placed back to back, as libssl does for large writes
+                 */
+                size_t off, reclen, outlen = 0;
+                int pad;
+
+                for (off = 0; off < len; off += reclen) {
+                    reclen = len - off;
+                    if (reclen > 16384) /* SSL3_RT_MAX_PLAIN_LENGTH */
+                        reclen = 16384;
+                    memcpy(out + outlen + eivlen, inp + off, reclen);
+                    aad[11] = (unsigned char)((eivlen + reclen) >> 8);
+                    aad[12] = (unsigned char)(eivlen + reclen);
+                    pad = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_TLS1_AAD,
+                                              EVP_AEAD_TLS1_AAD_LEN, aad);
+                    if (pad <= 0
+                        || EVP_Cipher(ctx, out + outlen, out + outlen,
+                                      eivlen + reclen + pad) <= 0) {
+                        BIO_printf(bio_err, "%s encryption failure\n",
+                                   alg_name);
+                        ERR_print_errors(bio_err);
+                        exit(1);
+                    }
+                    outlen += eivlen + reclen + pad;
+                }
+                continue;
+            }
+
             mb_param.out = NULL;
             mb_param.inp = aad;
             mb_param.len = len;
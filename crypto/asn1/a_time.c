@@ -18,6 +18,7 @@
 #include <time.h>
 #include "internal/cryptlib.h"
 #include <openssl/asn1t.h>
+#include "internal/asn1_int.h"
 #include "asn1_locl.h"
 
 IMPLEMENT_ASN1_MSTRING(ASN1_TIME, B_ASN1_TIME)
@@ -159,6 +160,22 @@ int ASN1_TIME_diff(int *pday, int *psec,
     return OPENSSL_gmtime_diff(pday, psec, &tm_from, &tm_to);
 }
 
+/*
+ * Like ASN1_TIME_diff() with |to| given as a time_t, which avoids encoding
+ * |to| as an ASN1_TIME only to parse it again.
+ */
+int asn1_time_diff_time_t(int *pday, int *psec,
+                          const ASN1_TIME *from, time_t to)
+{
+    struct tm tm_from, tm_to;
+
+    if (!asn1_time_to_tm(&tm_from, from))
+        return 0;
+    if (OPENSSL_gmtime(&to, &tm_to) == NULL)
+        return 0;
+    return OPENSSL_gmtime_diff(pday, psec, &tm_from, &tm_to);
+}
+
 int ASN1_TIME_print(BIO *bp, const ASN1_TIME *tm)
 {
     if (tm->type == V_ASN1_UTCTIME)
@@ -56,6 +56,8 @@ static ERR_STRING_DATA BIO_str_functs[] = {
     {ERR_FUNC(BIO_F_BUFFER_CTRL), "buffer_ctrl"},
     {ERR_FUNC(BIO_F_CONN_CTRL), "conn_ctrl"},
     {ERR_FUNC(BIO_F_CONN_STATE), "conn_state"},
+    {ERR_FUNC(BIO_F_DGRAM_BATCH_RESERVE), "dgram_batch_reserve"},
+    {ERR_FUNC(BIO_F_DGRAM_BATCH_SET_MAX), "dgram_batch_set_max"},
     {ERR_FUNC(BIO_F_DGRAM_SCTP_READ), "dgram_sctp_read"},
     {ERR_FUNC(BIO_F_DGRAM_SCTP_WRITE), "dgram_sctp_write"},
     {ERR_FUNC(BIO_F_FILE_CTRL), "file_ctrl"},
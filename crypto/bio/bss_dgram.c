@@ -7,12 +7,26 @@
  * https://www.openssl.org/source/license.html
  */
 
+/*
+ * We need to do this early, because stdio.h includes the header files that
+ * handle _GNU_SOURCE and other similar macros.  Without it recvmmsg() and
+ * sendmmsg() are not declared.
+ */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <errno.h>
 
 #include "bio_lcl.h"
 #ifndef OPENSSL_NO_DGRAM
 
+# if defined(OPENSSL_SYS_LINUX) && defined(MSG_WAITFORONE)
+#  define DGRAM_MMSG
+#  define DGRAM_MAX_BATCH     64
+# endif
+
 # if !defined(_WIN32)
 #  include <sys/time.h>
 # endif
@@ -103,6 +117,31 @@ static const BIO_METHOD methods_dgramp_sctp = {
 };
 # endif
 
+# ifdef DGRAM_MMSG
+typedef struct bio_dgram_msg_st {
+    BIO_ADDR peer;
+    size_t off;
+    size_t len;
+} bio_dgram_msg;
+
+/*
+ * Datagrams received by one recvmmsg() call, or queued for the next
+ * sendmmsg() call. Received datagrams occupy fixed size slots of |buf|,
+ * datagrams to be sent are packed back to back.
+ */
+typedef struct bio_dgram_batch_st {
+    unsigned int max;           /* datagrams per call, 0 if not batching */
+    unsigned int count;         /* datagrams in |msgs| */
+    unsigned int next;          /* next one to read or send */
+    unsigned char *buf;
+    size_t buf_len;
+    size_t used;
+    bio_dgram_msg *msgs;
+    struct mmsghdr *hdrs;
+    struct iovec *iov;
+} bio_dgram_batch;
+# endif
+
 typedef struct bio_dgram_data_st {
     BIO_ADDR peer;
     unsigned int connected;
@@ -111,6 +150,10 @@ typedef struct bio_dgram_data_st {
     struct timeval next_timeout;
     struct timeval socket_timeout;
     unsigned int peekmode;
+# ifdef DGRAM_MMSG
+    bio_dgram_batch rbatch;
+    bio_dgram_batch wbatch;
+# endif
 } bio_dgram_data;
 
 # ifndef OPENSSL_NO_SCTP
@@ -155,6 +198,60 @@ BIO *BIO_new_dgram(int fd, int close_flag)
     return (ret);
 }
 
+# ifdef DGRAM_MMSG
+static void dgram_batch_free(bio_dgram_batch *batch)
+{
+    OPENSSL_free(batch->buf);
+    OPENSSL_free(batch->msgs);
+    OPENSSL_free(batch->hdrs);
+    OPENSSL_free(batch->iov);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/*
+ * Set up |batch| for |max| datagrams per system call, 0 turns batching off.
+ * Returns 1 on success or 0 on failure.
+ */
+static int dgram_batch_set_max(bio_dgram_batch *batch, long max)
+{
+    if (max < 0 || max > DGRAM_MAX_BATCH)
+        return 0;
+    dgram_batch_free(batch);
+    if (max == 0)
+        return 1;
+
+    batch->msgs = OPENSSL_zalloc(max * sizeof(*batch->msgs));
+    batch->hdrs = OPENSSL_zalloc(max * sizeof(*batch->hdrs));
+    batch->iov = OPENSSL_zalloc(max * sizeof(*batch->iov));
+    if (batch->msgs == NULL || batch->hdrs == NULL || batch->iov == NULL) {
+        BIOerr(BIO_F_DGRAM_BATCH_SET_MAX, ERR_R_MALLOC_FAILURE);
+        dgram_batch_free(batch);
+        return 0;
+    }
+    batch->max = (unsigned int)max;
+    return 1;
+}
+
+/* Make sure that the buffer of |batch| holds at least |len| bytes */
+static int dgram_batch_reserve(bio_dgram_batch *batch, size_t len)
+{
+    unsigned char *buf;
+
+    if (len <= batch->buf_len)
+        return 1;
+    if (len < batch->buf_len * 2)
+        len = batch->buf_len * 2;
+    buf = OPENSSL_realloc(batch->buf, len);
+    if (buf == NULL) {
+        BIOerr(BIO_F_DGRAM_BATCH_RESERVE, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    batch->buf = buf;
+    batch->buf_len = len;
+    return 1;
+}
+# endif
+
 static int dgram_new(BIO *bi)
 {
     bio_dgram_data *data = OPENSSL_zalloc(sizeof(*data));
@@ -175,6 +272,10 @@ static int dgram_free(BIO *a)
         return 0;
 
     data = (bio_dgram_data *)a->ptr;
+# ifdef DGRAM_MMSG
+    dgram_batch_free(&data->rbatch);
+    dgram_batch_free(&data->wbatch);
+# endif
     OPENSSL_free(data);
 
     return (1);
@@ -299,6 +400,148 @@ static void dgram_reset_rcv_timeout(BIO *b)
 # endif
 }
 
+# ifdef DGRAM_MMSG
+/*
+ * Receive as many waiting datagrams as fit into the batch with a single
+ * recvmmsg() call and hand them out one per call. Each slot holds |outl|
+ * bytes, longer datagrams are truncated just like recvfrom() does.
+ */
+static int dgram_read_batch(BIO *b, char *out, int outl)
+{
+    bio_dgram_data *data = (bio_dgram_data *)b->ptr;
+    bio_dgram_batch *batch = &data->rbatch;
+    bio_dgram_msg *msg;
+    struct msghdr *hdr;
+    size_t slot = (size_t)outl;
+    unsigned int i;
+    int ret;
+
+    BIO_clear_retry_flags(b);
+    if (batch->next == batch->count) {
+        batch->count = batch->next = 0;
+        if (!dgram_batch_reserve(batch, slot * batch->max))
+            return -1;
+        for (i = 0; i < batch->max; i++) {
+            msg = &batch->msgs[i];
+            memset(&msg->peer, 0, sizeof(msg->peer));
+            msg->off = i * slot;
+            batch->iov[i].iov_base = batch->buf + msg->off;
+            batch->iov[i].iov_len = slot;
+            hdr = &batch->hdrs[i].msg_hdr;
+            memset(hdr, 0, sizeof(*hdr));
+            hdr->msg_name = BIO_ADDR_sockaddr_noconst(&msg->peer);
+            hdr->msg_namelen = sizeof(msg->peer);
+            hdr->msg_iov = &batch->iov[i];
+            hdr->msg_iovlen = 1;
+        }
+
+        dgram_adjust_rcv_timeout(b);
+        ret = recvmmsg(b->num, batch->hdrs, batch->max, MSG_WAITFORONE, NULL);
+        if (ret < 0) {
+            if (BIO_dgram_should_retry(ret)) {
+                BIO_set_retry_read(b);
+                data->_errno = get_last_socket_error();
+            }
+            dgram_reset_rcv_timeout(b);
+            return ret;
+        }
+        dgram_reset_rcv_timeout(b);
+
+        for (i = 0; i < (unsigned int)ret; i++)
+            batch->msgs[i].len = batch->hdrs[i].msg_len;
+        batch->count = (unsigned int)ret;
+    }
+
+    msg = &batch->msgs[batch->next];
+    ret = msg->len < slot ? (int)msg->len : outl;
+    memcpy(out, batch->buf + msg->off, ret);
+    if (!data->connected)
+        BIO_ctrl(b, BIO_CTRL_DGRAM_SET_PEER, 0, &msg->peer);
+    if (!data->peekmode)
+        batch->next++;
+    return ret;
+}
+
+/*
+ * Send the datagrams queued by dgram_write_batch() using as few sendmmsg()
+ * calls as possible. Returns 1 once the queue is empty or -1 on error, which
+ * leaves the unsent datagrams queued. A datagram that fails with a fatal
+ * error is dropped, as it would have been by sendto().
+ */
+static int dgram_flush_batch(BIO *b)
+{
+    bio_dgram_data *data = (bio_dgram_data *)b->ptr;
+    bio_dgram_batch *batch = &data->wbatch;
+    bio_dgram_msg *msg;
+    struct msghdr *hdr;
+    unsigned int i;
+    int ret;
+
+    BIO_clear_retry_flags(b);
+    while (batch->next < batch->count) {
+        for (i = batch->next; i < batch->count; i++) {
+            msg = &batch->msgs[i];
+            batch->iov[i].iov_base = batch->buf + msg->off;
+            batch->iov[i].iov_len = msg->len;
+            hdr = &batch->hdrs[i].msg_hdr;
+            memset(hdr, 0, sizeof(*hdr));
+            if (!data->connected) {
+                hdr->msg_name = BIO_ADDR_sockaddr_noconst(&msg->peer);
+                hdr->msg_namelen = BIO_ADDR_sockaddr_size(&msg->peer);
+            }
+            hdr->msg_iov = &batch->iov[i];
+            hdr->msg_iovlen = 1;
+        }
+
+        clear_socket_error();
+        ret = sendmmsg(b->num, batch->hdrs + batch->next,
+                       batch->count - batch->next, 0);
+        if (ret <= 0) {
+            if (BIO_dgram_should_retry(ret)) {
+                BIO_set_retry_write(b);
+                data->_errno = get_last_socket_error();
+            } else {
+                batch->next++;
+            }
+            return -1;
+        }
+        batch->next += ret;
+    }
+    batch->count = batch->next = 0;
+    batch->used = 0;
+    return 1;
+}
+
+/*
+ * Queue a datagram for dgram_flush_batch(), which is called as soon as the
+ * batch is full. Errors sending a full batch are reported by the next write
+ * or BIO_flush().
+ */
+static int dgram_write_batch(BIO *b, const char *in, int inl)
+{
+    bio_dgram_data *data = (bio_dgram_data *)b->ptr;
+    bio_dgram_batch *batch = &data->wbatch;
+    bio_dgram_msg *msg;
+
+    if (batch->count == batch->max && dgram_flush_batch(b) <= 0)
+        return -1;
+    if (!dgram_batch_reserve(batch, batch->used + inl))
+        return -1;
+
+    msg = &batch->msgs[batch->count++];
+    msg->peer = data->peer;
+    msg->off = batch->used;
+    msg->len = inl;
+    memcpy(batch->buf + batch->used, in, inl);
+    batch->used += inl;
+
+    if (batch->count == batch->max)
+        (void)dgram_flush_batch(b);
+    BIO_clear_retry_flags(b);
+    return inl;
+}
+# endif
+
 static int dgram_read(BIO *b, char *out, int outl)
 {
     int ret = 0;
@@ -310,6 +553,10 @@ static int dgram_read(BIO *b, char *out, int outl)
 
     if (out != NULL) {
         clear_socket_error();
+# ifdef DGRAM_MMSG
+        if (data->rbatch.max > 0)
+            return dgram_read_batch(b, out, outl);
+# endif
         memset(&peer, 0, sizeof(peer));
         dgram_adjust_rcv_timeout(b);
         if (data->peekmode)
@@ -339,6 +586,10 @@ static int dgram_write(BIO *b, const char *in, int inl)
     bio_dgram_data *data = (bio_dgram_data *)b->ptr;
     clear_socket_error();
 
+# ifdef DGRAM_MMSG
+    if (data->wbatch.max > 0)
+        return dgram_write_batch(b, in, inl);
+# endif
     if (data->connected)
         ret = writesocket(b->num, in, inl);
     else {
@@ -415,6 +666,9 @@ static long dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
     socklen_t addr_len;
     BIO_ADDR addr;
 # endif
+# ifdef DGRAM_MMSG
+    unsigned int i;
+# endif
 
     data = (bio_dgram_data *)b->ptr;
 
@@ -448,12 +702,29 @@ static long dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
         b->shutdown = (int)num;
         break;
     case BIO_CTRL_PENDING:
+        ret = 0;
+# ifdef DGRAM_MMSG
+        /* Datagrams received by recvmmsg() that have not been read yet */
+        for (i = data->rbatch.next; i < data->rbatch.count; i++)
+            ret += (long)data->rbatch.msgs[i].len;
+# endif
+        break;
     case BIO_CTRL_WPENDING:
+        /*
+         * Queued datagrams are not counted: DTLS takes pending data to be
+         * part of the datagram it is building.
+         */
         ret = 0;
         break;
     case BIO_CTRL_DUP:
+        ret = 1;
+        break;
     case BIO_CTRL_FLUSH:
+# ifdef DGRAM_MMSG
+        ret = dgram_flush_batch(b);
+# else
         ret = 1;
+# endif
         break;
     case BIO_CTRL_DGRAM_CONNECT:
         BIO_ADDR_make(&data->peer, BIO_ADDR_sockaddr((BIO_ADDR *)ptr));
@@ -791,6 +1062,21 @@ static long dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
     case BIO_CTRL_DGRAM_SET_PEEK_MODE:
         data->peekmode = (unsigned int)num;
         break;
+# ifdef DGRAM_MMSG
+    case BIO_CTRL_DGRAM_SET_RECV_BATCH:
+        /* Don't throw away datagrams which have been received already */
+        if (data->rbatch.next < data->rbatch.count)
+            ret = 0;
+        else
+            ret = dgram_batch_set_max(&data->rbatch, num);
+        break;
+    case BIO_CTRL_DGRAM_SET_SEND_BATCH:
+        if (dgram_flush_batch(b) <= 0)
+            ret = 0;
+        else
+            ret = dgram_batch_set_max(&data->wbatch, num);
+        break;
+# endif
     default:
         ret = 0;
         break;
@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <internal/cryptlib_int.h>
@@ -123,8 +124,20 @@ static ERR_STRING_DATA ERR_str_reasons[] = {
 static CRYPTO_ONCE err_init = CRYPTO_ONCE_STATIC_INIT;
 static CRYPTO_THREAD_LOCAL err_thread_local;
 
+/*
+ * Where the compiler supports native thread local variables, the state of
+ * the thread is also kept in one, so that ERR_get_state() needs neither the
+ * run once check nor the thread key lookup once the state exists.
+ */
+#if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG) \
+    && defined(__GNUC__) && defined(__ELF__)
+# define ERR_STATE_CACHE
+static __thread ERR_STATE *err_state_cache = NULL;
+#endif
+
 static CRYPTO_ONCE err_string_init = CRYPTO_ONCE_STATIC_INIT;
 static CRYPTO_RWLOCK *err_string_lock;
+static CRYPTO_RWLOCK *err_static_lock;
 
 static ERR_STRING_DATA *int_err_get_item(const ERR_STRING_DATA *);
 
@@ -135,6 +148,35 @@ static ERR_STRING_DATA *int_err_get_item(const ERR_STRING_DATA *);
 static LHASH_OF(ERR_STRING_DATA) *int_error_hash = NULL;
 static int int_err_library_number = ERR_LIB_USER;
 
+/*
+ * The string tables of the built-in libraries, that is those with library
+ * codes below ERR_LIB_USER, are not added to |int_error_hash|.  Each is
+ * copied, sorted by error code and appended to |err_static_tables| when
+ * loaded, and the first |err_num_static| entries never change afterwards,
+ * so that lookups can binary search them without taking |err_string_lock|.
+ * As with the hash, the string loaded last wins: the tables are searched
+ * newest first, and a copy keeps only the last of equal error codes.  The
+ * hash holds the strings of dynamically allocated libraries only, and is
+ * not consulted at all while |err_num_dynamic| is zero.
+ */
+#define ERR_MAX_STATIC_TABLES   128
+
+typedef struct {
+    const ERR_STRING_DATA *orig;
+    ERR_STRING_DATA *str;
+    size_t num;
+} ERR_STATIC_TABLE;
+
+typedef struct {
+    unsigned long error;
+    size_t pos;
+    const char *string;
+} ERR_SORT_ITEM;
+
+static ERR_STATIC_TABLE err_static_tables[ERR_MAX_STATIC_TABLES];
+static int err_num_static = 0;
+static int err_num_dynamic = 0;
+
 static unsigned long get_error_values(int inc, int top, const char **file,
                                       int *line, const char **data,
                                       int *flags);
@@ -154,9 +196,131 @@ static int err_string_data_cmp(const ERR_STRING_DATA *a,
     return (int)(a->error - b->error);
 }
 
+static int err_sort_item_cmp(const void *a, const void *b)
+{
+    const ERR_SORT_ITEM *ia = a, *ib = b;
+
+    if (ia->error != ib->error)
+        return ia->error < ib->error ? -1 : 1;
+    return ia->pos < ib->pos ? -1 : ia->pos > ib->pos;
+}
+
+/* Read one of the counters above without taking a lock where possible */
+static int err_counter_get(int *counter)
+{
+    int ret;
+
+#if defined(OPENSSL_THREADS) && defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+    if (__atomic_is_lock_free(sizeof(*counter), counter))
+        return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+#endif
+    if (!CRYPTO_atomic_add(counter, 0, &ret, err_static_lock))
+        return 0;
+    return ret;
+}
+
+static void err_counter_set(int *counter, int val)
+{
+    int ret;
+
+    CRYPTO_atomic_add(counter, val - err_counter_get(counter), &ret,
+                      err_static_lock);
+}
+
+static ERR_STRING_DATA *err_get_static(unsigned long e)
+{
+    const ERR_STATIC_TABLE *t;
+    size_t lo, hi, mid;
+    int i, n = err_counter_get(&err_num_static);
+
+    for (i = n - 1; i >= 0; i--) {
+        t = &err_static_tables[i];
+        if (e < t->str[0].error || e > t->str[t->num - 1].error)
+            continue;
+        lo = 0;
+        hi = t->num;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (t->str[mid].error < e)
+                lo = mid + 1;
+            else if (t->str[mid].error > e)
+                hi = mid;
+            else
+                return (ERR_STRING_DATA *)&t->str[mid];
+        }
+    }
+    return NULL;
+}
+
+/* Whether |str| is a table in |err_static_tables| */
+static int err_is_static(const ERR_STRING_DATA *str)
+{
+    int i;
+
+    for (i = 0; i < err_num_static; i++) {
+        if (err_static_tables[i].orig == str)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Append a sorted copy of the |num| strings of |str|, with library code
+ * |lib| if not zero, to |err_static_tables|.  |str| itself is not modified.
+ * Returns 0 if the strings must go into |int_error_hash| instead.  Called
+ * with |err_string_lock| held for writing.
+ */
+static int err_add_static(int lib, const ERR_STRING_DATA *str, size_t num)
+{
+    ERR_SORT_ITEM *items;
+    ERR_STRING_DATA *copy;
+    size_t i, n;
+
+    if (err_num_static == ERR_MAX_STATIC_TABLES)
+        return 0;
+    for (i = 0; i < num; i++) {
+        if (ERR_GET_LIB(str[i].error | ERR_PACK(lib, 0, 0)) >= ERR_LIB_USER)
+            return 0;
+    }
+    if (num == 0)
+        return 1;
+
+    items = OPENSSL_malloc(num * sizeof(*items));
+    copy = OPENSSL_malloc(num * sizeof(*copy));
+    if (items == NULL || copy == NULL) {
+        OPENSSL_free(items);
+        OPENSSL_free(copy);
+        return 0;
+    }
+    for (i = 0; i < num; i++) {
+        items[i].error = str[i].error | ERR_PACK(lib, 0, 0);
+        items[i].pos = i;
+        items[i].string = str[i].string;
+    }
+    qsort(items, num, sizeof(*items), err_sort_item_cmp);
+    for (i = n = 0; i < num; i++) {
+        if (i + 1 < num && items[i + 1].error == items[i].error)
+            continue;
+        copy[n].error = items[i].error;
+        copy[n].string = items[i].string;
+        n++;
+    }
+    OPENSSL_free(items);
+
+    err_static_tables[err_num_static].orig = str;
+    err_static_tables[err_num_static].str = copy;
+    err_static_tables[err_num_static].num = n;
+    err_counter_set(&err_num_static, err_num_static + 1);
+    return 1;
+}
+
 static ERR_STRING_DATA *int_err_get_item(const ERR_STRING_DATA *d)
 {
-    ERR_STRING_DATA *p = NULL;
+    ERR_STRING_DATA *p;
+
+    if ((p = err_get_static(d->error)) != NULL
+            || err_counter_get(&err_num_dynamic) == 0)
+        return p;
 
     CRYPTO_THREAD_read_lock(err_string_lock);
     if (int_error_hash != NULL)
@@ -254,13 +418,15 @@ DEFINE_RUN_ONCE_STATIC(do_err_strings_init)
 {
     OPENSSL_init_crypto(0, NULL);
     err_string_lock = CRYPTO_THREAD_lock_new();
-    return err_string_lock != NULL;
+    err_static_lock = CRYPTO_THREAD_lock_new();
+    return err_string_lock != NULL && err_static_lock != NULL;
 }
 
 void err_cleanup(void)
 {
     CRYPTO_THREAD_lock_free(err_string_lock);
-    err_string_lock = NULL;
+    CRYPTO_THREAD_lock_free(err_static_lock);
+    err_string_lock = err_static_lock = NULL;
 }
 
 int ERR_load_ERR_strings(void)
@@ -280,7 +446,16 @@ int ERR_load_ERR_strings(void)
 
 static void err_load_strings(int lib, ERR_STRING_DATA *str)
 {
+    size_t num;
+
     CRYPTO_THREAD_write_lock(err_string_lock);
+    if (err_is_static(str))
+        goto end;
+    for (num = 0; str[num].error; num++)
+        continue;
+    if (err_add_static(lib, str, num))
+        goto end;
+
     if (int_error_hash == NULL)
         int_error_hash = lh_ERR_STRING_DATA_new(err_string_data_hash,
                                                 err_string_data_cmp);
@@ -290,7 +465,10 @@ static void err_load_strings(int lib, ERR_STRING_DATA *str)
                 str->error |= ERR_PACK(lib, 0, 0);
             (void)lh_ERR_STRING_DATA_insert(int_error_hash, str);
         }
+        err_counter_set(&err_num_dynamic,
+                        (int)lh_ERR_STRING_DATA_num_items(int_error_hash));
     }
+ end:
     CRYPTO_THREAD_unlock(err_string_lock);
 }
 
@@ -308,12 +486,15 @@ int ERR_unload_strings(int lib, ERR_STRING_DATA *str)
         return 0;
 
     CRYPTO_THREAD_write_lock(err_string_lock);
-    if (int_error_hash != NULL) {
+    /* Strings of the built-in libraries stay loaded */
+    if (int_error_hash != NULL && !err_is_static(str)) {
         for (; str->error; str++) {
             if (lib)
                 str->error |= ERR_PACK(lib, 0, 0);
             (void)lh_ERR_STRING_DATA_delete(int_error_hash, str);
         }
+        err_counter_set(&err_num_dynamic,
+                        (int)lh_ERR_STRING_DATA_num_items(int_error_hash));
     }
     CRYPTO_THREAD_unlock(err_string_lock);
 
@@ -322,12 +503,18 @@ int ERR_unload_strings(int lib, ERR_STRING_DATA *str)
 
 void err_free_strings_int(void)
 {
+    int i;
+
     if (!RUN_ONCE(&err_string_init, do_err_strings_init))
         return;
 
     CRYPTO_THREAD_write_lock(err_string_lock);
     lh_ERR_STRING_DATA_free(int_error_hash);
     int_error_hash = NULL;
+    err_counter_set(&err_num_dynamic, 0);
+    for (i = 0; i < err_num_static; i++)
+        OPENSSL_free(err_static_tables[i].str);
+    err_counter_set(&err_num_static, 0);
     CRYPTO_THREAD_unlock(err_string_lock);
 }
 
@@ -357,7 +544,14 @@ void ERR_put_error(int lib, int func, int reason, const char *file, int line)
     }
 #endif
     es = ERR_get_state();
+    if (es == NULL)
+        return;
 
+    /*
+     * The error is queued even when suppressed: callers such as
+     * SSL_get_error() and X509_load_cert_file() peek at it to decide what
+     * happened.  Only the data attached to it is dropped.
+     */
     es->top = (es->top + 1) % ERR_NUM_ERRORS;
     if (es->top == es->bottom)
         es->bottom = (es->bottom + 1) % ERR_NUM_ERRORS;
@@ -374,9 +568,16 @@ void ERR_clear_error(void)
     ERR_STATE *es;
 
     es = ERR_get_state();
+    if (es == NULL)
+        return;
 
+    /*
+     * Records outside the queue are never read again and are overwritten by
+     * ERR_put_error(), but popped records may still own their data.
+     */
     for (i = 0; i < ERR_NUM_ERRORS; i++) {
-        err_clear(es, i);
+        if (es->err_data_flags[i] != 0)
+            err_clear_data(es, i);
     }
     es->top = es->bottom = 0;
 }
@@ -620,6 +821,9 @@ void err_delete_thread_state(void)
         return;
 
     CRYPTO_THREAD_set_local(&err_thread_local, NULL);
+#ifdef ERR_STATE_CACHE
+    err_state_cache = NULL;
+#endif
     ERR_STATE_free(state);
 }
 
@@ -644,6 +848,10 @@ ERR_STATE *ERR_get_state(void)
 {
     ERR_STATE *state = NULL;
 
+#ifdef ERR_STATE_CACHE
+    if (err_state_cache != NULL)
+        return err_state_cache;
+#endif
     if (!RUN_ONCE(&err_init, err_do_init))
         return NULL;
 
@@ -664,6 +872,9 @@ ERR_STATE *ERR_get_state(void)
         ossl_init_thread_start(OPENSSL_INIT_THREAD_ERR_STATE);
     }
 
+#ifdef ERR_STATE_CACHE
+    err_state_cache = state;
+#endif
     return state;
 }
 
@@ -687,6 +898,11 @@ void ERR_set_error_data(char *data, int flags)
     int i;
 
     es = ERR_get_state();
+    if (es == NULL || es->suppress > 0) {
+        if (flags & ERR_TXT_MALLOCED)
+            OPENSSL_free(data);
+        return;
+    }
 
     i = es->top;
     if (i == 0)
@@ -709,6 +925,10 @@ void ERR_add_error_vdata(int num, va_list args)
 {
     int i, n, s;
     char *str, *p, *a;
+    ERR_STATE *es = ERR_get_state();
+
+    if (es == NULL || es->suppress > 0)
+        return;
 
     s = 80;
     str = OPENSSL_malloc(s + 1);
@@ -768,3 +988,27 @@ int ERR_pop_to_mark(void)
     es->err_flags[es->top] &= ~ERR_FLAG_MARK;
     return 1;
 }
+
+int ERR_suppress_start(void)
+{
+    ERR_STATE *es;
+
+    es = ERR_get_state();
+    if (es == NULL)
+        return 0;
+
+    es->suppress++;
+    return 1;
+}
+
+int ERR_suppress_end(void)
+{
+    ERR_STATE *es;
+
+    es = ERR_get_state();
+    if (es == NULL || es->suppress == 0)
+        return 0;
+
+    es->suppress--;
+    return 1;
+}
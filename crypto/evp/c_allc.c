@@ -11,6 +11,7 @@
 #include "internal/cryptlib.h"
 #include <openssl/evp.h>
 #include <internal/evp_int.h>
+#include <internal/objects.h>
 #include <openssl/pkcs12.h>
 #include <openssl/objects.h>
 
@@ -247,4 +248,7 @@ void openssl_add_all_ciphers_int(void)
     EVP_add_cipher(EVP_chacha20_poly1305());
 # endif
 #endif
+
+    /* Resolve the names above once for EVP_get_cipherbyname() */
+    obj_name_snapshot_int(OBJ_NAME_TYPE_CIPHER_METH);
 }
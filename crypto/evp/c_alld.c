@@ -11,6 +11,7 @@
 #include "internal/cryptlib.h"
 #include <openssl/evp.h>
 #include <internal/evp_int.h>
+#include <internal/objects.h>
 #include <openssl/pkcs12.h>
 #include <openssl/objects.h>
 
@@ -46,4 +47,7 @@ void openssl_add_all_digests_int(void)
     EVP_add_digest(EVP_blake2b512());
     EVP_add_digest(EVP_blake2s256());
 #endif
+
+    /* Resolve the names above once for EVP_get_digestbyname() */
+    obj_name_snapshot_int(OBJ_NAME_TYPE_MD_METH);
 }
@@ -96,3 +96,5 @@ struct asn1_pctx_st {
 } /* ASN1_PCTX */ ;
 
 int asn1_valid_host(const ASN1_STRING *host);
+int asn1_time_diff_time_t(int *pday, int *psec,
+                          const ASN1_TIME *from, time_t to);
@@ -10,3 +10,4 @@
 #include <openssl/objects.h>
 
 void obj_cleanup_int(void);
+int obj_name_snapshot_int(int type);
@@ -35,6 +35,8 @@ struct X509_name_st {
     /* canonical encoding used for rapid Name comparison */
     unsigned char *canon_enc;
     int canon_enclen;
+    /* leading octets of the SHA1 digest of canon_enc, little endian */
+    uint64_t canon_hash;
 } /* X509_NAME */ ;
 
 /* PKCS#10 certificate request */
@@ -96,6 +98,17 @@ struct X509_crl_st {
     const X509_CRL_METHOD *meth;
     void *meth_data;
     CRYPTO_RWLOCK *lock;
+    /*
+     * Revoked entries left encoded in |crl.enc| by d2i_X509_CRL_compact():
+     * |compact_der| points to the contents of revokedCertificates and
+     * |compact| indexes the entries by serial number.  Entries that have
+     * been looked up are decoded into |compact_hits|.
+     */
+    const unsigned char *compact_der;
+    long compact_len;
+    struct x509_crl_entry_st *compact;
+    size_t compact_num;
+    LHASH_OF(X509_REVOKED) *compact_hits;
 };
 
 struct x509_revoked_st {
@@ -142,6 +155,18 @@ struct x509_cinf_st {
     ASN1_ENCODING enc;
 };
 
+/*
+ * A validity time converted when a certificate was decoded. It is only used
+ * while the time in the certificate still has the encoding in |data|, so
+ * that it does not go stale when the time is changed in any way.
+ */
+typedef struct x509_cached_time_st {
+    int type;
+    int length;                 /* 0 if nothing is cached */
+    unsigned char data[24];
+    time_t t;
+} X509_CACHED_TIME;
+
 struct x509_st {
     X509_CINF cert_info;
     X509_ALGOR sig_alg;
@@ -155,6 +180,8 @@ struct x509_st {
     uint32_t ex_kusage;
     uint32_t ex_xkusage;
     uint32_t ex_nscert;
+    /* X509_CACHED_* flags of the values below that are decoded on demand */
+    uint32_t ex_cached;
     ASN1_OCTET_STRING *skid;
     AUTHORITY_KEYID *akid;
     X509_POLICY_CACHE *policy_cache;
@@ -166,10 +193,18 @@ struct x509_st {
     struct ASIdentifiers_st *rfc3779_asid;
 # endif
     unsigned char sha1_hash[SHA_DIGEST_LENGTH];
+    /* If set, the signature was verified with the issuer key |sig_key| */
+    int sig_verified;
+    unsigned char sig_key[SHA256_DIGEST_LENGTH];
+    /* The validity period as decoded, see x509_check_cert_time() */
+    X509_CACHED_TIME not_before, not_after;
     X509_CERT_AUX *aux;
     CRYPTO_RWLOCK *lock;
 } /* X509 */ ;
 
+#define X509_CACHED_ALTNAME     0x1
+#define X509_CACHED_CRLDP       0x2
+
 /*
  * This is a used when verifying cert chains.  Since the gathering of the
  * cert chain can take some time (and have to be 'retried', this needs to be
@@ -238,6 +273,10 @@ struct x509_store_ctx_st {      /* X509_STORE_CTX */
     SSL_DANE *dane;
     /* signed via bare TA public key, rather than CA certificate */
     int bare_ta_signed;
+    /* earliest nextUpdate of the CRLs checked so far, 0 if none */
+    time_t crl_expires;
+    /* untrusted certificates shared by X509_verify_cert_batch(), owned */
+    STACK_OF(X509) *batch_untrusted;
 };
 
 /* PKCS#8 private key info structure */
@@ -263,7 +302,21 @@ struct x509_object_st {
         X509_CRL *crl;
         EVP_PKEY *pkey;
     } data;
+    /* next object with the same name in the index of an X509_STORE */
+    struct x509_object_st *next;
 };
 
 int a2i_ipadd(unsigned char *ipout, const char *ipasc);
 int x509_set1_time(ASN1_TIME **ptm, const ASN1_TIME *tm);
+int x509_time_to_time_t(const ASN1_TIME *ctm, time_t *t);
+void x509_cache_time(X509_CACHED_TIME *ct, const ASN1_TIME *tm);
+int x509_cached_time(const X509_CACHED_TIME *ct, const ASN1_TIME *tm,
+                     time_t *t);
+int x509_pubkey_sha256(const X509 *x, unsigned char *md);
+int x509_name_equal(const X509_NAME *a, const X509_NAME *b);
+int x509_crl_expand(X509_CRL *crl);
+X509_CRL *x509_crl_d2i_compact_own(unsigned char *der, long len,
+                                   const unsigned char *sha1);
+int x509_crl_read_bio(BIO *bp, int pem, X509_CRL **crl);
+STACK_OF(GENERAL_NAME) *x509v3_get0_altname(X509 *x);
+STACK_OF(DIST_POINT) *x509v3_get0_crldp(X509 *x);
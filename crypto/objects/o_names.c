@@ -16,6 +16,7 @@
 #include <openssl/objects.h>
 #include <openssl/safestack.h>
 #include <openssl/e_os2.h>
+#include "internal/objects.h"
 #include "obj_lcl.h"
 
 /*
@@ -53,6 +54,28 @@ struct name_funcs_st {
 
 static STACK_OF(NAME_FUNCS) *name_funcs_stack;
 
+/*
+ * Snapshot of the names of one of the predefined types, taken by
+ * obj_name_snapshot_int() once the built-in names have been added.  Aliases
+ * are resolved and lookups probe an open addressing table rather than
+ * |names_lh|.  A snapshot is never modified.  It is disabled when one of its
+ * names is removed or added again with different data, and names added
+ * after it was taken are looked up in |names_lh|.
+ */
+typedef struct {
+    const char *name;
+    const char *data;
+    unsigned long hash;
+} OBJ_NAME_SNAPSHOT_ENTRY;
+
+typedef struct {
+    OBJ_NAME_SNAPSHOT_ENTRY *entries;
+    size_t mask;
+    int enabled;
+} OBJ_NAME_SNAPSHOT;
+
+static OBJ_NAME_SNAPSHOT *names_snapshot[OBJ_NAME_TYPE_NUM];
+
 /*
  * The LHASH callbacks now use the raw "void *" prototypes and do
  * per-variable casting in the functions. This prevents function pointer
@@ -153,18 +176,46 @@ static unsigned long obj_name_hash(const OBJ_NAME *a)
     return (ret);
 }
 
-const char *OBJ_NAME_get(const char *name, int type)
+static OBJ_NAME_SNAPSHOT_ENTRY *snapshot_find(OBJ_NAME_SNAPSHOT *snap,
+                                             const char *name,
+                                             unsigned long hash)
 {
-    OBJ_NAME on, *ret;
-    int num = 0, alias;
+    OBJ_NAME_SNAPSHOT_ENTRY *e;
+    size_t i;
 
-    if (name == NULL)
-        return (NULL);
-    if ((names_lh == NULL) && !OBJ_NAME_init())
-        return (NULL);
+    for (i = hash & snap->mask; (e = &snap->entries[i])->name != NULL;
+         i = (i + 1) & snap->mask) {
+        if (e->hash == hash && strcmp(e->name, name) == 0)
+            return e;
+    }
+    return NULL;
+}
 
-    alias = type & OBJ_NAME_ALIAS;
-    type &= ~OBJ_NAME_ALIAS;
+static void snapshot_free(OBJ_NAME_SNAPSHOT *snap)
+{
+    if (snap == NULL)
+        return;
+    OPENSSL_free(snap->entries);
+    OPENSSL_free(snap);
+}
+
+/* Disable the snapshot of |type| if |name| is in it */
+static void snapshot_disable(const char *name, int type)
+{
+    OBJ_NAME_SNAPSHOT *snap;
+
+    if (type < 0 || type >= OBJ_NAME_TYPE_NUM
+            || (snap = names_snapshot[type]) == NULL || !snap->enabled)
+        return;
+    if (snapshot_find(snap, name, OPENSSL_LH_strhash(name)) != NULL)
+        snap->enabled = 0;
+}
+
+/* Look up |name| in |names_lh|, following aliases unless |alias| is set */
+static const char *obj_name_lh_get(const char *name, int type, int alias)
+{
+    OBJ_NAME on, *ret;
+    int num = 0;
 
     on.name = name;
     on.type = type;
@@ -183,6 +234,108 @@ const char *OBJ_NAME_get(const char *name, int type)
     }
 }
 
+const char *OBJ_NAME_get(const char *name, int type)
+{
+    OBJ_NAME_SNAPSHOT *snap;
+    OBJ_NAME_SNAPSHOT_ENTRY *e;
+    int alias;
+
+    if (name == NULL)
+        return (NULL);
+    if ((names_lh == NULL) && !OBJ_NAME_init())
+        return (NULL);
+
+    alias = type & OBJ_NAME_ALIAS;
+    type &= ~OBJ_NAME_ALIAS;
+
+    if (!alias && type >= 0 && type < OBJ_NAME_TYPE_NUM
+            && (snap = names_snapshot[type]) != NULL && snap->enabled
+            && (e = snapshot_find(snap, name,
+                                  OPENSSL_LH_strhash(name))) != NULL)
+        return e->data;
+    return obj_name_lh_get(name, type, alias);
+}
+
+typedef struct {
+    int type;
+    int num;
+    OBJ_NAME_SNAPSHOT *snap;
+} OBJ_SNAPSHOT_ARG;
+
+static void snapshot_count_fn(const OBJ_NAME *name, OBJ_SNAPSHOT_ARG *arg)
+{
+    if (name->type == arg->type)
+        arg->num++;
+}
+
+static void snapshot_add_fn(const OBJ_NAME *name, OBJ_SNAPSHOT_ARG *arg)
+{
+    OBJ_NAME_SNAPSHOT *snap = arg->snap;
+    const char *data;
+    unsigned long hash;
+    size_t i;
+
+    if (name->type != arg->type
+            || (data = obj_name_lh_get(name->name, name->type, 0)) == NULL)
+        return;
+    hash = OPENSSL_LH_strhash(name->name);
+    for (i = hash & snap->mask; snap->entries[i].name != NULL;
+         i = (i + 1) & snap->mask)
+        continue;
+    snap->entries[i].name = name->name;
+    snap->entries[i].data = data;
+    snap->entries[i].hash = hash;
+}
+
+IMPLEMENT_LHASH_DOALL_ARG_CONST(OBJ_NAME, OBJ_SNAPSHOT_ARG);
+
+/*
+ * Take a snapshot of the names of |type|, which must be one of the
+ * predefined types and use the default hash and comparison functions.
+ * Like additions of names, this must not run concurrently with lookups.
+ */
+int obj_name_snapshot_int(int type)
+{
+    OBJ_SNAPSHOT_ARG arg;
+    OBJ_NAME_SNAPSHOT *snap;
+    NAME_FUNCS *funcs;
+    size_t size = 16;
+
+    if (type < 0 || type >= OBJ_NAME_TYPE_NUM
+            || (names_lh == NULL && !OBJ_NAME_init()))
+        return 0;
+    if (name_funcs_stack != NULL
+            && sk_NAME_FUNCS_num(name_funcs_stack) > type) {
+        funcs = sk_NAME_FUNCS_value(name_funcs_stack, type);
+        if (funcs->hash_func != OPENSSL_LH_strhash
+                || funcs->cmp_func != obj_strcmp)
+            return 0;
+    }
+
+    arg.type = type;
+    arg.num = 0;
+    lh_OBJ_NAME_doall_OBJ_SNAPSHOT_ARG(names_lh, snapshot_count_fn, &arg);
+    /* Keep the table at most half full */
+    while (size < 2 * (size_t)arg.num)
+        size <<= 1;
+
+    if ((snap = OPENSSL_zalloc(sizeof(*snap))) == NULL
+            || (snap->entries = OPENSSL_zalloc(sizeof(*snap->entries)
+                                               * size)) == NULL) {
+        OBJerr(OBJ_F_OBJ_NAME_SNAPSHOT_INT, ERR_R_MALLOC_FAILURE);
+        OPENSSL_free(snap);
+        return 0;
+    }
+    snap->mask = size - 1;
+    arg.snap = snap;
+    lh_OBJ_NAME_doall_OBJ_SNAPSHOT_ARG(names_lh, snapshot_add_fn, &arg);
+    snap->enabled = 1;
+
+    snapshot_free(names_snapshot[type]);
+    names_snapshot[type] = snap;
+    return 1;
+}
+
 int OBJ_NAME_add(const char *name, int type, const char *data)
 {
     OBJ_NAME *onp, *ret;
@@ -207,6 +360,8 @@ int OBJ_NAME_add(const char *name, int type, const char *data)
 
     ret = lh_OBJ_NAME_insert(names_lh, onp);
     if (ret != NULL) {
+        if (ret->alias != alias || ret->data != data)
+            snapshot_disable(name, type);
         /* free things */
         if ((name_funcs_stack != NULL)
             && (sk_NAME_FUNCS_num(name_funcs_stack) > ret->type)) {
@@ -241,6 +396,7 @@ int OBJ_NAME_remove(const char *name, int type)
     on.type = type;
     ret = lh_OBJ_NAME_delete(names_lh, &on);
     if (ret != NULL) {
+        snapshot_disable(name, type);
         /* free things */
         if ((name_funcs_stack != NULL)
             && (sk_NAME_FUNCS_num(name_funcs_stack) > ret->type)) {
@@ -351,10 +507,18 @@ static void name_funcs_free(NAME_FUNCS *ptr)
 void OBJ_NAME_cleanup(int type)
 {
     unsigned long down_load;
+    int i;
 
     if (names_lh == NULL)
         return;
 
+    for (i = 0; i < OBJ_NAME_TYPE_NUM; i++) {
+        if (type < 0 || type == i) {
+            snapshot_free(names_snapshot[i]);
+            names_snapshot[i] = NULL;
+        }
+    }
+
     free_type = type;
     down_load = lh_OBJ_NAME_get_down_load(names_lh);
     lh_OBJ_NAME_set_down_load(names_lh, 0);
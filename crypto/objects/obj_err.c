@@ -23,6 +23,7 @@ static ERR_STRING_DATA OBJ_str_functs[] = {
     {ERR_FUNC(OBJ_F_OBJ_CREATE), "OBJ_create"},
     {ERR_FUNC(OBJ_F_OBJ_DUP), "OBJ_dup"},
     {ERR_FUNC(OBJ_F_OBJ_NAME_NEW_INDEX), "OBJ_NAME_new_index"},
+    {ERR_FUNC(OBJ_F_OBJ_NAME_SNAPSHOT_INT), "obj_name_snapshot_int"},
     {ERR_FUNC(OBJ_F_OBJ_NID2LN), "OBJ_nid2ln"},
     {ERR_FUNC(OBJ_F_OBJ_NID2OBJ), "OBJ_nid2obj"},
     {ERR_FUNC(OBJ_F_OBJ_NID2SN), "OBJ_nid2sn"},
@@ -17,6 +17,7 @@
 #include <openssl/rsa.h>
 #include <openssl/dsa.h>
 #include <openssl/dh.h>
+#include "internal/x509_int.h"
 
 #ifndef OPENSSL_NO_RSA
 static RSA *pkey_get_rsa(EVP_PKEY *key, RSA **rsa);
@@ -33,6 +34,27 @@ IMPLEMENT_PEM_rw(X509_REQ, X509_REQ, PEM_STRING_X509_REQ, X509_REQ)
 
 IMPLEMENT_PEM_write(X509_REQ_NEW, X509_REQ, PEM_STRING_X509_REQ_OLD, X509_REQ)
 IMPLEMENT_PEM_rw(X509_CRL, X509_CRL, PEM_STRING_X509_CRL, X509_CRL)
+
+/*
+ * Read a CRL with d2i_X509_CRL_compact(), decoding the PEM as it is read
+ * rather than holding all of it in memory.
+ */
+X509_CRL *PEM_read_bio_X509_CRL_compact(BIO *bp, X509_CRL **x)
+{
+    X509_CRL *ret;
+    int i;
+
+    if ((i = x509_crl_read_bio(bp, 1, &ret)) <= 0) {
+        if (i < 0)
+            PEMerr(PEM_F_PEM_READ_BIO_X509_CRL_COMPACT, PEM_R_NO_START_LINE);
+        return NULL;
+    }
+    if (x != NULL) {
+        X509_CRL_free(*x);
+        *x = ret;
+    }
+    return ret;
+}
 IMPLEMENT_PEM_rw(PKCS7, PKCS7, PEM_STRING_PKCS7, PKCS7)
 
 IMPLEMENT_PEM_rw(NETSCAPE_CERT_SEQUENCE, NETSCAPE_CERT_SEQUENCE,
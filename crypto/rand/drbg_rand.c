@@ -0,0 +1,404 @@
+/*
+ * Copyright 2017 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the OpenSSL license (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "e_os.h"
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/err.h>
+#include "internal/cryptlib_int.h"
+#include "internal/rand.h"
+#include "rand_lcl.h"
+
+#include <internal/thread_once.h>
+
+#if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG) \
+    && defined(OPENSSL_SYS_UNIX)
+# include <pthread.h>
+# define DRBG_USE_ATFORK
+#endif
+
+/*
+ * The default RAND method is a CTR_DRBG as specified in NIST SP 800-90A,
+ * using AES-256 without a derivation function.  The md_rand pool keeps
+ * collecting the input of RAND_add() and RAND_poll() and seeds a master
+ * DRBG.  Each thread generates from its own DRBG, which reseeds from the
+ * master, so that RAND_bytes() only takes a lock when that happens.
+ * Small requests are served from a buffer of output the thread DRBG
+ * generates in advance.
+ */
+
+/* Maximum number of octets generated between two updates of the state */
+#define DRBG_MAX_REQUEST        (1 << 16)
+/* Number of requests a thread DRBG serves before reseeding */
+#define DRBG_RESEED_INTERVAL    (1 << 16)
+/* Number of thread DRBG seeds the master provides before reseeding */
+#define MASTER_RESEED_INTERVAL  (1 << 8)
+/* Size of the output buffer of thread DRBGs */
+#define DRBG_BUFLEN             4096
+/* Largest request served from that buffer */
+#define DRBG_SMALL_REQUEST      256
+
+struct drbg_ctx_st {
+    EVP_CIPHER_CTX *cipher;
+    unsigned char K[DRBG_KEYLEN];
+    unsigned char V[DRBG_BLOCKLEN];
+    int seeded;
+    unsigned int reseed_counter;
+    /* Value of |seed_generation| when last seeded */
+    int generation;
+    /* Value of drbg_fork_id() when last seeded */
+    long fork_id;
+    /* Output not yet returned is the last |avail| octets of |buf| */
+    size_t avail;
+    unsigned char buf[DRBG_BUFLEN];
+};
+
+static DRBG_CTX *master = NULL;
+static CRYPTO_RWLOCK *master_lock = NULL;
+/* Incremented by RAND_add() and RAND_seed() to have all DRBGs reseed */
+static int seed_generation = 0;
+static CRYPTO_RWLOCK *seed_generation_lock = NULL;
+static CRYPTO_THREAD_LOCAL drbg_thread_local;
+static CRYPTO_ONCE drbg_init = CRYPTO_ONCE_STATIC_INIT;
+static int drbg_inited = 0;
+#ifdef DRBG_USE_ATFORK
+/* Incremented in the child process after fork() */
+static int fork_count = 0;
+#endif
+
+static int drbg_seed(const void *buf, int num);
+static int drbg_rand_bytes(unsigned char *buf, int num);
+static void drbg_cleanup(void);
+static int drbg_add(const void *buf, int num, double add_entropy);
+#if OPENSSL_API_COMPAT < 0x10100000L
+static int drbg_pseudo_bytes(unsigned char *buf, int num);
+#endif
+static int drbg_status(void);
+
+static RAND_METHOD drbg_meth = {
+    drbg_seed,
+    drbg_rand_bytes,
+    drbg_cleanup,
+    drbg_add,
+#if OPENSSL_API_COMPAT < 0x10100000L
+    drbg_pseudo_bytes,
+#else
+    NULL,
+#endif
+    drbg_status
+};
+
+#ifdef DRBG_USE_ATFORK
+static void drbg_fork_child(void)
+{
+    fork_count++;
+}
+#endif
+
+/* Identifies the process that the state of a DRBG belongs to */
+static long drbg_fork_id(void)
+{
+#if defined(DRBG_USE_ATFORK)
+    return fork_count;
+#elif !defined(GETPID_IS_MEANINGLESS)
+    return (long)getpid();
+#else
+    return 0;
+#endif
+}
+
+DEFINE_RUN_ONCE_STATIC(do_drbg_init)
+{
+    OPENSSL_init_crypto(0, NULL);
+    master_lock = CRYPTO_THREAD_lock_new();
+    seed_generation_lock = CRYPTO_THREAD_lock_new();
+    if (master_lock == NULL || seed_generation_lock == NULL
+#ifdef DRBG_USE_ATFORK
+            || pthread_atfork(NULL, NULL, drbg_fork_child) != 0
+#endif
+            || !CRYPTO_THREAD_init_local(&drbg_thread_local, NULL)) {
+        CRYPTO_THREAD_lock_free(master_lock);
+        CRYPTO_THREAD_lock_free(seed_generation_lock);
+        master_lock = seed_generation_lock = NULL;
+        return 0;
+    }
+    drbg_inited = 1;
+    return 1;
+}
+
+RAND_METHOD *RAND_OpenSSL(void)
+{
+    return &drbg_meth;
+}
+
+DRBG_CTX *rand_drbg_new(void)
+{
+    DRBG_CTX *drbg = OPENSSL_zalloc(sizeof(*drbg));
+
+    if (drbg == NULL || (drbg->cipher = EVP_CIPHER_CTX_new()) == NULL) {
+        RANDerr(RAND_F_RAND_BYTES, ERR_R_MALLOC_FAILURE);
+        OPENSSL_free(drbg);
+        return NULL;
+    }
+    return drbg;
+}
+
+void rand_drbg_free(DRBG_CTX *drbg)
+{
+    if (drbg == NULL)
+        return;
+    EVP_CIPHER_CTX_free(drbg->cipher);
+    OPENSSL_clear_free(drbg, sizeof(*drbg));
+}
+
+/*
+ * Generate |outlen| octets into |out|, then update the state with |provided|,
+ * which is DRBG_SEEDLEN octets or NULL for all zeroes.  Both take the key
+ * stream E(K, V + 1), E(K, V + 2), ... of AES-256-CTR, and the update starts
+ * with the block that follows the last one used for |out|.
+ */
+static int drbg_ctr_update(DRBG_CTX *drbg, unsigned char *out, size_t outlen,
+                           const unsigned char *provided)
+{
+    unsigned char iv[DRBG_BLOCKLEN], tmp[DRBG_BLOCKLEN + DRBG_SEEDLEN];
+    unsigned char *seed;
+    size_t full = outlen & ~(size_t)(DRBG_BLOCKLEN - 1);
+    size_t rest = outlen - full;
+    int tmplen = (rest > 0 ? DRBG_BLOCKLEN : 0) + DRBG_SEEDLEN;
+    int i, outl, ret = 0;
+
+    memcpy(iv, drbg->V, sizeof(iv));
+    for (i = DRBG_BLOCKLEN - 1; i >= 0 && ++iv[i] == 0; i--)
+        continue;
+    if (!EVP_EncryptInit_ex(drbg->cipher, EVP_aes_256_ctr(), NULL, drbg->K,
+                            iv))
+        goto err;
+    if (full > 0) {
+        memset(out, 0, full);
+        if (!EVP_EncryptUpdate(drbg->cipher, out, &outl, out, (int)full))
+            goto err;
+    }
+    memset(tmp, 0, tmplen);
+    if (!EVP_EncryptUpdate(drbg->cipher, tmp, &outl, tmp, tmplen))
+        goto err;
+    if (rest > 0)
+        memcpy(out + full, tmp, rest);
+
+    seed = tmp + tmplen - DRBG_SEEDLEN;
+    if (provided != NULL) {
+        for (i = 0; i < DRBG_SEEDLEN; i++)
+            seed[i] ^= provided[i];
+    }
+    memcpy(drbg->K, seed, DRBG_KEYLEN);
+    memcpy(drbg->V, seed + DRBG_KEYLEN, DRBG_BLOCKLEN);
+    ret = 1;
+
+ err:
+    OPENSSL_cleanse(iv, sizeof(iv));
+    OPENSSL_cleanse(tmp, sizeof(tmp));
+    if (!ret) {
+        drbg->seeded = 0;
+        RANDerr(RAND_F_RAND_BYTES, ERR_R_EVP_LIB);
+    }
+    return ret;
+}
+
+/* Instantiate or reseed |drbg| with DRBG_SEEDLEN octets of |seed| */
+int rand_drbg_reseed(DRBG_CTX *drbg, const unsigned char *seed)
+{
+    if (!drbg->seeded) {
+        memset(drbg->K, 0, sizeof(drbg->K));
+        memset(drbg->V, 0, sizeof(drbg->V));
+    }
+    if (!drbg_ctr_update(drbg, NULL, 0, seed))
+        return 0;
+    drbg->seeded = 1;
+    drbg->reseed_counter = 1;
+    drbg->fork_id = drbg_fork_id();
+    return 1;
+}
+
+int rand_drbg_generate(DRBG_CTX *drbg, unsigned char *out, size_t outlen)
+{
+    size_t chunk;
+
+    while (outlen > 0) {
+        chunk = outlen > DRBG_MAX_REQUEST ? DRBG_MAX_REQUEST : outlen;
+        if (!drbg_ctr_update(drbg, out, chunk, NULL))
+            return 0;
+        drbg->reseed_counter++;
+        out += chunk;
+        outlen -= chunk;
+    }
+    return 1;
+}
+
+/* Whether |drbg| must be reseeded before serving another request */
+static int drbg_need_reseed(DRBG_CTX *drbg, int generation,
+                            unsigned int interval)
+{
+    /* Parent and child must not share the state after fork() */
+    return !drbg->seeded || drbg->generation != generation
+           || drbg->reseed_counter > interval
+           || drbg->fork_id != drbg_fork_id();
+}
+
+/*
+ * Output DRBG_SEEDLEN octets of the master DRBG into |seed|, reseeding it
+ * from the md_rand pool first if needed.  Called with |master_lock| held.
+ */
+static int master_get_seed(unsigned char *seed, int generation)
+{
+    unsigned char entropy[DRBG_SEEDLEN];
+    int ret = 0;
+
+    if (master == NULL && (master = rand_drbg_new()) == NULL)
+        return 0;
+    if (drbg_need_reseed(master, generation, MASTER_RESEED_INTERVAL)) {
+        if (rand_md_method()->bytes(entropy, sizeof(entropy)) <= 0
+                || !rand_drbg_reseed(master, entropy))
+            goto end;
+        master->generation = generation;
+    }
+    ret = rand_drbg_generate(master, seed, DRBG_SEEDLEN);
+
+ end:
+    OPENSSL_cleanse(entropy, sizeof(entropy));
+    return ret;
+}
+
+static DRBG_CTX *drbg_get_thread(void)
+{
+    DRBG_CTX *drbg;
+
+    if (!RUN_ONCE(&drbg_init, do_drbg_init)) {
+        RANDerr(RAND_F_RAND_BYTES, ERR_R_MALLOC_FAILURE);
+        return NULL;
+    }
+
+    drbg = CRYPTO_THREAD_get_local(&drbg_thread_local);
+    if (drbg == NULL) {
+        if ((drbg = rand_drbg_new()) == NULL)
+            return NULL;
+        if (!CRYPTO_THREAD_set_local(&drbg_thread_local, drbg)) {
+            rand_drbg_free(drbg);
+            return NULL;
+        }
+        ossl_init_thread_start(OPENSSL_INIT_THREAD_RAND);
+    }
+    return drbg;
+}
+
+void rand_delete_thread_state(void)
+{
+    DRBG_CTX *drbg;
+
+    if (!drbg_inited)
+        return;
+    drbg = CRYPTO_THREAD_get_local(&drbg_thread_local);
+    CRYPTO_THREAD_set_local(&drbg_thread_local, NULL);
+    rand_drbg_free(drbg);
+}
+
+static int drbg_rand_bytes(unsigned char *buf, int num)
+{
+    DRBG_CTX *drbg;
+    unsigned char seed[DRBG_SEEDLEN], *p;
+    int generation, ok;
+
+#ifdef PREDICT
+    if (rand_predictable)
+        return rand_md_method()->bytes(buf, num);
+#endif
+
+    if (num <= 0)
+        return 1;
+    if ((drbg = drbg_get_thread()) == NULL)
+        return 0;
+
+    if (!CRYPTO_atomic_add(&seed_generation, 0, &generation,
+                           seed_generation_lock))
+        return 0;
+    if (drbg_need_reseed(drbg, generation, DRBG_RESEED_INTERVAL)) {
+        /* Output generated before reseeding must not be returned after */
+        OPENSSL_cleanse(drbg->buf, sizeof(drbg->buf));
+        drbg->avail = 0;
+        CRYPTO_THREAD_write_lock(master_lock);
+        ok = master_get_seed(seed, generation);
+        CRYPTO_THREAD_unlock(master_lock);
+        ok = ok && rand_drbg_reseed(drbg, seed);
+        OPENSSL_cleanse(seed, sizeof(seed));
+        if (!ok)
+            return 0;
+        drbg->generation = generation;
+    }
+
+    if (num > DRBG_SMALL_REQUEST)
+        return rand_drbg_generate(drbg, buf, (size_t)num);
+    if (drbg->avail < (size_t)num) {
+        drbg->avail = 0;
+        if (!rand_drbg_generate(drbg, drbg->buf, sizeof(drbg->buf)))
+            return 0;
+        drbg->avail = sizeof(drbg->buf);
+    }
+    p = drbg->buf + sizeof(drbg->buf) - drbg->avail;
+    memcpy(buf, p, num);
+    OPENSSL_cleanse(p, num);
+    drbg->avail -= num;
+    return 1;
+}
+
+#if OPENSSL_API_COMPAT < 0x10100000L
+static int drbg_pseudo_bytes(unsigned char *buf, int num)
+{
+    return rand_md_method()->pseudorand(buf, num);
+}
+#endif
+
+static int drbg_add(const void *buf, int num, double add_entropy)
+{
+    int dummy;
+
+    if (!rand_md_method()->add(buf, num, add_entropy))
+        return 0;
+    if (!RUN_ONCE(&drbg_init, do_drbg_init))
+        return 0;
+    return CRYPTO_atomic_add(&seed_generation, 1, &dummy,
+                             seed_generation_lock);
+}
+
+static int drbg_seed(const void *buf, int num)
+{
+    return drbg_add(buf, num, (double)num);
+}
+
+static int drbg_status(void)
+{
+    return rand_md_method()->status();
+}
+
+static void drbg_cleanup(void)
+{
+    if (drbg_inited) {
+        rand_delete_thread_state();
+        CRYPTO_THREAD_cleanup_local(&drbg_thread_local);
+        rand_drbg_free(master);
+        master = NULL;
+        CRYPTO_THREAD_lock_free(master_lock);
+        CRYPTO_THREAD_lock_free(seed_generation_lock);
+        master_lock = seed_generation_lock = NULL;
+        drbg_inited = 0;
+    }
+    rand_md_method()->cleanup();
+}
@@ -29,12 +29,6 @@
 
 #include <internal/thread_once.h>
 
-#if defined(BN_DEBUG) || defined(FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION)
-# define PREDICT
-#endif
-
-/* #define PREDICT      1 */
-
 #define STATE_SIZE      1023
 static size_t state_num = 0, state_index = 0;
 static unsigned char state[STATE_SIZE + MD_DIGEST_LENGTH];
@@ -91,7 +85,8 @@ DEFINE_RUN_ONCE_STATIC(do_rand_lock_init)
     return rand_lock != NULL && rand_tmp_lock != NULL;
 }
 
-RAND_METHOD *RAND_OpenSSL(void)
+/* The entropy pool that seeds the DRBGs of RAND_OpenSSL() */
+RAND_METHOD *rand_md_method(void)
 {
     return (&rand_meth);
 }
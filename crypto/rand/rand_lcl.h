@@ -12,6 +12,16 @@
 
 # define ENTROPY_NEEDED 32      /* require 256 bits = 32 bytes of randomness */
 
+# if defined(BN_DEBUG) || defined(FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION)
+#  define PREDICT
+# endif
+
+/* #define PREDICT      1 */
+
+# ifdef PREDICT
+extern int rand_predictable;
+# endif
+
 # if !defined(USE_MD5_RAND) && !defined(USE_SHA1_RAND) && !defined(USE_MDC2_RAND) && !defined(USE_MD2_RAND)
 #  define USE_SHA1_RAND
 # endif
@@ -42,5 +52,18 @@
 # endif
 
 void rand_hw_xor(unsigned char *buf, size_t num);
+RAND_METHOD *rand_md_method(void);
+
+/* The CTR_DRBG of the default RAND method, see drbg_rand.c */
+# define DRBG_KEYLEN             32
+# define DRBG_BLOCKLEN           16
+# define DRBG_SEEDLEN            (DRBG_KEYLEN + DRBG_BLOCKLEN)
+
+typedef struct drbg_ctx_st DRBG_CTX;
+
+DRBG_CTX *rand_drbg_new(void);
+void rand_drbg_free(DRBG_CTX *drbg);
+int rand_drbg_reseed(DRBG_CTX *drbg, const unsigned char *seed);
+int rand_drbg_generate(DRBG_CTX *drbg, unsigned char *out, size_t outlen);
 
 #endif
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <errno.h>
+#include <ctype.h>
 
 #include "internal/cryptlib.h"
 
@@ -23,6 +24,7 @@
 
 #include <openssl/lhash.h>
 #include <openssl/x509.h>
+#include "internal/o_dir.h"
 #include "internal/x509_int.h"
 #include "x509_lcl.h"
 
@@ -31,18 +33,41 @@ struct lookup_dir_hashes_st {
     int suffix;
 };
 
+/* A hashed file name "hash.N" or, for a CRL, "hash.rN" */
+typedef struct lookup_dir_file_st {
+    unsigned long hash;
+    int crl;
+    int suffix;
+} BY_DIR_FILE;
+
+DEFINE_STACK_OF(BY_DIR_FILE)
+
 struct lookup_dir_entry_st {
     char *dir;
     int dir_type;
     STACK_OF(BY_DIR_HASH) *hashes;
+    /*
+     * Sorted snapshot of the hashed file names in the directory, NULL if
+     * there is none. It is taken at time |taken| when the modification time
+     * of the directory was |mtime|, which was last checked at time |checked|.
+     */
+    STACK_OF(BY_DIR_FILE) *files;
+    time_t taken;
+    time_t mtime;
+    time_t checked;
 };
 
 typedef struct lookup_dir_st {
     BUF_MEM *buffer;
     STACK_OF(BY_DIR_ENTRY) *dirs;
     CRYPTO_RWLOCK *lock;
+    /* Seconds a directory snapshot is used without checking the directory */
+    long cache_ttl;
 } BY_DIR;
 
+/* Default for the directory snapshot time to live, in seconds */
+#define BY_DIR_CACHE_TTL_DEFAULT 1
+
 static int dir_ctrl(X509_LOOKUP *ctx, int cmd, const char *argp, long argl,
                     char **ret);
 static int new_dir(X509_LOOKUP *lu);
@@ -92,6 +117,14 @@ static int dir_ctrl(X509_LOOKUP *ctx, int cmd, const char *argp, long argl,
         } else
             ret = add_cert_dir(ld, argp, (int)argl);
         break;
+    case X509_L_DIR_CACHE_TTL:
+        if (argl < 0)
+            break;
+        CRYPTO_THREAD_write_lock(ld->lock);
+        ld->cache_ttl = argl;
+        CRYPTO_THREAD_unlock(ld->lock);
+        ret = 1;
+        break;
     }
     return (ret);
 }
@@ -107,6 +140,7 @@ static int new_dir(X509_LOOKUP *lu)
         return 0;
     }
     a->dirs = NULL;
+    a->cache_ttl = BY_DIR_CACHE_TTL_DEFAULT;
     a->lock = CRYPTO_THREAD_lock_new();
     if (a->lock == NULL) {
         BUF_MEM_free(a->buffer);
@@ -132,10 +166,26 @@ static int by_dir_hash_cmp(const BY_DIR_HASH *const *a,
     return 0;
 }
 
+static void by_dir_file_free(BY_DIR_FILE *file)
+{
+    OPENSSL_free(file);
+}
+
+static int by_dir_file_cmp(const BY_DIR_FILE *const *a,
+                           const BY_DIR_FILE *const *b)
+{
+    if ((*a)->hash != (*b)->hash)
+        return (*a)->hash > (*b)->hash ? 1 : -1;
+    if ((*a)->crl != (*b)->crl)
+        return (*a)->crl - (*b)->crl;
+    return (*a)->suffix - (*b)->suffix;
+}
+
 static void by_dir_entry_free(BY_DIR_ENTRY *ent)
 {
     OPENSSL_free(ent->dir);
     sk_BY_DIR_HASH_pop_free(ent->hashes, by_dir_hash_free);
+    sk_BY_DIR_FILE_pop_free(ent->files, by_dir_file_free);
     OPENSSL_free(ent);
 }
 
@@ -186,7 +236,7 @@ static int add_cert_dir(BY_DIR *ctx, const char *dir, int type)
                     return 0;
                 }
             }
-            ent = OPENSSL_malloc(sizeof(*ent));
+            ent = OPENSSL_zalloc(sizeof(*ent));
             if (ent == NULL)
                 return 0;
             ent->dir_type = type;
@@ -205,32 +255,157 @@ static int add_cert_dir(BY_DIR *ctx, const char *dir, int type)
     return 1;
 }
 
+#ifndef OPENSSL_NO_POSIX_IO
+# ifdef _WIN32
+#  define stat _stat
+# endif
+
+/*
+ * Parse a hashed file name into |file|. Returns 0 if |name| is not of the
+ * form "hash.N" or "hash.rN".
+ */
+static int dir_parse_name(const char *name, BY_DIR_FILE *file)
+{
+    int i;
+
+    file->hash = 0;
+    for (i = 0; i < 8; i++) {
+        if (!isxdigit((unsigned char)name[i]))
+            return 0;
+        file->hash = (file->hash << 4) | OPENSSL_hexchar2int(name[i]);
+    }
+    if (name[i++] != '.')
+        return 0;
+    file->crl = name[i] == 'r';
+    if (file->crl)
+        i++;
+    if (name[i] == '\0')
+        return 0;
+    for (file->suffix = 0; name[i] != '\0'; i++) {
+        if (!isdigit((unsigned char)name[i]) || file->suffix > 99999)
+            return 0;
+        file->suffix = file->suffix * 10 + (name[i] - '0');
+    }
+    return 1;
+}
+
+/* Read the hashed file names in the directory of |ent|, NULL on error */
+static STACK_OF(BY_DIR_FILE) *dir_read_files(BY_DIR_ENTRY *ent)
+{
+    STACK_OF(BY_DIR_FILE) *files = sk_BY_DIR_FILE_new(by_dir_file_cmp);
+    OPENSSL_DIR_CTX *d = NULL;
+    BY_DIR_FILE tmp, *file;
+    const char *name;
+
+    if (files == NULL)
+        return NULL;
+    while ((name = OPENSSL_DIR_read(&d, ent->dir)) != NULL) {
+        if (!dir_parse_name(name, &tmp))
+            continue;
+        if ((file = OPENSSL_malloc(sizeof(*file))) == NULL
+                || !sk_BY_DIR_FILE_push(files, file)) {
+            OPENSSL_free(file);
+            goto err;
+        }
+        *file = tmp;
+    }
+    if (errno != 0)
+        goto err;
+    if (d != NULL)
+        OPENSSL_DIR_end(&d);
+    sk_BY_DIR_FILE_sort(files);
+    return files;
+
+ err:
+    if (d != NULL)
+        OPENSSL_DIR_end(&d);
+    sk_BY_DIR_FILE_pop_free(files, by_dir_file_free);
+    return NULL;
+}
+
+/*
+ * Bring the snapshot of the directory of |ent| up to date at time |now|: it is
+ * read again only if the modification time of the directory has changed or
+ * the snapshot was taken in the same second as the last modification, which
+ * may have been followed by others that leave the time unchanged. Locked by
+ * the BY_DIR lock in the calling function.
+ */
+static void dir_update_files(BY_DIR_ENTRY *ent, time_t now)
+{
+    struct stat st;
+
+    ent->checked = now;
+    if (stat(ent->dir, &st) < 0) {
+        sk_BY_DIR_FILE_pop_free(ent->files, by_dir_file_free);
+        ent->files = NULL;
+        return;
+    }
+    if (ent->files != NULL && st.st_mtime == ent->mtime
+            && ent->taken > ent->mtime)
+        return;
+    sk_BY_DIR_FILE_pop_free(ent->files, by_dir_file_free);
+    ent->files = dir_read_files(ent);
+    ent->mtime = st.st_mtime;
+    ent->taken = now;
+}
+
+/*
+ * Look for the file with hash |h| and suffix |k| in the snapshot of the
+ * directory of |ent|. Returns 1 if it is there, 0 if it is not and -1 if
+ * there is no snapshot to tell, in which case the file system must be asked.
+ */
+static int dir_find_file(BY_DIR *ctx, BY_DIR_ENTRY *ent, unsigned long h,
+                         int crl, int k)
+{
+    BY_DIR_FILE tmp;
+    time_t now = time(NULL);
+    int ret = -1;
+
+    tmp.hash = h;
+    tmp.crl = crl;
+    tmp.suffix = k;
+
+    CRYPTO_THREAD_read_lock(ctx->lock);
+    if (ctx->cache_ttl == 0) {
+        CRYPTO_THREAD_unlock(ctx->lock);
+        return -1;
+    }
+    if (now >= ent->checked && now - ent->checked < ctx->cache_ttl) {
+        if (ent->files != NULL)
+            ret = sk_BY_DIR_FILE_find(ent->files, &tmp) >= 0;
+        CRYPTO_THREAD_unlock(ctx->lock);
+        return ret;
+    }
+    CRYPTO_THREAD_unlock(ctx->lock);
+
+    CRYPTO_THREAD_write_lock(ctx->lock);
+    /* Another thread may have updated the snapshot in the meantime */
+    if (now < ent->checked || now - ent->checked >= ctx->cache_ttl)
+        dir_update_files(ent, now);
+    if (ent->files != NULL)
+        ret = sk_BY_DIR_FILE_find(ent->files, &tmp) >= 0;
+    CRYPTO_THREAD_unlock(ctx->lock);
+    return ret;
+}
+#endif
+
 static int get_cert_by_subject(X509_LOOKUP *xl, X509_LOOKUP_TYPE type,
                                X509_NAME *name, X509_OBJECT *ret)
 {
     BY_DIR *ctx;
-    union {
-        X509 st_x509;
-        X509_CRL crl;
-    } data;
     int ok = 0;
     int i, j, k;
     unsigned long h;
     BUF_MEM *b = NULL;
-    X509_OBJECT stmp, *tmp;
+    X509_OBJECT *tmp;
     const char *postfix = "";
 
     if (name == NULL)
         return (0);
 
-    stmp.type = type;
     if (type == X509_LU_X509) {
-        data.st_x509.cert_info.subject = name;
-        stmp.data.x509 = &data.st_x509;
         postfix = "";
     } else if (type == X509_LU_CRL) {
-        data.crl.crl.issuer = name;
-        stmp.data.crl = &data.crl;
         postfix = "r";
     } else {
         X509err(X509_F_GET_CERT_BY_SUBJECT, X509_R_WRONG_LOOKUP_TYPE);
@@ -299,12 +474,12 @@ static int get_cert_by_subject(X509_LOOKUP *xl, X509_LOOKUP_TYPE type,
                              "%s%c%08lx.%s%d", ent->dir, c, h, postfix, k);
             }
 #ifndef OPENSSL_NO_POSIX_IO
-# ifdef _WIN32
-#  define stat _stat
-# endif
             {
                 struct stat st;
-                if (stat(b->data, &st) < 0)
+                int found = dir_find_file(ctx, ent, h, type == X509_LU_CRL,
+                                          k);
+
+                if (found == 0 || (found < 0 && stat(b->data, &st) < 0))
                     break;
             }
 #endif
@@ -323,13 +498,9 @@ static int get_cert_by_subject(X509_LOOKUP *xl, X509_LOOKUP_TYPE type,
         /*
          * we have added it to the cache so now pull it out again
          */
-        CRYPTO_THREAD_write_lock(ctx->lock);
-        j = sk_X509_OBJECT_find(xl->store_ctx->objs, &stmp);
-        if (j != -1)
-            tmp = sk_X509_OBJECT_value(xl->store_ctx->objs, j);
-        else
-            tmp = NULL;
-        CRYPTO_THREAD_unlock(ctx->lock);
+        CRYPTO_THREAD_read_lock(xl->store_ctx->lock);
+        tmp = x509_store_get0_object(xl->store_ctx, type, name);
+        CRYPTO_THREAD_unlock(xl->store_ctx->lock);
 
         /* If a CRL, update the last file suffix added for this */
 
@@ -147,7 +147,7 @@ int X509_load_crl_file(X509_LOOKUP *ctx, const char *file, int type)
 
     if (type == X509_FILETYPE_PEM) {
         for (;;) {
-            x = PEM_read_bio_X509_CRL(in, NULL, NULL, NULL);
+            x = PEM_read_bio_X509_CRL_compact(in, NULL);
             if (x == NULL) {
                 if ((ERR_GET_REASON(ERR_peek_last_error()) ==
                      PEM_R_NO_START_LINE) && (count > 0)) {
@@ -167,7 +167,7 @@ int X509_load_crl_file(X509_LOOKUP *ctx, const char *file, int type)
         }
         ret = count;
     } else if (type == X509_FILETYPE_ASN1) {
-        x = d2i_X509_CRL_bio(in, NULL);
+        x = d2i_X509_CRL_compact_bio(in, NULL);
         if (x == NULL) {
             X509err(X509_F_X509_LOAD_CRL_FILE, ERR_R_ASN1_LIB);
             goto err;
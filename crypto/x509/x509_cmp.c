@@ -181,21 +181,34 @@ int X509_NAME_cmp(const X509_NAME *a, const X509_NAME *b)
 
 }
 
-unsigned long X509_NAME_hash(X509_NAME *x)
+/*
+ * Return 1 if |a| and |b| are equal as by X509_NAME_cmp(), 0 if not and -1
+ * on error. The fingerprints tell most different names apart without
+ * looking at their encodings; they cannot be used for ordering, which is
+ * that of the encodings.
+ */
+int x509_name_equal(const X509_NAME *a, const X509_NAME *b)
 {
-    unsigned long ret = 0;
-    unsigned char md[SHA_DIGEST_LENGTH];
+    if ((!a->canon_enc || a->modified)
+            && i2d_X509_NAME((X509_NAME *)a, NULL) < 0)
+        return -1;
+    if ((!b->canon_enc || b->modified)
+            && i2d_X509_NAME((X509_NAME *)b, NULL) < 0)
+        return -1;
+
+    if (a->canon_enclen != b->canon_enclen || a->canon_hash != b->canon_hash)
+        return 0;
+    return a->canon_enclen == 0
+           || memcmp(a->canon_enc, b->canon_enc, a->canon_enclen) == 0;
+}
 
+unsigned long X509_NAME_hash(X509_NAME *x)
+{
     /* Make sure X509_NAME structure contains valid cached encoding */
-    i2d_X509_NAME(x, NULL);
-    if (!EVP_Digest(x->canon_enc, x->canon_enclen, md, NULL, EVP_sha1(),
-                    NULL))
+    if (x->modified && i2d_X509_NAME(x, NULL) < 0)
         return 0;
 
-    ret = (((unsigned long)md[0]) | ((unsigned long)md[1] << 8L) |
-           ((unsigned long)md[2] << 16L) | ((unsigned long)md[3] << 24L)
-        ) & 0xffffffffL;
-    return (ret);
+    return (unsigned long)(x->canon_hash & 0xffffffffL);
 }
 
 #ifndef OPENSSL_NO_MD5
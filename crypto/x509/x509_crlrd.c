@@ -0,0 +1,261 @@
+/*
+ * Copyright 2017 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the OpenSSL license (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "internal/cryptlib.h"
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "internal/x509_int.h"
+
+/*
+ * Streaming CRL reader.  The DER encoding of the CRL is read straight into
+ * the buffer that d2i_X509_CRL_compact() keeps as its encoding, decoding PEM
+ * a line at a time and digesting the octets as they arrive, so the base64
+ * text and a second copy of the DER are never held next to the CRL.
+ */
+
+#define CRL_CHUNK_INITIAL_SIZE  (16 * 1024)
+#define CRL_LINE_SIZE           256
+
+static const char crl_begin[] = "-----BEGIN " PEM_STRING_X509_CRL "-----";
+static const char crl_end[] = "-----END " PEM_STRING_X509_CRL "-----";
+
+typedef struct {
+    BIO *bio;
+    EVP_ENCODE_CTX *b64;        /* NULL for DER input */
+    EVP_MD_CTX *md;
+    int end;                    /* END line of PEM input seen */
+    /* Decoded octets of the last PEM line not yet returned */
+    unsigned char buf[CRL_LINE_SIZE];
+    int off, len;
+} CRL_READER;
+
+/*
+ * Read a line of PEM input into |line|, without its line ending.  Returns
+ * the length of the line, or -1 at the end of the input.
+ */
+static int crl_gets(CRL_READER *r, char *line)
+{
+    int n = BIO_gets(r->bio, line, CRL_LINE_SIZE - 2);
+
+    if (n <= 0)
+        return -1;
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+        n--;
+    line[n] = '\0';
+    return n;
+}
+
+/*
+ * Decode the next line of a PEM body into |r->buf|.  Returns 0 on error or
+ * if the END line has already been reached.
+ */
+static int crl_decode_line(CRL_READER *r)
+{
+    char line[CRL_LINE_SIZE];
+    int n;
+
+    r->off = r->len = 0;
+    if (r->end) {
+        X509err(X509_F_X509_CRL_READ_BIO, X509_R_BAD_CRL_ENCODING);
+        return 0;
+    }
+    if ((n = crl_gets(r, line)) < 0) {
+        X509err(X509_F_X509_CRL_READ_BIO, X509_R_BASE64_DECODE_ERROR);
+        return 0;
+    }
+    if (strncmp(line, "-----END ", 9) == 0) {
+        r->end = 1;
+        if (strcmp(line, crl_end) != 0
+                || EVP_DecodeFinal(r->b64, r->buf, &r->len) < 0) {
+            X509err(X509_F_X509_CRL_READ_BIO, X509_R_BASE64_DECODE_ERROR);
+            return 0;
+        }
+        return 1;
+    }
+    if (n == 0)
+        return 1;
+    /* Encrypted and annotated PEM bodies are not supported */
+    if (strchr(line, ':') != NULL
+            || EVP_DecodeUpdate(r->b64, r->buf, &r->len,
+                                (unsigned char *)line, n) < 0) {
+        X509err(X509_F_X509_CRL_READ_BIO, X509_R_BASE64_DECODE_ERROR);
+        return 0;
+    }
+    return 1;
+}
+
+/* Read exactly |n| octets of DER into |out| and add them to the digest */
+static int crl_read(CRL_READER *r, unsigned char *out, size_t n)
+{
+    unsigned char *p = out;
+    size_t left = n, chunk;
+    int i;
+
+    while (left > 0) {
+        if (r->b64 == NULL) {
+            chunk = left > INT_MAX ? INT_MAX : left;
+            if ((i = BIO_read(r->bio, p, (int)chunk)) <= 0) {
+                X509err(X509_F_X509_CRL_READ_BIO, X509_R_BAD_CRL_ENCODING);
+                return 0;
+            }
+            chunk = i;
+        } else {
+            if (r->off == r->len) {
+                if (!crl_decode_line(r))
+                    return 0;
+                continue;
+            }
+            chunk = r->len - r->off;
+            if (chunk > left)
+                chunk = left;
+            memcpy(p, r->buf + r->off, chunk);
+            r->off += chunk;
+        }
+        p += chunk;
+        left -= chunk;
+    }
+    if (!EVP_DigestUpdate(r->md, out, n)) {
+        X509err(X509_F_X509_CRL_READ_BIO, ERR_R_EVP_LIB);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Read the header of the CertificateList SEQUENCE into |hdr|, which must
+ * have room for 2 + sizeof(long) octets.  Sets |*len| to the length of its
+ * contents and returns the length of the header, or 0 on error.  Only
+ * definite lengths are supported.
+ */
+static int crl_read_header(CRL_READER *r, unsigned char *hdr, long *len)
+{
+    int i, n;
+
+    if (!crl_read(r, hdr, 2))
+        return 0;
+    if (hdr[0] != (V_ASN1_CONSTRUCTED | V_ASN1_SEQUENCE) || hdr[1] == 0x80)
+        goto err;
+    if (hdr[1] < 0x80) {
+        *len = hdr[1];
+        return 2;
+    }
+    n = hdr[1] & 0x7f;
+    if (n >= (int)sizeof(long) || !crl_read(r, hdr + 2, n))
+        goto err;
+    for (*len = 0, i = 0; i < n; i++)
+        *len = (*len << 8) | hdr[2 + i];
+    if (*len > LONG_MAX - 2 - n)
+        goto err;
+    return 2 + n;
+
+ err:
+    X509err(X509_F_X509_CRL_READ_BIO, X509_R_BAD_CRL_ENCODING);
+    return 0;
+}
+
+/*
+ * Read one CRL from |bp|, PEM encoded if |pem| is set, into |*crl|.
+ * Returns 1 on success, 0 on error or -1 if PEM input has no further CRL.
+ */
+int x509_crl_read_bio(BIO *bp, int pem, X509_CRL **crl)
+{
+    CRL_READER r;
+    char line[CRL_LINE_SIZE];
+    unsigned char hdr[2 + sizeof(long)], sha1[SHA_DIGEST_LENGTH];
+    unsigned char *der = NULL, *tmp;
+    size_t total, have, want, chunk_max = CRL_CHUNK_INITIAL_SIZE;
+    long len;
+    int hdrlen, ret = 0;
+
+    memset(&r, 0, sizeof(r));
+    r.bio = bp;
+    *crl = NULL;
+
+    if (pem) {
+        /* Skip anything up to the BEGIN line, like PEM_read_bio() */
+        do {
+            if (crl_gets(&r, line) < 0)
+                return -1;
+        } while (strcmp(line, crl_begin) != 0);
+        if ((r.b64 = EVP_ENCODE_CTX_new()) == NULL) {
+            X509err(X509_F_X509_CRL_READ_BIO, ERR_R_MALLOC_FAILURE);
+            return 0;
+        }
+        EVP_DecodeInit(r.b64);
+    }
+    if ((r.md = EVP_MD_CTX_new()) == NULL) {
+        X509err(X509_F_X509_CRL_READ_BIO, ERR_R_MALLOC_FAILURE);
+        goto end;
+    }
+    if (!EVP_DigestInit_ex(r.md, EVP_sha1(), NULL)) {
+        X509err(X509_F_X509_CRL_READ_BIO, ERR_R_EVP_LIB);
+        goto end;
+    }
+    if ((hdrlen = crl_read_header(&r, hdr, &len)) == 0)
+        goto end;
+
+    /*
+     * Read the contents in chunks of increasing size, so that a bogus
+     * length fails at the end of the input rather than allocating it all.
+     */
+    total = hdrlen + (size_t)len;
+    have = hdrlen;
+    while (der == NULL || have < total) {
+        want = total - have > chunk_max ? have + chunk_max : total;
+        if ((tmp = OPENSSL_realloc(der, want)) == NULL) {
+            X509err(X509_F_X509_CRL_READ_BIO, ERR_R_MALLOC_FAILURE);
+            goto end;
+        }
+        der = tmp;
+        if (have == (size_t)hdrlen)
+            memcpy(der, hdr, hdrlen);
+        if (!crl_read(&r, der + have, want - have))
+            goto end;
+        have = want;
+        if (chunk_max < INT_MAX / 2)
+            chunk_max *= 2;
+    }
+
+    /* The DER must be followed by the END line and nothing else */
+    if (pem) {
+        if (r.off != r.len)
+            goto bad;
+        while (!r.end) {
+            if (!crl_decode_line(&r))
+                goto end;
+            if (r.len != 0)
+                goto bad;
+        }
+    }
+
+    if (!EVP_DigestFinal_ex(r.md, sha1, NULL)) {
+        X509err(X509_F_X509_CRL_READ_BIO, ERR_R_EVP_LIB);
+        goto end;
+    }
+    *crl = x509_crl_d2i_compact_own(der, (long)total, sha1);
+    der = NULL;
+    if (*crl == NULL) {
+        X509err(X509_F_X509_CRL_READ_BIO, ERR_R_NESTED_ASN1_ERROR);
+        goto end;
+    }
+    ret = 1;
+    goto end;
+
+ bad:
+    X509err(X509_F_X509_CRL_READ_BIO, X509_R_BAD_CRL_ENCODING);
+ end:
+    OPENSSL_free(der);
+    EVP_MD_CTX_free(r.md);
+    EVP_ENCODE_CTX_free(r.b64);
+    return ret;
+}
@@ -102,10 +102,28 @@ struct x509_lookup_st {
  * validation.  Once we have a certificate chain, the 'verify' function is
  * then called to actually check the cert chain.
  */
+DEFINE_LHASH_OF(X509_OBJECT);
+
+/*
+ * A chain that verified successfully, see x509_store_cache_get().  Entries
+ * are kept in insertion order so that the oldest one can be evicted first.
+ */
+typedef struct x509_verify_cache_st {
+    unsigned char key[SHA256_DIGEST_LENGTH];
+    STACK_OF(X509) *chain;
+    int num_untrusted;
+    time_t expires;
+    struct x509_verify_cache_st *prev, *next;
+} X509_VERIFY_CACHE;
+
+DEFINE_LHASH_OF(X509_VERIFY_CACHE);
+
 struct x509_store_st {
     /* The following is a cache of trusted certs */
     int cache;                  /* if true, stash any hits */
     STACK_OF(X509_OBJECT) *objs; /* Cache of all objects */
+    /* Index of |objs| by type and name, see x509_store_get0_object() */
+    LHASH_OF(X509_OBJECT) *obj_index;
     /* These are external lookup methods */
     STACK_OF(X509_LOOKUP) *get_cert_methods;
     X509_VERIFY_PARAM *param;
@@ -134,6 +152,10 @@ struct x509_store_st {
     CRYPTO_EX_DATA ex_data;
     CRYPTO_REF_COUNT references;
     CRYPTO_RWLOCK *lock;
+    /* Verified chain cache, at most |verify_cache_max| entries */
+    size_t verify_cache_max;
+    LHASH_OF(X509_VERIFY_CACHE) *verify_cache;
+    X509_VERIFY_CACHE *verify_cache_head, *verify_cache_tail;
 };
 
 typedef struct lookup_dir_hashes_st BY_DIR_HASH;
@@ -142,3 +164,11 @@ DEFINE_STACK_OF(BY_DIR_HASH)
 DEFINE_STACK_OF(BY_DIR_ENTRY)
 typedef STACK_OF(X509_NAME_ENTRY) STACK_OF_X509_NAME_ENTRY;
 DEFINE_STACK_OF(STACK_OF_X509_NAME_ENTRY)
+
+X509_OBJECT *x509_store_get0_object(X509_STORE *store, X509_LOOKUP_TYPE type,
+                                    X509_NAME *name);
+int x509_store_cache_get(X509_STORE *store, const unsigned char *key,
+                         STACK_OF(X509) **chain, int *num_untrusted);
+void x509_store_cache_add(X509_STORE *store, const unsigned char *key,
+                          STACK_OF(X509) *chain, int num_untrusted,
+                          time_t expires);
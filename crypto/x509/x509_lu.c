@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <time.h>
 #include "internal/cryptlib.h"
 #include <openssl/lhash.h>
 #include <openssl/x509.h>
@@ -139,6 +140,82 @@ static int x509_object_cmp(const X509_OBJECT *const *a,
     return ret;
 }
 
+/*
+ * The objects of an X509_STORE are indexed by type and by the canonical
+ * encoding of their subject name (issuer name for CRLs). The index holds the
+ * first object with each name, further objects with the same name are
+ * chained to it in the order they were added. Lookups only need the read
+ * lock, unlike sk_X509_OBJECT_find() which sorts the stack of all objects.
+ */
+static X509_NAME *x509_object_name(const X509_OBJECT *a)
+{
+    switch (a->type) {
+    case X509_LU_X509:
+        return a->data.x509->cert_info.subject;
+    case X509_LU_CRL:
+        return a->data.crl->crl.issuer;
+    case X509_LU_NONE:
+        break;
+    }
+    return NULL;
+}
+
+static unsigned long x509_object_hash(const X509_OBJECT *a)
+{
+    X509_NAME *nm = x509_object_name(a);
+
+    if (nm == NULL)
+        return 0;
+    /* Make sure the canonical encoding is up to date */
+    if (nm->modified && i2d_X509_NAME(nm, NULL) < 0)
+        return 0;
+
+    return (unsigned long)(nm->canon_hash >> 32) ^ (unsigned long)a->type;
+}
+
+static int x509_object_index_cmp(const X509_OBJECT *a, const X509_OBJECT *b)
+{
+    return x509_object_cmp(&a, &b);
+}
+
+static unsigned long verify_cache_hash(const X509_VERIFY_CACHE *a)
+{
+    /* The key is a SHA-256 digest already */
+    return (unsigned long)a->key[0] | ((unsigned long)a->key[1] << 8)
+           | ((unsigned long)a->key[2] << 16)
+           | ((unsigned long)a->key[3] << 24);
+}
+
+static int verify_cache_cmp(const X509_VERIFY_CACHE *a,
+                            const X509_VERIFY_CACHE *b)
+{
+    return memcmp(a->key, b->key, sizeof(a->key));
+}
+
+/* Remove |e| from the cache and free it, must hold the write lock */
+static void verify_cache_remove(X509_STORE *store, X509_VERIFY_CACHE *e)
+{
+    lh_X509_VERIFY_CACHE_delete(store->verify_cache, e);
+    if (e->prev != NULL)
+        e->prev->next = e->next;
+    else
+        store->verify_cache_head = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        store->verify_cache_tail = e->prev;
+    sk_X509_pop_free(e->chain, X509_free);
+    OPENSSL_free(e);
+}
+
+/* Evict the oldest entries until at most |max| remain */
+static void verify_cache_trim(X509_STORE *store, size_t max)
+{
+    while (store->verify_cache_head != NULL
+           && lh_X509_VERIFY_CACHE_num_items(store->verify_cache) > max)
+        verify_cache_remove(store, store->verify_cache_head);
+}
+
 X509_STORE *X509_STORE_new(void)
 {
     X509_STORE *ret;
@@ -147,6 +224,10 @@ X509_STORE *X509_STORE_new(void)
         return NULL;
     if ((ret->objs = sk_X509_OBJECT_new(x509_object_cmp)) == NULL)
         goto err;
+    ret->obj_index = lh_X509_OBJECT_new(x509_object_hash,
+                                        x509_object_index_cmp);
+    if (ret->obj_index == NULL)
+        goto err;
     ret->cache = 1;
     if ((ret->get_cert_methods = sk_X509_LOOKUP_new_null()) == NULL)
         goto err;
@@ -166,6 +247,7 @@ X509_STORE *X509_STORE_new(void)
 
 err:
     X509_VERIFY_PARAM_free(ret->param);
+    lh_X509_OBJECT_free(ret->obj_index);
     sk_X509_OBJECT_free(ret->objs);
     sk_X509_LOOKUP_free(ret->get_cert_methods);
     OPENSSL_free(ret);
@@ -209,6 +291,11 @@ void X509_STORE_free(X509_STORE *vfy)
         X509_LOOKUP_free(lu);
     }
     sk_X509_LOOKUP_free(sk);
+    if (vfy->verify_cache != NULL) {
+        verify_cache_trim(vfy, 0);
+        lh_X509_VERIFY_CACHE_free(vfy->verify_cache);
+    }
+    lh_X509_OBJECT_free(vfy->obj_index);
     sk_X509_OBJECT_pop_free(vfy->objs, cleanup);
 
     CRYPTO_free_ex_data(CRYPTO_EX_INDEX_X509_STORE, vfy, &vfy->ex_data);
@@ -280,8 +367,8 @@ int X509_STORE_CTX_get_by_subject(X509_STORE_CTX *vs, X509_LOOKUP_TYPE type,
     X509_OBJECT stmp, *tmp;
     int i, j;
 
-    CRYPTO_THREAD_write_lock(ctx->lock);
-    tmp = X509_OBJECT_retrieve_by_subject(ctx->objs, type, name);
+    CRYPTO_THREAD_read_lock(ctx->lock);
+    tmp = x509_store_get0_object(ctx, type, name);
     CRYPTO_THREAD_unlock(ctx->lock);
 
     if (tmp == NULL || type == X509_LU_CRL) {
@@ -305,73 +392,83 @@ int X509_STORE_CTX_get_by_subject(X509_STORE_CTX *vs, X509_LOOKUP_TYPE type,
     return 1;
 }
 
-int X509_STORE_add_cert(X509_STORE *ctx, X509 *x)
+/*
+ * Add |obj| to |store| unless an equal object is already there. Returns 1 if
+ * it was added, 0 if it is a duplicate and -1 on allocation failure. Locked by
+ * the store lock in the calling function.
+ */
+static int x509_store_add_object(X509_STORE *store, X509_OBJECT *obj)
 {
-    X509_OBJECT *obj;
-    int ret = 1, added = 1;
+    X509_OBJECT *first, *last = NULL, *o;
 
-    if (x == NULL)
-        return 0;
-    obj = X509_OBJECT_new();
-    if (obj == NULL)
-        return 0;
-    obj->type = X509_LU_X509;
-    obj->data.x509 = x;
-    X509_OBJECT_up_ref_count(obj);
-
-    CRYPTO_THREAD_write_lock(ctx->lock);
-
-    if (X509_OBJECT_retrieve_match(ctx->objs, obj)) {
-        X509err(X509_F_X509_STORE_ADD_CERT,
-                X509_R_CERT_ALREADY_IN_HASH_TABLE);
-        ret = 0;
-    } else {
-        added = sk_X509_OBJECT_push(ctx->objs, obj);
-        ret = added != 0;
+    first = lh_X509_OBJECT_retrieve(store->obj_index, obj);
+    for (o = first; o != NULL; o = o->next) {
+        if (obj->type == X509_LU_X509
+                ? X509_cmp(o->data.x509, obj->data.x509) == 0
+                : X509_CRL_match(o->data.crl, obj->data.crl) == 0)
+            return 0;
+        last = o;
     }
 
-    CRYPTO_THREAD_unlock(ctx->lock);
-
-    if (!ret)                   /* obj not pushed */
-        X509_OBJECT_free(obj);
-    if (!added)                 /* on push failure */
-        X509err(X509_F_X509_STORE_ADD_CERT, ERR_R_MALLOC_FAILURE);
-
-    return ret;
+    if (!sk_X509_OBJECT_push(store->objs, obj))
+        return -1;
+    obj->next = NULL;
+    if (last != NULL) {
+        last->next = obj;
+    } else if (lh_X509_OBJECT_insert(store->obj_index, obj) == NULL
+               && lh_X509_OBJECT_error(store->obj_index)) {
+        (void)sk_X509_OBJECT_pop(store->objs);
+        return -1;
+    }
+    return 1;
 }
 
-int X509_STORE_add_crl(X509_STORE *ctx, X509_CRL *x)
+static int x509_store_add(X509_STORE *store, void *x, int crl)
 {
     X509_OBJECT *obj;
-    int ret = 1, added = 1;
+    int ret;
 
     if (x == NULL)
         return 0;
     obj = X509_OBJECT_new();
     if (obj == NULL)
         return 0;
-    obj->type = X509_LU_CRL;
-    obj->data.crl = x;
-    X509_OBJECT_up_ref_count(obj);
-
-    CRYPTO_THREAD_write_lock(ctx->lock);
-
-    if (X509_OBJECT_retrieve_match(ctx->objs, obj)) {
-        X509err(X509_F_X509_STORE_ADD_CRL, X509_R_CERT_ALREADY_IN_HASH_TABLE);
-        ret = 0;
+    if (crl) {
+        obj->type = X509_LU_CRL;
+        obj->data.crl = (X509_CRL *)x;
     } else {
-        added = sk_X509_OBJECT_push(ctx->objs, obj);
-        ret = added != 0;
+        obj->type = X509_LU_X509;
+        obj->data.x509 = (X509 *)x;
     }
+    X509_OBJECT_up_ref_count(obj);
 
-    CRYPTO_THREAD_unlock(ctx->lock);
+    CRYPTO_THREAD_write_lock(store->lock);
+    ret = x509_store_add_object(store, obj);
+    /* A new CRL may revoke a chain that has been verified before */
+    if (ret == 1 && crl && store->verify_cache != NULL)
+        verify_cache_trim(store, 0);
+    CRYPTO_THREAD_unlock(store->lock);
 
-    if (!ret)                   /* obj not pushed */
-        X509_OBJECT_free(obj);
-    if (!added)                 /* on push failure */
-        X509err(X509_F_X509_STORE_ADD_CRL, ERR_R_MALLOC_FAILURE);
+    if (ret == 1)
+        return 1;
+    X509_OBJECT_free(obj);
+    if (ret == 0)
+        X509err(crl ? X509_F_X509_STORE_ADD_CRL : X509_F_X509_STORE_ADD_CERT,
+                X509_R_CERT_ALREADY_IN_HASH_TABLE);
+    else
+        X509err(crl ? X509_F_X509_STORE_ADD_CRL : X509_F_X509_STORE_ADD_CERT,
+                ERR_R_MALLOC_FAILURE);
+    return 0;
+}
 
-    return ret;
+int X509_STORE_add_cert(X509_STORE *ctx, X509 *x)
+{
+    return x509_store_add(ctx, x, 0);
+}
+
+int X509_STORE_add_crl(X509_STORE *ctx, X509_CRL *x)
+{
+    return x509_store_add(ctx, x, 1);
 }
 
 int X509_OBJECT_up_ref_count(X509_OBJECT *a)
@@ -497,16 +594,43 @@ STACK_OF(X509_OBJECT) *X509_STORE_get0_objects(X509_STORE *v)
     return v->objs;
 }
 
+/*
+ * Return the first object of type |type| with name |name| in |store|, the
+ * others are chained to it. The caller must hold the store lock, which may
+ * be a read lock.
+ */
+X509_OBJECT *x509_store_get0_object(X509_STORE *store, X509_LOOKUP_TYPE type,
+                                    X509_NAME *name)
+{
+    X509_OBJECT stmp;
+    X509 x509_s;
+    X509_CRL crl_s;
+
+    stmp.type = type;
+    switch (type) {
+    case X509_LU_X509:
+        stmp.data.x509 = &x509_s;
+        x509_s.cert_info.subject = name;
+        break;
+    case X509_LU_CRL:
+        stmp.data.crl = &crl_s;
+        crl_s.crl.issuer = name;
+        break;
+    case X509_LU_NONE:
+        return NULL;
+    }
+    return lh_X509_OBJECT_retrieve(store->obj_index, &stmp);
+}
+
 STACK_OF(X509) *X509_STORE_CTX_get1_certs(X509_STORE_CTX *ctx, X509_NAME *nm)
 {
-    int i, idx, cnt;
     STACK_OF(X509) *sk = NULL;
     X509 *x;
     X509_OBJECT *obj;
 
-    CRYPTO_THREAD_write_lock(ctx->ctx->lock);
-    idx = x509_object_idx_cnt(ctx->ctx->objs, X509_LU_X509, nm, &cnt);
-    if (idx < 0) {
+    CRYPTO_THREAD_read_lock(ctx->ctx->lock);
+    obj = x509_store_get0_object(ctx->ctx, X509_LU_X509, nm);
+    if (obj == NULL) {
         /*
          * Nothing found in cache: do lookup to possibly add new objects to
          * cache
@@ -521,17 +645,16 @@ STACK_OF(X509) *X509_STORE_CTX_get1_certs(X509_STORE_CTX *ctx, X509_NAME *nm)
             return NULL;
         }
         X509_OBJECT_free(xobj);
-        CRYPTO_THREAD_write_lock(ctx->ctx->lock);
-        idx = x509_object_idx_cnt(ctx->ctx->objs, X509_LU_X509, nm, &cnt);
-        if (idx < 0) {
+        CRYPTO_THREAD_read_lock(ctx->ctx->lock);
+        obj = x509_store_get0_object(ctx->ctx, X509_LU_X509, nm);
+        if (obj == NULL) {
             CRYPTO_THREAD_unlock(ctx->ctx->lock);
             return NULL;
         }
     }
 
     sk = sk_X509_new_null();
-    for (i = 0; i < cnt; i++, idx++) {
-        obj = sk_X509_OBJECT_value(ctx->ctx->objs, idx);
+    for (; obj != NULL; obj = obj->next) {
         x = obj->data.x509;
         X509_up_ref(x);
         if (!sk_X509_push(sk, x)) {
@@ -547,7 +670,6 @@ STACK_OF(X509) *X509_STORE_CTX_get1_certs(X509_STORE_CTX *ctx, X509_NAME *nm)
 
 STACK_OF(X509_CRL) *X509_STORE_CTX_get1_crls(X509_STORE_CTX *ctx, X509_NAME *nm)
 {
-    int i, idx, cnt;
     STACK_OF(X509_CRL) *sk = sk_X509_CRL_new_null();
     X509_CRL *x;
     X509_OBJECT *obj, *xobj = X509_OBJECT_new();
@@ -560,16 +682,15 @@ STACK_OF(X509_CRL) *X509_STORE_CTX_get1_crls(X509_STORE_CTX *ctx, X509_NAME *nm)
         return NULL;
     }
     X509_OBJECT_free(xobj);
-    CRYPTO_THREAD_write_lock(ctx->ctx->lock);
-    idx = x509_object_idx_cnt(ctx->ctx->objs, X509_LU_CRL, nm, &cnt);
-    if (idx < 0) {
+    CRYPTO_THREAD_read_lock(ctx->ctx->lock);
+    obj = x509_store_get0_object(ctx->ctx, X509_LU_CRL, nm);
+    if (obj == NULL) {
         CRYPTO_THREAD_unlock(ctx->ctx->lock);
         sk_X509_CRL_free(sk);
         return NULL;
     }
 
-    for (i = 0; i < cnt; i++, idx++) {
-        obj = sk_X509_OBJECT_value(ctx->ctx->objs, idx);
+    for (; obj != NULL; obj = obj->next) {
         x = obj->data.crl;
         X509_CRL_up_ref(x);
         if (!sk_X509_CRL_push(sk, x)) {
@@ -626,7 +747,7 @@ int X509_STORE_CTX_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x)
 {
     X509_NAME *xn;
     X509_OBJECT *obj = X509_OBJECT_new(), *pobj = NULL;
-    int i, ok, idx, ret;
+    int ok, ret;
 
     if (obj == NULL)
         return -1;
@@ -650,31 +771,22 @@ int X509_STORE_CTX_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x)
 
     /* Else find index of first cert accepted by 'check_issued' */
     ret = 0;
-    CRYPTO_THREAD_write_lock(ctx->ctx->lock);
-    idx = X509_OBJECT_idx_by_subject(ctx->ctx->objs, X509_LU_X509, xn);
-    if (idx != -1) {            /* should be true as we've had at least one
-                                 * match */
-        /* Look through all matching certs for suitable issuer */
-        for (i = idx; i < sk_X509_OBJECT_num(ctx->ctx->objs); i++) {
-            pobj = sk_X509_OBJECT_value(ctx->ctx->objs, i);
-            /* See if we've run past the matches */
-            if (pobj->type != X509_LU_X509)
-                break;
-            if (X509_NAME_cmp(xn, X509_get_subject_name(pobj->data.x509)))
+    CRYPTO_THREAD_read_lock(ctx->ctx->lock);
+    /* Look through all matching certs for suitable issuer */
+    pobj = x509_store_get0_object(ctx->ctx, X509_LU_X509, xn);
+    for (; pobj != NULL; pobj = pobj->next) {
+        if (ctx->check_issued(ctx, x, pobj->data.x509)) {
+            *issuer = pobj->data.x509;
+            ret = 1;
+            /*
+             * If times check, exit with match,
+             * otherwise keep looking. Leave last
+             * match in issuer so we return nearest
+             * match if no certificate time is OK.
+             */
+
+            if (x509_check_cert_time(ctx, *issuer, -1))
                 break;
-            if (ctx->check_issued(ctx, x, pobj->data.x509)) {
-                *issuer = pobj->data.x509;
-                ret = 1;
-                /*
-                 * If times check, exit with match,
-                 * otherwise keep looking. Leave last
-                 * match in issuer so we return nearest
-                 * match if no certificate time is OK.
-                 */
-
-                if (x509_check_cert_time(ctx, *issuer, -1))
-                    break;
-            }
         }
     }
     CRYPTO_THREAD_unlock(ctx->ctx->lock);
@@ -688,6 +800,108 @@ int X509_STORE_set_flags(X509_STORE *ctx, unsigned long flags)
     return X509_VERIFY_PARAM_set_flags(ctx->param, flags);
 }
 
+int X509_STORE_set_verify_cache_size(X509_STORE *store, size_t max)
+{
+    int ret = 1;
+
+    CRYPTO_THREAD_write_lock(store->lock);
+    if (max > 0 && store->verify_cache == NULL) {
+        store->verify_cache = lh_X509_VERIFY_CACHE_new(verify_cache_hash,
+                                                       verify_cache_cmp);
+        if (store->verify_cache == NULL) {
+            X509err(X509_F_X509_STORE_SET_VERIFY_CACHE_SIZE,
+                    ERR_R_MALLOC_FAILURE);
+            ret = 0;
+        }
+    }
+    if (ret) {
+        store->verify_cache_max = max;
+        if (store->verify_cache != NULL)
+            verify_cache_trim(store, max);
+    }
+    CRYPTO_THREAD_unlock(store->lock);
+    return ret;
+}
+
+void X509_STORE_flush_verify_cache(X509_STORE *store)
+{
+    CRYPTO_THREAD_write_lock(store->lock);
+    if (store->verify_cache != NULL)
+        verify_cache_trim(store, 0);
+    CRYPTO_THREAD_unlock(store->lock);
+}
+
+/*
+ * Look up the chain that was cached for |key| by x509_store_cache_add().
+ * On a hit |*chain| is set to a copy of the chain that holds a reference to
+ * each certificate and 1 is returned.  Returns 0 if there is no chain for
+ * |key|, it has expired or the copy could not be made.
+ */
+int x509_store_cache_get(X509_STORE *store, const unsigned char *key,
+                         STACK_OF(X509) **chain, int *num_untrusted)
+{
+    X509_VERIFY_CACHE tmp, *e;
+    int ret = 0;
+
+    memcpy(tmp.key, key, sizeof(tmp.key));
+    CRYPTO_THREAD_read_lock(store->lock);
+    if (store->verify_cache != NULL
+        && (e = lh_X509_VERIFY_CACHE_retrieve(store->verify_cache,
+                                              &tmp)) != NULL
+        && e->expires > time(NULL)
+        && (*chain = X509_chain_up_ref(e->chain)) != NULL) {
+        *num_untrusted = e->num_untrusted;
+        ret = 1;
+    }
+    CRYPTO_THREAD_unlock(store->lock);
+    return ret;
+}
+
+/*
+ * Remember that |chain| was verified successfully for |key| until
+ * |expires|.  Failure to add the chain is not an error, the next
+ * verification just does all the work again.
+ */
+void x509_store_cache_add(X509_STORE *store, const unsigned char *key,
+                          STACK_OF(X509) *chain, int num_untrusted,
+                          time_t expires)
+{
+    X509_VERIFY_CACHE *e, *old;
+
+    if ((e = OPENSSL_zalloc(sizeof(*e))) == NULL)
+        return;
+    memcpy(e->key, key, sizeof(e->key));
+    e->num_untrusted = num_untrusted;
+    e->expires = expires;
+    if ((e->chain = X509_chain_up_ref(chain)) == NULL) {
+        OPENSSL_free(e);
+        return;
+    }
+
+    CRYPTO_THREAD_write_lock(store->lock);
+    if (store->verify_cache == NULL || store->verify_cache_max == 0)
+        goto err;
+    if ((old = lh_X509_VERIFY_CACHE_retrieve(store->verify_cache, e)) != NULL)
+        verify_cache_remove(store, old);
+    verify_cache_trim(store, store->verify_cache_max - 1);
+    lh_X509_VERIFY_CACHE_insert(store->verify_cache, e);
+    if (lh_X509_VERIFY_CACHE_error(store->verify_cache))
+        goto err;
+    e->prev = store->verify_cache_tail;
+    if (e->prev != NULL)
+        e->prev->next = e;
+    else
+        store->verify_cache_head = e;
+    store->verify_cache_tail = e;
+    CRYPTO_THREAD_unlock(store->lock);
+    return;
+
+ err:
+    CRYPTO_THREAD_unlock(store->lock);
+    sk_X509_pop_free(e->chain, X509_free);
+    OPENSSL_free(e);
+}
+
 int X509_STORE_set_depth(X509_STORE *ctx, int depth)
 {
     X509_VERIFY_PARAM_set_depth(ctx->param, depth);
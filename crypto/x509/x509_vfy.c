@@ -22,6 +22,7 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 #include <openssl/objects.h>
+#include <internal/asn1_int.h>
 #include <internal/dane.h>
 #include <internal/x509_int.h>
 #include "x509_lcl.h"
@@ -76,6 +77,8 @@ static int check_id(X509_STORE_CTX *ctx);
 static int check_trust(X509_STORE_CTX *ctx, int num_untrusted);
 static int check_revocation(X509_STORE_CTX *ctx);
 static int check_cert(X509_STORE_CTX *ctx);
+static int check_crl(X509_STORE_CTX *ctx, X509_CRL *crl);
+static int cert_crl(X509_STORE_CTX *ctx, X509_CRL *crl, X509 *x);
 static int check_policy(X509_STORE_CTX *ctx);
 static int get_issuer_sk(X509 **issuer, X509_STORE_CTX *ctx, X509 *x);
 static int check_dane_issuer(X509_STORE_CTX *ctx, int depth);
@@ -99,6 +102,7 @@ static int check_crl_chain(X509_STORE_CTX *ctx,
                            STACK_OF(X509) *crl_path);
 
 static int internal_verify(X509_STORE_CTX *ctx);
+static void update_expiry(time_t *expires, const ASN1_TIME *tm);
 
 static int null_callback(int ok, X509_STORE_CTX *e)
 {
@@ -249,9 +253,134 @@ static int verify_chain(X509_STORE_CTX *ctx)
     return ok;
 }
 
+/*
+ * Lower |*expires| to |tm| if that is earlier, 0 meaning no bound yet.  A
+ * time that cannot be used sets it to -1 so that the result is not cached.
+ */
+static void update_expiry(time_t *expires, const ASN1_TIME *tm)
+{
+    int day, sec;
+    time_t t;
+
+    if (tm == NULL)
+        return;
+    if (!ASN1_TIME_diff(&day, &sec, NULL, tm)) {
+        *expires = (time_t)-1;
+        return;
+    }
+    t = time(NULL) + (time_t)day * 86400 + sec;
+    if (*expires == 0 || t < *expires)
+        *expires = t;
+}
+
+/*
+ * Compute the key of the verified chain cache of the store into |key|.  The
+ * key covers the target certificate, the untrusted certificates and the
+ * parameters that affect the result other than the peer identity, which
+ * check_id() verifies on every cache hit.  Returns 0 if the result is not
+ * cacheable, because the cache is disabled or the result depends on more than
+ * the key and the contents of the store: a verify callback, CRLs or other
+ * callbacks supplied by the application, a fixed verification time or a
+ * policy tree the caller may want to inspect.
+ */
+static int verify_cache_key(X509_STORE_CTX *ctx, unsigned char *key)
+{
+    X509_STORE *store = ctx->ctx;
+    EVP_MD_CTX *mctx;
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    unsigned int mdlen;
+    struct {
+        unsigned long flags;
+        int purpose, trust, depth, auth_level;
+    } param;
+    int i, ret = 0;
+
+    if (store == NULL || store->verify_cache_max == 0 || ctx->parent != NULL
+        || ctx->crls != NULL
+        || (ctx->param->flags & (X509_V_FLAG_USE_CHECK_TIME
+                                 | X509_V_FLAG_POLICY_CHECK)) != 0
+        || ctx->verify_cb != null_callback
+        || ctx->verify != internal_verify
+        || ctx->get_issuer != X509_STORE_CTX_get1_issuer
+        || ctx->check_issued != check_issued
+        || ctx->check_revocation != check_revocation
+        || ctx->get_crl != NULL
+        || ctx->check_crl != check_crl
+        || ctx->cert_crl != cert_crl
+        || ctx->lookup_certs != X509_STORE_CTX_get1_certs
+        || ctx->lookup_crls != X509_STORE_CTX_get1_crls)
+        return 0;
+
+    /* Avoid hashing uninitialised padding */
+    memset(&param, 0, sizeof(param));
+    param.flags = ctx->param->flags;
+    param.purpose = ctx->param->purpose;
+    param.trust = ctx->param->trust;
+    param.depth = ctx->param->depth;
+    param.auth_level = ctx->param->auth_level;
+
+    if ((mctx = EVP_MD_CTX_new()) == NULL
+        || !EVP_DigestInit_ex(mctx, EVP_sha256(), NULL)
+        || !EVP_DigestUpdate(mctx, &param, sizeof(param))
+        || !X509_digest(ctx->cert, EVP_sha256(), md, &mdlen)
+        || !EVP_DigestUpdate(mctx, md, mdlen))
+        goto end;
+    for (i = 0; i < sk_X509_num(ctx->untrusted); i++) {
+        if (!X509_digest(sk_X509_value(ctx->untrusted, i), EVP_sha256(),
+                         md, &mdlen)
+            || !EVP_DigestUpdate(mctx, md, mdlen))
+            goto end;
+    }
+    ret = EVP_DigestFinal_ex(mctx, key, NULL);
+ end:
+    EVP_MD_CTX_free(mctx);
+    return ret;
+}
+
+/*
+ * Use the chain cached for |key| if there is one, in which case |*ret| is set
+ * to the result of the verification and 1 is returned.
+ */
+static int verify_cache_get(X509_STORE_CTX *ctx, const unsigned char *key,
+                            int *ret)
+{
+    STACK_OF(X509) *chain;
+
+    if (!x509_store_cache_get(ctx->ctx, key, &chain, &ctx->num_untrusted))
+        return 0;
+
+    /* The cached chain may start with a different copy of the target */
+    X509_free(sk_X509_value(chain, 0));
+    X509_up_ref(ctx->cert);
+    sk_X509_set(chain, 0, ctx->cert);
+    sk_X509_pop_free(ctx->chain, X509_free);
+    ctx->chain = chain;
+    X509_get_pubkey_parameters(NULL, ctx->chain);
+    *ret = check_id(ctx);
+    return 1;
+}
+
+/*
+ * Cache the chain that has just been verified, until the first certificate
+ * expires or the first CRL that was checked needs to be updated.
+ */
+static void verify_cache_add(X509_STORE_CTX *ctx, const unsigned char *key)
+{
+    time_t expires = ctx->crl_expires;
+    int i;
+
+    for (i = 0; i < sk_X509_num(ctx->chain); i++)
+        update_expiry(&expires, X509_get0_notAfter(sk_X509_value(ctx->chain,
+                                                                 i)));
+    if (expires > time(NULL))
+        x509_store_cache_add(ctx->ctx, key, ctx->chain, ctx->num_untrusted,
+                             expires);
+}
+
 int X509_verify_cert(X509_STORE_CTX *ctx)
 {
     SSL_DANE *dane = ctx->dane;
+    unsigned char key[SHA256_DIGEST_LENGTH];
     int ret;
 
     if (ctx->cert == NULL) {
@@ -288,10 +417,15 @@ int X509_verify_cert(X509_STORE_CTX *ctx)
         !verify_cb_cert(ctx, ctx->cert, 0, X509_V_ERR_EE_KEY_TOO_SMALL))
         return 0;
 
-    if (DANETLS_ENABLED(dane))
+    if (DANETLS_ENABLED(dane)) {
         ret = dane_verify(ctx);
-    else
+    } else if (!verify_cache_key(ctx, key)) {
         ret = verify_chain(ctx);
+    } else if (!verify_cache_get(ctx, key, &ret)) {
+        ret = verify_chain(ctx);
+        if (ret > 0 && ctx->error == X509_V_OK)
+            verify_cache_add(ctx, key);
+    }
 
     /*
      * Safety-net.  If we are returning an error, we must also set ctx->error,
@@ -303,6 +437,78 @@ int X509_verify_cert(X509_STORE_CTX *ctx)
     return ret;
 }
 
+static int batch_cmp(const X509 *const *a, const X509 *const *b)
+{
+    return X509_cmp(*a, *b);
+}
+
+/*
+ * Give the contexts of a batch copies of their untrusted certificate stacks
+ * in which equal certificates are the same X509 object, so that the cached
+ * extensions and remembered signatures of an intermediate CA certificate
+ * are computed once for the whole batch. On allocation failure the contexts
+ * not handled yet keep their own stacks, which only loses the saving.
+ */
+static int batch_share_untrusted(X509_STORE_CTX **ctx, int num)
+{
+    STACK_OF(X509) *all, *sk;
+    X509 *x;
+    int i, j, ret = 0;
+
+    if ((all = sk_X509_new(batch_cmp)) == NULL)
+        return 0;
+    for (i = 0; i < num; i++) {
+        for (j = 0; j < sk_X509_num(ctx[i]->untrusted); j++) {
+            if (!sk_X509_push(all, sk_X509_value(ctx[i]->untrusted, j)))
+                goto end;
+        }
+    }
+    sk_X509_sort(all);
+
+    for (i = 0; i < num; i++) {
+        if (ctx[i]->untrusted == NULL || ctx[i]->batch_untrusted != NULL)
+            continue;
+        if ((sk = sk_X509_new_null()) == NULL)
+            goto end;
+        for (j = 0; j < sk_X509_num(ctx[i]->untrusted); j++) {
+            x = sk_X509_value(all,
+                              sk_X509_find(all,
+                                           sk_X509_value(ctx[i]->untrusted,
+                                                         j)));
+            if (!sk_X509_push(sk, x)) {
+                sk_X509_pop_free(sk, X509_free);
+                goto end;
+            }
+            X509_up_ref(x);
+        }
+        ctx[i]->batch_untrusted = sk;
+        ctx[i]->untrusted = sk;
+    }
+    ret = 1;
+ end:
+    sk_X509_free(all);
+    return ret;
+}
+
+int X509_verify_cert_batch(X509_STORE_CTX **ctx, int *ret, int num)
+{
+    int i, r, ok = 1;
+
+    /*
+     * Sharing only saves work, verify each chain on its own if it fails. The
+     * chains are verified one after the other in the calling thread.
+     */
+    batch_share_untrusted(ctx, num);
+    for (i = 0; i < num; i++) {
+        r = X509_verify_cert(ctx[i]);
+        if (ret != NULL)
+            ret[i] = r;
+        if (r <= 0)
+            ok = 0;
+    }
+    return ok;
+}
+
 /*
  * Given a STACK_OF(X509) find the issuer of cert (if any)
  */
@@ -886,6 +1092,9 @@ static int check_cert(X509_STORE_CTX *ctx)
                 goto done;
         }
 
+        update_expiry(&ctx->crl_expires, X509_CRL_get0_nextUpdate(crl));
+        if (dcrl)
+            update_expiry(&ctx->crl_expires, X509_CRL_get0_nextUpdate(dcrl));
         X509_CRL_free(crl);
         X509_CRL_free(dcrl);
         crl = NULL;
@@ -1379,6 +1588,8 @@ static int crl_crldp_check(X509 *x, X509_CRL *crl, int crl_score,
                            unsigned int *preasons)
 {
     int i;
+    STACK_OF(DIST_POINT) *crldp;
+
     if (crl->idp_flags & IDP_ONLYATTR)
         return 0;
     if (x->ex_flags & EXFLAG_CA) {
@@ -1389,8 +1600,9 @@ static int crl_crldp_check(X509 *x, X509_CRL *crl, int crl_score,
             return 0;
     }
     *preasons = crl->idp_reasons;
-    for (i = 0; i < sk_DIST_POINT_num(x->crldp); i++) {
-        DIST_POINT *dp = sk_DIST_POINT_value(x->crldp, i);
+    crldp = x509v3_get0_crldp(x);
+    for (i = 0; i < sk_DIST_POINT_num(crldp); i++) {
+        DIST_POINT *dp = sk_DIST_POINT_value(crldp, i);
         if (crldp_check_crlissuer(dp, crl, crl_score)) {
             if (!crl->idp || idp_check_dp(dp->distpoint, crl->idp->distpoint)) {
                 *preasons &= dp->dp_reasons;
@@ -1547,7 +1759,8 @@ static int cert_crl(X509_STORE_CTX *ctx, X509_CRL *crl, X509 *x)
      * reason is not removeFromCRL.
      */
     if (X509_CRL_get0_by_cert(crl, &rev, x)) {
-        if (rev->reason == CRL_REASON_REMOVE_FROM_CRL)
+        /* |rev| is NULL if the entry could not be decoded: still revoked */
+        if (rev != NULL && rev->reason == CRL_REASON_REMOVE_FROM_CRL)
             return 2;
         if (!verify_cb_crl(ctx, X509_V_ERR_CERT_REVOKED))
             return 0;
@@ -1636,6 +1849,26 @@ static int check_policy(X509_STORE_CTX *ctx)
  *
  * Return 1 on success, 0 otherwise.
  */
+/*
+ * Compare the notBefore (|after| == 0) or notAfter time of |x| like
+ * X509_cmp_time().  The time converted when |x| was decoded is used as long
+ * as the time in |x| is unchanged, however it was modified.
+ */
+static int cert_cmp_time(X509 *x, int after, time_t *ptime)
+{
+    const ASN1_TIME *tm = after ? X509_get0_notAfter(x)
+                                : X509_get0_notBefore(x);
+    time_t t, now;
+
+    if (!x509_cached_time(after ? &x->not_after : &x->not_before, tm, &t))
+        return X509_cmp_time(tm, ptime);
+    if (ptime == NULL)
+        time(&now);
+    else
+        now = *ptime;
+    return t <= now ? -1 : 1;
+}
+
 int x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int depth)
 {
     time_t *ptime;
@@ -1648,7 +1881,7 @@ int x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int depth)
     else
         ptime = NULL;
 
-    i = X509_cmp_time(X509_get0_notBefore(x), ptime);
+    i = cert_cmp_time(x, 0, ptime);
     if (i >= 0 && depth < 0)
         return 0;
     if (i == 0 && !verify_cb_cert(ctx, x, depth,
@@ -1657,7 +1890,7 @@ int x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int depth)
     if (i > 0 && !verify_cb_cert(ctx, x, depth, X509_V_ERR_CERT_NOT_YET_VALID))
         return 0;
 
-    i = X509_cmp_time(X509_get0_notAfter(x), ptime);
+    i = cert_cmp_time(x, 1, ptime);
     if (i <= 0 && depth < 0)
         return 0;
     if (i == 0 && !verify_cb_cert(ctx, x, depth,
@@ -1668,6 +1901,36 @@ int x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int depth)
     return 1;
 }
 
+/*
+ * Verify the signature of |xs| with the public key |pkey| of its issuer |xi|.
+ * A good signature is remembered in |xs| along with a digest of the issuer's
+ * SubjectPublicKeyInfo, including the algorithm and its parameters, so
+ * that certificates shared by many chains, like the intermediates held by an
+ * X509_STORE, are only checked once.
+ */
+static int verify_signature(X509 *xs, X509 *xi, EVP_PKEY *pkey)
+{
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    int ret;
+
+    if (!x509_pubkey_sha256(xi, md))
+        return X509_verify(xs, pkey);
+
+    CRYPTO_THREAD_read_lock(xs->lock);
+    ret = xs->sig_verified && memcmp(xs->sig_key, md, sizeof(md)) == 0;
+    CRYPTO_THREAD_unlock(xs->lock);
+    if (ret)
+        return 1;
+
+    if ((ret = X509_verify(xs, pkey)) > 0) {
+        CRYPTO_THREAD_write_lock(xs->lock);
+        memcpy(xs->sig_key, md, sizeof(md));
+        xs->sig_verified = 1;
+        CRYPTO_THREAD_unlock(xs->lock);
+    }
+    return ret;
+}
+
 static int internal_verify(X509_STORE_CTX *ctx)
 {
     int n = sk_X509_num(ctx->chain) - 1;
@@ -1718,7 +1981,7 @@ static int internal_verify(X509_STORE_CTX *ctx)
                 if (!verify_cb_cert(ctx, xi, xi != xs ? n+1 : n,
                         X509_V_ERR_UNABLE_TO_DECODE_ISSUER_PUBLIC_KEY))
                     return 0;
-            } else if (X509_verify(xs, pkey) <= 0) {
+            } else if (verify_signature(xs, xi, pkey) <= 0) {
                 if (!verify_cb_cert(ctx, xs, n,
                                     X509_V_ERR_CERT_SIGNATURE_FAILURE))
                     return 0;
@@ -1753,12 +2016,12 @@ int X509_cmp_current_time(const ASN1_TIME *ctm)
     return X509_cmp_time(ctm, NULL);
 }
 
-int X509_cmp_time(const ASN1_TIME *ctm, time_t *cmp_time)
+/* Check that |ctm| has the form RFC 5280 requires for validity times */
+static int time_format_ok(const ASN1_TIME *ctm)
 {
     static const size_t utctime_length = sizeof("YYMMDDHHMMSSZ") - 1;
     static const size_t generalizedtime_length = sizeof("YYYYMMDDHHMMSSZ") - 1;
-    ASN1_TIME *asn1_cmp_time = NULL;
-    int i, day, sec, ret = 0;
+    int i;
 
     /*
      * Note that ASN.1 allows much more slack in the time format than RFC5280.
@@ -1796,26 +2059,75 @@ int X509_cmp_time(const ASN1_TIME *ctm, time_t *cmp_time)
     if (ctm->data[ctm->length - 1] != 'Z')
         return 0;
 
-    /*
-     * There is ASN1_UTCTIME_cmp_time_t but no
-     * ASN1_GENERALIZEDTIME_cmp_time_t or ASN1_TIME_cmp_time_t,
-     * so we go through ASN.1
-     */
-    asn1_cmp_time = X509_time_adj(NULL, 0, cmp_time);
-    if (asn1_cmp_time == NULL)
-        goto err;
-    if (!ASN1_TIME_diff(&day, &sec, ctm, asn1_cmp_time))
-        goto err;
+    return 1;
+}
+
+int X509_cmp_time(const ASN1_TIME *ctm, time_t *cmp_time)
+{
+    time_t now;
+    int day, sec;
+
+    if (!time_format_ok(ctm))
+        return 0;
+
+    if (cmp_time == NULL)
+        time(&now);
+    else
+        now = *cmp_time;
+    if (!asn1_time_diff_time_t(&day, &sec, ctm, now))
+        return 0;
 
     /*
      * X509_cmp_time comparison is <=.
      * The return value 0 is reserved for errors.
      */
-    ret = (day >= 0 && sec >= 0) ? -1 : 1;
+    return (day >= 0 && sec >= 0) ? -1 : 1;
+}
 
- err:
-    ASN1_TIME_free(asn1_cmp_time);
-    return ret;
+/*
+ * Convert a validity time to seconds since the epoch.  Returns 0 if |ctm| is
+ * not in the form X509_cmp_time() accepts or does not fit in a time_t.
+ */
+int x509_time_to_time_t(const ASN1_TIME *ctm, time_t *t)
+{
+    int day, sec;
+    int64_t secs;
+
+    if (ctm == NULL || !time_format_ok(ctm)
+        || !asn1_time_diff_time_t(&day, &sec, ctm, 0))
+        return 0;
+    secs = -((int64_t)day * 86400 + sec);
+    if ((int64_t)(time_t)secs != secs)
+        return 0;
+    *t = (time_t)secs;
+    return 1;
+}
+
+/* Convert |tm| and remember it in |ct| with its encoding if possible */
+void x509_cache_time(X509_CACHED_TIME *ct, const ASN1_TIME *tm)
+{
+    ct->length = 0;
+    if (tm == NULL || tm->length <= 0 || tm->length > (int)sizeof(ct->data)
+            || !x509_time_to_time_t(tm, &ct->t))
+        return;
+    ct->type = tm->type;
+    memcpy(ct->data, tm->data, tm->length);
+    ct->length = tm->length;
+}
+
+/*
+ * Return 1 and the converted time in |*t| if |ct| holds |tm| as it is now
+ * encoded, 0 if it has to be converted again.
+ */
+int x509_cached_time(const X509_CACHED_TIME *ct, const ASN1_TIME *tm,
+                     time_t *t)
+{
+    if (ct->length == 0 || tm == NULL || tm->type != ct->type
+            || tm->length != ct->length
+            || memcmp(tm->data, ct->data, ct->length) != 0)
+        return 0;
+    *t = ct->t;
+    return 1;
 }
 
 ASN1_TIME *X509_gmtime_adj(ASN1_TIME *s, long adj)
@@ -2192,6 +2504,8 @@ int X509_STORE_CTX_init(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
     ctx->parent = NULL;
     ctx->dane = NULL;
     ctx->bare_ta_signed = 0;
+    ctx->crl_expires = 0;
+    ctx->batch_untrusted = NULL;
     /* Zero ex_data to make sure we're cleanup-safe */
     memset(&ctx->ex_data, 0, sizeof(ctx->ex_data));
 
@@ -2338,6 +2652,12 @@ void X509_STORE_CTX_cleanup(X509_STORE_CTX *ctx)
     ctx->tree = NULL;
     sk_X509_pop_free(ctx->chain, X509_free);
     ctx->chain = NULL;
+    if (ctx->batch_untrusted != NULL) {
+        if (ctx->untrusted == ctx->batch_untrusted)
+            ctx->untrusted = NULL;
+        sk_X509_pop_free(ctx->batch_untrusted, X509_free);
+        ctx->batch_untrusted = NULL;
+    }
     CRYPTO_free_ex_data(CRYPTO_EX_INDEX_X509_STORE_CTX, ctx, &(ctx->ex_data));
     memset(&ctx->ex_data, 0, sizeof(ctx->ex_data));
 }
@@ -51,6 +51,8 @@ int X509_CRL_sort(X509_CRL *c)
 {
     int i;
     X509_REVOKED *r;
+    if (!x509_crl_expand(c))
+        return 0;
     /*
      * sort the data so it will be written in serial number order
      */
@@ -114,6 +116,8 @@ const STACK_OF(X509_EXTENSION) *X509_CRL_get0_extensions(const X509_CRL *crl)
 
 STACK_OF(X509_REVOKED) *X509_CRL_get_REVOKED(X509_CRL *crl)
 {
+    if (!x509_crl_expand(crl))
+        return NULL;
     return crl->crl.revoked;
 }
 
@@ -177,6 +181,9 @@ const STACK_OF(X509_EXTENSION) *X509_REVOKED_get0_extensions(const X509_REVOKED
 
 int i2d_re_X509_CRL_tbs(X509_CRL *crl, unsigned char **pp)
 {
+    /* Re-encoding needs the revoked entries of a compact CRL */
+    if (!x509_crl_expand(crl))
+        return -1;
     crl->crl.enc.modified = 1;
     return i2d_X509_CRL_INFO(&crl->crl, pp);
 }
@@ -15,10 +15,23 @@
 #include <openssl/x509v3.h>
 #include "x509_lcl.h"
 
+DEFINE_LHASH_OF(X509_REVOKED);
+
 static int X509_REVOKED_cmp(const X509_REVOKED *const *a,
                             const X509_REVOKED *const *b);
 static void setup_idp(X509_CRL *crl, ISSUING_DIST_POINT *idp);
 
+/*
+ * Index entry for a revoked certificate left encoded by
+ * d2i_X509_CRL_compact(): |der| is the encoding of the entry and its serial
+ * number has |seriallen| octets at offset |serial|, without padding.
+ */
+typedef struct x509_crl_entry_st {
+    const unsigned char *der;
+    unsigned char serial;
+    unsigned char seriallen;
+} X509_CRL_ENTRY;
+
 ASN1_SEQUENCE(X509_REVOKED) = {
         ASN1_EMBED(X509_REVOKED,serialNumber, ASN1_INTEGER),
         ASN1_SIMPLE(X509_REVOKED,revocationDate, ASN1_TIME),
@@ -86,7 +99,7 @@ static int crl_set_issuers(X509_CRL *crl)
     GENERAL_NAMES *gens, *gtmp;
     STACK_OF(X509_REVOKED) *revoked;
 
-    revoked = X509_CRL_get_REVOKED(crl);
+    revoked = crl->crl.revoked;
 
     gens = NULL;
     for (i = 0; i < sk_X509_REVOKED_num(revoked); i++) {
@@ -169,6 +182,10 @@ static int crl_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
         crl->issuers = NULL;
         crl->crl_number = NULL;
         crl->base_crl_number = NULL;
+        crl->compact_der = NULL;
+        crl->compact = NULL;
+        crl->compact_num = 0;
+        crl->compact_hits = NULL;
         break;
 
     case ASN1_OP_D2I_POST:
@@ -240,6 +257,9 @@ static int crl_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
         ASN1_INTEGER_free(crl->crl_number);
         ASN1_INTEGER_free(crl->base_crl_number);
         sk_GENERAL_NAMES_pop_free(crl->issuers, GENERAL_NAMES_free);
+        OPENSSL_free(crl->compact);
+        lh_X509_REVOKED_doall(crl->compact_hits, X509_REVOKED_free);
+        lh_X509_REVOKED_free(crl->compact_hits);
         break;
     }
     return 1;
@@ -299,6 +319,318 @@ IMPLEMENT_ASN1_FUNCTIONS(X509_CRL)
 
 IMPLEMENT_ASN1_DUP_FUNCTION(X509_CRL)
 
+/* Order entries like X509_REVOKED_cmp() orders positive serial numbers */
+static int compact_serial_cmp(const X509_CRL_ENTRY *a, const X509_CRL_ENTRY *b)
+{
+    if (a->seriallen != b->seriallen)
+        return a->seriallen < b->seriallen ? -1 : 1;
+    return memcmp(a->der + a->serial, b->der + b->serial, a->seriallen);
+}
+
+/* Keep entries with the same serial number in their original order */
+static int compact_entry_cmp(const void *a, const void *b)
+{
+    const X509_CRL_ENTRY *ea = a, *eb = b;
+    int ret = compact_serial_cmp(ea, eb);
+
+    if (ret != 0)
+        return ret;
+    return ea->der < eb->der ? -1 : ea->der > eb->der;
+}
+
+static int compact_reason(X509_REVOKED *rev)
+{
+    ASN1_ENUMERATED *reason;
+    int ret = CRL_REASON_NONE;
+
+    reason = X509_REVOKED_get_ext_d2i(rev, NID_crl_reason, NULL, NULL);
+    if (reason != NULL) {
+        ret = ASN1_ENUMERATED_get(reason);
+        ASN1_ENUMERATED_free(reason);
+    }
+    return ret;
+}
+
+/*
+ * Read the header of the DER object at |*p| and advance |*p| to its
+ * contents, which are |*len| octets long.  Returns 0 for indefinite length
+ * encodings, errors, or if |tag| is not -1 and the object is not a universal
+ * object with that tag.
+ */
+static int compact_header(const unsigned char **p, const unsigned char *end,
+                          long *len, int tag)
+{
+    int ret, otag, oclass;
+
+    ret = ASN1_get_object(p, len, &otag, &oclass, end - *p);
+    if ((ret & 0x80) != 0 || ret == 0x21)
+        return 0;
+    return tag == -1 || (oclass == V_ASN1_UNIVERSAL && otag == tag);
+}
+
+/*
+ * Check the revoked entry of |crl| at |*p| and fill in |ent| for it.  An
+ * entry with extensions is decoded to check them like crl_set_issuers() does.
+ * Returns 0 if the entry cannot be left encoded, because it is malformed,
+ * has an unusual serial number or a certificate issuer extension.
+ */
+static int compact_entry(X509_CRL *crl, const unsigned char **p,
+                         const unsigned char *end, X509_CRL_ENTRY *ent)
+{
+    const unsigned char *q = *p, *s, *eend;
+    long len;
+    int pad, i, j;
+    X509_REVOKED *rev;
+    ASN1_ENUMERATED *reason;
+    GENERAL_NAMES *gens;
+    X509_EXTENSION *ext;
+
+    if (!compact_header(&q, end, &len, V_ASN1_SEQUENCE))
+        return 0;
+    eend = q + len;
+    if (!compact_header(&q, eend, &len, V_ASN1_INTEGER) || len == 0
+            || (q[0] & 0x80) != 0)
+        return 0;
+    s = q;
+    q += len;
+    pad = len > 1 && s[0] == 0;
+    if ((pad && (s[1] & 0x80) == 0) || len - pad > 0xff
+            || s + pad - *p > 0xff)
+        return 0;
+    ent->der = *p;
+    ent->serial = (unsigned char)(s + pad - *p);
+    ent->seriallen = (unsigned char)(len - pad);
+
+    if (!compact_header(&q, eend, &len, -1))
+        return 0;
+    q += len;
+    if (q == eend) {
+        *p = eend;
+        return 1;
+    }
+
+    q = *p;
+    if ((rev = d2i_X509_REVOKED(NULL, &q, eend - q)) == NULL || q != eend) {
+        X509_REVOKED_free(rev);
+        return 0;
+    }
+    gens = X509_REVOKED_get_ext_d2i(rev, NID_certificate_issuer, &j, NULL);
+    GENERAL_NAMES_free(gens);
+    if (j != -1) {
+        X509_REVOKED_free(rev);
+        return 0;
+    }
+    reason = X509_REVOKED_get_ext_d2i(rev, NID_crl_reason, &j, NULL);
+    if (reason == NULL && j != -1)
+        crl->flags |= EXFLAG_INVALID;
+    ASN1_ENUMERATED_free(reason);
+    for (i = 0; i < sk_X509_EXTENSION_num(rev->extensions); i++) {
+        ext = sk_X509_EXTENSION_value(rev->extensions, i);
+        if (X509_EXTENSION_get_critical(ext))
+            crl->flags |= EXFLAG_CRITICAL;
+    }
+    X509_REVOKED_free(rev);
+    *p = eend;
+    return 1;
+}
+
+/*
+ * Decode a CRL but leave its revoked entries encoded in |crl->crl.enc|.
+ * If |own| is not NULL it is the buffer holding the CRL at |*in|, which
+ * becomes |crl->crl.enc| instead of being copied, and |sha1| is the SHA1
+ * digest of the CRL.  Returns NULL if the CRL has to be decoded by
+ * d2i_X509_CRL() instead, in which case |own| is left untouched.
+ */
+static X509_CRL *compact_d2i(const unsigned char **in, long inlen,
+                             unsigned char *own, const unsigned char *sha1)
+{
+    const unsigned char *p = *in, *crl_end, *tbs, *tbs_data, *tbs_end;
+    const unsigned char *rev = NULL, *rev_end = NULL, *revc, *q, *end, *tp;
+    unsigned char *tmp = NULL, *w, *enc;
+    X509_CRL *crl = NULL;
+    long len, tbs2len, tmplen, tbslen;
+    size_t n, i;
+    int nseq = 0;
+
+    /* CertificateList */
+    if (!compact_header(&p, *in + inlen, &len, V_ASN1_SEQUENCE))
+        return NULL;
+    crl_end = p + len;
+    /* TBSCertList */
+    tbs = p;
+    if (!compact_header(&p, crl_end, &len, V_ASN1_SEQUENCE))
+        return NULL;
+    tbs_data = p;
+    tbs_end = p + len;
+    tbslen = tbs_end - tbs;
+    /* The revoked entries are the third SEQUENCE in TBSCertList */
+    while (p < tbs_end) {
+        q = p;
+        if (!compact_header(&q, tbs_end, &len, -1))
+            return NULL;
+        if (*p == (V_ASN1_CONSTRUCTED | V_ASN1_SEQUENCE) && ++nseq == 3) {
+            rev = p;
+            rev_end = q + len;
+            break;
+        }
+        p = q + len;
+    }
+    if (rev == NULL)
+        return NULL;
+
+    /* Decode a copy of the CRL without the revoked entries */
+    tbs2len = (tbs_end - tbs_data) - (rev_end - rev);
+    len = ASN1_object_size(1, tbs2len, V_ASN1_SEQUENCE) + (crl_end - tbs_end);
+    tmplen = ASN1_object_size(1, len, V_ASN1_SEQUENCE);
+    if ((tmp = OPENSSL_malloc(tmplen)) == NULL)
+        return NULL;
+    w = tmp;
+    ASN1_put_object(&w, 1, len, V_ASN1_SEQUENCE, V_ASN1_UNIVERSAL);
+    ASN1_put_object(&w, 1, tbs2len, V_ASN1_SEQUENCE, V_ASN1_UNIVERSAL);
+    memcpy(w, tbs_data, rev - tbs_data);
+    w += rev - tbs_data;
+    memcpy(w, rev_end, crl_end - rev_end);
+    tp = tmp;
+    crl = d2i_X509_CRL(NULL, &tp, tmplen);
+    OPENSSL_free(tmp);
+    if (crl == NULL)
+        return NULL;
+
+    /* Index the revoked entries where they are in the input */
+    p = rev;
+    if (!compact_header(&p, rev_end, &len, V_ASN1_SEQUENCE))
+        goto err;
+    revc = p;
+    end = p + len;
+    for (n = 0, q = p; q < end; n++) {
+        if (!compact_header(&q, end, &len, V_ASN1_SEQUENCE))
+            goto err;
+        q += len;
+    }
+    if (n > 0
+            && (crl->compact = OPENSSL_malloc(n * sizeof(*crl->compact)))
+               == NULL)
+        goto err;
+    for (crl->compact_num = 0; crl->compact_num < n; crl->compact_num++) {
+        if (!compact_entry(crl, &p, end, &crl->compact[crl->compact_num]))
+            goto err;
+    }
+
+    /* Keep the original encoding and point the index into it */
+    if (own != NULL) {
+        enc = own;
+        memmove(enc, tbs, tbslen);
+        memcpy(crl->sha1_hash, sha1, sizeof(crl->sha1_hash));
+    } else {
+        if ((enc = OPENSSL_malloc(tbslen)) == NULL)
+            goto err;
+        memcpy(enc, tbs, tbslen);
+    }
+    OPENSSL_free(crl->crl.enc.enc);
+    crl->crl.enc.enc = enc;
+    crl->crl.enc.len = tbslen;
+    crl->crl.enc.modified = 0;
+    crl->compact_der = enc + (revc - tbs);
+    crl->compact_len = end - revc;
+    for (i = 0; i < n; i++)
+        crl->compact[i].der = enc + (crl->compact[i].der - tbs);
+    if (own == NULL) {
+        if (!X509_CRL_digest(crl, EVP_sha1(), crl->sha1_hash, NULL))
+            goto err;
+        *in = crl_end;
+    }
+    qsort(crl->compact, n, sizeof(*crl->compact), compact_entry_cmp);
+    return crl;
+
+ err:
+    X509_CRL_free(crl);
+    return NULL;
+}
+
+X509_CRL *d2i_X509_CRL_compact(X509_CRL **a, const unsigned char **in,
+                               long len)
+{
+    X509_CRL *ret;
+
+    if (default_crl_method != &int_crl_meth
+            || (ret = compact_d2i(in, len, NULL, NULL)) == NULL)
+        return d2i_X509_CRL(a, in, len);
+    if (a != NULL) {
+        X509_CRL_free(*a);
+        *a = ret;
+    }
+    return ret;
+}
+
+/*
+ * Like d2i_X509_CRL_compact() for the |len| octets of |der|, but the buffer
+ * is kept as the encoding of the CRL rather than copied, or freed.  |sha1|
+ * is the SHA1 digest of |der|, computed by the caller as it was read.
+ */
+X509_CRL *x509_crl_d2i_compact_own(unsigned char *der, long len,
+                                   const unsigned char *sha1)
+{
+    const unsigned char *p = der;
+    X509_CRL *ret = NULL;
+
+    if (default_crl_method == &int_crl_meth)
+        ret = compact_d2i(&p, len, der, sha1);
+    if (ret == NULL) {
+        p = der;
+        ret = d2i_X509_CRL(NULL, &p, len);
+        OPENSSL_free(der);
+    }
+    return ret;
+}
+
+/*
+ * Decode the revoked entries of a CRL that d2i_X509_CRL_compact() left
+ * encoded, for the functions that need all of them.
+ */
+int x509_crl_expand(X509_CRL *crl)
+{
+    STACK_OF(X509_REVOKED) *revoked;
+    X509_REVOKED *rev;
+    const unsigned char *p, *end;
+    int ret = 0;
+
+    if (crl->compact_der == NULL)
+        return 1;
+
+    CRYPTO_THREAD_write_lock(crl->lock);
+    if (crl->compact_der == NULL) {
+        CRYPTO_THREAD_unlock(crl->lock);
+        return 1;
+    }
+    if ((revoked = sk_X509_REVOKED_new(X509_REVOKED_cmp)) == NULL)
+        goto end;
+    p = crl->compact_der;
+    end = p + crl->compact_len;
+    while (p < end) {
+        if ((rev = d2i_X509_REVOKED(NULL, &p, end - p)) == NULL)
+            goto end;
+        if (!sk_X509_REVOKED_push(revoked, rev)) {
+            X509_REVOKED_free(rev);
+            goto end;
+        }
+    }
+    crl->crl.revoked = revoked;
+    if (!crl_set_issuers(crl)) {
+        crl->crl.revoked = NULL;
+        goto end;
+    }
+    revoked = NULL;
+    OPENSSL_free(crl->compact);
+    crl->compact = NULL;
+    crl->compact_num = 0;
+    crl->compact_der = NULL;
+    ret = 1;
+ end:
+    CRYPTO_THREAD_unlock(crl->lock);
+    sk_X509_REVOKED_pop_free(revoked, X509_REVOKED_free);
+    return ret;
+}
+
 static int X509_REVOKED_cmp(const X509_REVOKED *const *a,
                             const X509_REVOKED *const *b)
 {
@@ -310,6 +642,10 @@ int X509_CRL_add0_revoked(X509_CRL *crl, X509_REVOKED *rev)
 {
     X509_CRL_INFO *inf;
     inf = &crl->crl;
+    if (!x509_crl_expand(crl)) {
+        ASN1err(ASN1_F_X509_CRL_ADD0_REVOKED, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
     if (inf->revoked == NULL)
         inf->revoked = sk_X509_REVOKED_new(X509_REVOKED_cmp);
     if (inf->revoked == NULL || !sk_X509_REVOKED_push(inf->revoked, rev)) {
@@ -377,12 +713,138 @@ static int crl_revoked_issuer_match(X509_CRL *crl, X509_NAME *nm,
 
 }
 
+/*
+ * Look up |serial| in the revoked entries of a CRL decoded by
+ * d2i_X509_CRL_compact(), must hold the read lock.  Sets |*ent| to the
+ * matching entry and returns 1, or returns 0 if there is none.
+ */
+static int compact_find(X509_CRL *crl, ASN1_INTEGER *serial,
+                        const X509_CRL_ENTRY **ent)
+{
+    X509_CRL_ENTRY key;
+    size_t lo = 0, hi = crl->compact_num, mid;
+
+    /* Compact entries all have positive serial numbers */
+    if (serial->type != V_ASN1_INTEGER || serial->length > 0xff)
+        return 0;
+    key.der = serial->data;
+    key.serial = 0;
+    key.seriallen = (unsigned char)serial->length;
+
+    /* Find the first entry with the serial number */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (compact_serial_cmp(&crl->compact[mid], &key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == crl->compact_num
+            || compact_serial_cmp(&crl->compact[lo], &key) != 0)
+        return 0;
+    *ent = &crl->compact[lo];
+    return 1;
+}
+
+/* FNV-1a over the serial number of an entry decoded by a lookup */
+static unsigned long compact_hit_hash(const X509_REVOKED *rev)
+{
+    const ASN1_INTEGER *serial = &rev->serialNumber;
+    unsigned long h = 2166136261UL;
+    int i;
+
+    for (i = 0; i < serial->length; i++) {
+        h ^= serial->data[i];
+        h = (h * 16777619UL) & 0xffffffffUL;
+    }
+    return h;
+}
+
+static int compact_hit_cmp(const X509_REVOKED *a, const X509_REVOKED *b)
+{
+    return ASN1_INTEGER_cmp(&a->serialNumber, &b->serialNumber);
+}
+
+/*
+ * Decode the compact entry |der|, or return the copy decoded by an earlier
+ * lookup.  Returns NULL on allocation failure.
+ */
+static X509_REVOKED *compact_get(X509_CRL *crl, const unsigned char *der,
+                                 long len)
+{
+    X509_REVOKED *rev, *tmp;
+
+    if ((rev = d2i_X509_REVOKED(NULL, &der, len)) == NULL)
+        return NULL;
+    rev->reason = compact_reason(rev);
+
+    CRYPTO_THREAD_write_lock(crl->lock);
+    if (crl->compact_hits == NULL)
+        crl->compact_hits = lh_X509_REVOKED_new(compact_hit_hash,
+                                                compact_hit_cmp);
+    if (crl->compact_hits == NULL) {
+        tmp = NULL;
+    } else if ((tmp = lh_X509_REVOKED_retrieve(crl->compact_hits,
+                                               rev)) != NULL) {
+        /* Another thread got here first */
+    } else {
+        lh_X509_REVOKED_insert(crl->compact_hits, rev);
+        if (lh_X509_REVOKED_error(crl->compact_hits) == 0) {
+            tmp = rev;
+            rev = NULL;
+        }
+    }
+    CRYPTO_THREAD_unlock(crl->lock);
+    X509_REVOKED_free(rev);
+    return tmp;
+}
+
+static int compact_lookup(X509_CRL *crl, X509_REVOKED **ret,
+                          ASN1_INTEGER *serial, X509_NAME *issuer)
+{
+    X509_REVOKED rtmp, *rev = NULL;
+    const X509_CRL_ENTRY *ent;
+    const unsigned char *der = NULL;
+    long len = 0;
+
+    CRYPTO_THREAD_read_lock(crl->lock);
+    if (crl->compact_der == NULL) {
+        CRYPTO_THREAD_unlock(crl->lock);
+        return -1;
+    }
+    if (compact_find(crl, serial, &ent)) {
+        der = ent->der;
+        len = crl->compact_der + crl->compact_len - der;
+        rtmp.serialNumber = *serial;
+        if (crl->compact_hits != NULL)
+            rev = lh_X509_REVOKED_retrieve(crl->compact_hits, &rtmp);
+    }
+    CRYPTO_THREAD_unlock(crl->lock);
+
+    if (der == NULL)
+        return 0;
+    /* Compact entries have no certificate issuer extension */
+    if (issuer != NULL && X509_NAME_cmp(issuer, X509_CRL_get_issuer(crl)))
+        return 0;
+    if (rev == NULL)
+        rev = compact_get(crl, der, len);
+    if (ret)
+        *ret = rev;
+    if (rev != NULL && rev->reason == CRL_REASON_REMOVE_FROM_CRL)
+        return 2;
+    return 1;
+}
+
 static int def_crl_lookup(X509_CRL *crl,
                           X509_REVOKED **ret, ASN1_INTEGER *serial,
                           X509_NAME *issuer)
 {
     X509_REVOKED rtmp, *rev;
     int idx;
+
+    if (crl->compact_der != NULL
+            && (idx = compact_lookup(crl, ret, serial, issuer)) >= 0)
+        return idx;
     rtmp.serialNumber = *serial;
     /*
      * Sort revoked into serial number order if not already sorted. Do this
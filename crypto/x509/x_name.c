@@ -11,6 +11,7 @@
 #include <ctype.h>
 #include "internal/cryptlib.h"
 #include <openssl/asn1t.h>
+#include <openssl/evp.h>
 #include <openssl/x509.h>
 #include "internal/x509_int.h"
 #include "internal/asn1_int.h"
@@ -287,6 +288,24 @@ static int x509_name_ex_print(BIO *out, ASN1_VALUE **pval,
     return 2;
 }
 
+/*
+ * Compute the fingerprint of the canonical encoding. The low 32 bits are
+ * the value returned by X509_NAME_hash().
+ */
+static int x509_name_canon_hash(X509_NAME *a)
+{
+    unsigned char md[SHA_DIGEST_LENGTH];
+    int i;
+
+    a->canon_hash = 0;
+    if (!EVP_Digest(a->canon_enc, a->canon_enclen, md, NULL, EVP_sha1(),
+                    NULL))
+        return 0;
+    for (i = 7; i >= 0; i--)
+        a->canon_hash = (a->canon_hash << 8) | md[i];
+    return 1;
+}
+
 /*
  * This function generates the canonical encoding of the Name structure. In
  * it all strings are converted to UTF8, leading, trailing and multiple
@@ -310,7 +329,7 @@ static int x509_name_canon(X509_NAME *a)
     /* Special case: empty X509_NAME => null encoding */
     if (sk_X509_NAME_ENTRY_num(a->entries) == 0) {
         a->canon_enclen = 0;
-        return 1;
+        return x509_name_canon_hash(a);
     }
     intname = sk_STACK_OF_X509_NAME_ENTRY_new_null();
     if (!intname)
@@ -356,7 +375,7 @@ static int x509_name_canon(X509_NAME *a)
 
     i2d_name_canon(intname, &p);
 
-    ret = 1;
+    ret = x509_name_canon_hash(a);
 
  err:
 
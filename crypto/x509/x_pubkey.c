@@ -21,9 +21,15 @@ struct X509_pubkey_st {
     X509_ALGOR *algor;
     ASN1_BIT_STRING *public_key;
     EVP_PKEY *pkey;
+    /* SHA-256 digest of the DER encoding of the key, if |sha256_set| */
+    int sha256_set;
+    /* Set if the encoding lacks domain parameters inherited from the chain */
+    int params_missing;
+    unsigned char sha256[SHA256_DIGEST_LENGTH];
 };
 
 static int x509_pubkey_decode(EVP_PKEY **pk, X509_PUBKEY *key);
+static int x509_pubkey_der_sha256(X509_PUBKEY *key, unsigned char *md);
 
 /* Minor tweak to operation: free up EVP_PKEY */
 static int pubkey_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
@@ -45,6 +51,10 @@ static int pubkey_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
         if (x509_pubkey_decode(&pubkey->pkey, pubkey) == -1)
             return 0;
         ERR_pop_to_mark();
+        /* Cache the digest used to identify issuer keys, see x509_vfy.c */
+        pubkey->params_missing = pubkey->pkey != NULL
+                                 && EVP_PKEY_missing_parameters(pubkey->pkey);
+        pubkey->sha256_set = x509_pubkey_der_sha256(pubkey, pubkey->sha256);
     }
     return 1;
 }
@@ -340,6 +350,7 @@ int X509_PUBKEY_set0_param(X509_PUBKEY *pub, ASN1_OBJECT *aobj,
 {
     if (!X509_ALGOR_set0(pub->algor, aobj, ptype, pval))
         return 0;
+    pub->sha256_set = 0;
     if (penc) {
         OPENSSL_free(pub->public_key->data);
         pub->public_key->data = penc;
@@ -351,6 +362,38 @@ int X509_PUBKEY_set0_param(X509_PUBKEY *pub, ASN1_OBJECT *aobj,
     return 1;
 }
 
+/* SHA-256 digest of the DER encoding of the whole SubjectPublicKeyInfo */
+static int x509_pubkey_der_sha256(X509_PUBKEY *key, unsigned char *md)
+{
+    unsigned char *der = NULL;
+    int len, ret;
+
+    if ((len = i2d_X509_PUBKEY(key, &der)) <= 0)
+        return 0;
+    ret = EVP_Digest(der, len, md, NULL, EVP_sha256(), NULL);
+    OPENSSL_free(der);
+    return ret;
+}
+
+/*
+ * SHA-256 digest of the SubjectPublicKeyInfo of |x|, covering the algorithm
+ * and its parameters as well as the key itself. The digest cached when the
+ * key was decoded is used if there is one. Fails if the key takes its domain
+ * parameters from elsewhere in the chain, as they are not part of the digest.
+ */
+int x509_pubkey_sha256(const X509 *x, unsigned char *md)
+{
+    X509_PUBKEY *pub = x->cert_info.key;
+
+    if (pub == NULL || pub->public_key == NULL || pub->params_missing)
+        return 0;
+    if (pub->sha256_set) {
+        memcpy(md, pub->sha256, SHA256_DIGEST_LENGTH);
+        return 1;
+    }
+    return x509_pubkey_der_sha256(pub, md);
+}
+
 int X509_PUBKEY_get0_param(ASN1_OBJECT **ppkalg,
                            const unsigned char **pk, int *ppklen,
                            X509_ALGOR **pa, X509_PUBKEY *pub)
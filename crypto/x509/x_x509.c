@@ -42,6 +42,10 @@ static int x509_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
 
     case ASN1_OP_NEW_POST:
         ret->ex_flags = 0;
+        ret->ex_cached = 0;
+        ret->sig_verified = 0;
+        ret->not_before.length = 0;
+        ret->not_after.length = 0;
         ret->ex_pathlen = -1;
         ret->ex_pcpathlen = -1;
         ret->skid = NULL;
@@ -56,6 +60,11 @@ static int x509_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
             return 0;
         break;
 
+    case ASN1_OP_D2I_POST:
+        x509_cache_time(&ret->not_before, ret->cert_info.validity.notBefore);
+        x509_cache_time(&ret->not_after, ret->cert_info.validity.notAfter);
+        break;
+
     case ASN1_OP_FREE_POST:
         CRYPTO_free_ex_data(CRYPTO_EX_INDEX_X509, ret, &ret->ex_data);
         X509_CERT_AUX_free(ret->aux);
@@ -181,6 +181,7 @@ int NAME_CONSTRAINTS_check(X509 *x, NAME_CONSTRAINTS *nc)
 {
     int r, i;
     X509_NAME *nm;
+    GENERAL_NAMES *altname;
 
     nm = X509_get_subject_name(x);
 
@@ -217,8 +218,9 @@ int NAME_CONSTRAINTS_check(X509 *x, NAME_CONSTRAINTS *nc)
 
     }
 
-    for (i = 0; i < sk_GENERAL_NAME_num(x->altname); i++) {
-        GENERAL_NAME *gen = sk_GENERAL_NAME_value(x->altname, i);
+    altname = x509v3_get0_altname(x);
+    for (i = 0; i < sk_GENERAL_NAME_num(altname); i++) {
+        GENERAL_NAME *gen = sk_GENERAL_NAME_value(altname, i);
         r = nc_match(gen, nc);
         if (r != X509_V_OK)
             return r;
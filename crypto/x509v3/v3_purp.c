@@ -335,6 +335,37 @@ static void setup_crldp(X509 *x)
         setup_dp(x, sk_DIST_POINT_value(x->crldp, i));
 }
 
+/*
+ * The subject alternative names and CRL distribution points are not needed
+ * to work out the extension flags, and are often large, so they are only
+ * decoded the first time they are asked for.
+ */
+STACK_OF(GENERAL_NAME) *x509v3_get0_altname(X509 *x)
+{
+    if (!(x->ex_cached & X509_CACHED_ALTNAME)) {
+        CRYPTO_THREAD_write_lock(x->lock);
+        if (!(x->ex_cached & X509_CACHED_ALTNAME)) {
+            x->altname = X509_get_ext_d2i(x, NID_subject_alt_name, NULL, NULL);
+            x->ex_cached |= X509_CACHED_ALTNAME;
+        }
+        CRYPTO_THREAD_unlock(x->lock);
+    }
+    return x->altname;
+}
+
+STACK_OF(DIST_POINT) *x509v3_get0_crldp(X509 *x)
+{
+    if (!(x->ex_cached & X509_CACHED_CRLDP)) {
+        CRYPTO_THREAD_write_lock(x->lock);
+        if (!(x->ex_cached & X509_CACHED_CRLDP)) {
+            setup_crldp(x);
+            x->ex_cached |= X509_CACHED_CRLDP;
+        }
+        CRYPTO_THREAD_unlock(x->lock);
+    }
+    return x->crldp;
+}
+
 #define V1_ROOT (EXFLAG_V1|EXFLAG_SS)
 #define ku_reject(x, usage) \
         (((x)->ex_flags & EXFLAG_KUSAGE) && !((x)->ex_kusage & (usage)))
@@ -464,11 +495,9 @@ static void x509v3_cache_extensions(X509 *x)
             !ku_reject(x, KU_KEY_CERT_SIGN))
             x->ex_flags |= EXFLAG_SS;
     }
-    x->altname = X509_get_ext_d2i(x, NID_subject_alt_name, NULL, NULL);
     x->nc = X509_get_ext_d2i(x, NID_name_constraints, &i, NULL);
     if (!x->nc && (i != -1))
         x->ex_flags |= EXFLAG_INVALID;
-    setup_crldp(x);
 
 #ifndef OPENSSL_NO_RFC3779
     x->rfc3779_addr = X509_get_ext_d2i(x, NID_sbgp_ipAddrBlock, NULL, NULL);
@@ -755,8 +784,8 @@ static int no_check(const X509_PURPOSE *xp, const X509 *x, int ca)
 
 int X509_check_issued(X509 *issuer, X509 *subject)
 {
-    if (X509_NAME_cmp(X509_get_subject_name(issuer),
-                      X509_get_issuer_name(subject)))
+    if (x509_name_equal(X509_get_subject_name(issuer),
+                        X509_get_issuer_name(subject)) != 1)
         return X509_V_ERR_SUBJECT_ISSUER_MISMATCH;
     x509v3_cache_extensions(issuer);
     x509v3_cache_extensions(subject);
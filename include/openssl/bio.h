@@ -131,6 +131,9 @@ extern "C" {
 
 # define BIO_CTRL_DGRAM_SET_PEEK_MODE      50
 
+# define BIO_CTRL_DGRAM_SET_RECV_BATCH     71/* datagrams per recvmmsg() */
+# define BIO_CTRL_DGRAM_SET_SEND_BATCH     72/* datagrams per sendmmsg() */
+
 # ifndef OPENSSL_NO_SCTP
 /* SCTP stuff */
 #  define BIO_CTRL_DGRAM_SCTP_SET_IN_HANDSHAKE    50
@@ -518,6 +521,10 @@ int BIO_ctrl_reset_read_request(BIO *b);
          (int)BIO_ctrl(b, BIO_CTRL_DGRAM_SET_PEER, 0, (char *)peer)
 # define BIO_dgram_get_mtu_overhead(b) \
          (unsigned int)BIO_ctrl((b), BIO_CTRL_DGRAM_GET_MTU_OVERHEAD, 0, NULL)
+# define BIO_dgram_set_recv_batch(b,n) \
+         (int)BIO_ctrl(b, BIO_CTRL_DGRAM_SET_RECV_BATCH, n, NULL)
+# define BIO_dgram_set_send_batch(b,n) \
+         (int)BIO_ctrl(b, BIO_CTRL_DGRAM_SET_SEND_BATCH, n, NULL)
 
 #define BIO_get_ex_new_index(l, p, newf, dupf, freef) \
     CRYPTO_get_ex_new_index(CRYPTO_EX_INDEX_BIO, l, p, newf, dupf, freef)
@@ -822,6 +829,8 @@ int ERR_load_BIO_strings(void);
 # define BIO_F_BUFFER_CTRL                                114
 # define BIO_F_CONN_CTRL                                  127
 # define BIO_F_CONN_STATE                                 115
+# define BIO_F_DGRAM_BATCH_RESERVE                        143
+# define BIO_F_DGRAM_BATCH_SET_MAX                        145
 # define BIO_F_DGRAM_SCTP_READ                            132
 # define BIO_F_DGRAM_SCTP_WRITE                           133
 # define BIO_F_FILE_CTRL                                  116
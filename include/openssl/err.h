@@ -47,6 +47,8 @@ typedef struct err_state_st {
     const char *err_file[ERR_NUM_ERRORS];
     int err_line[ERR_NUM_ERRORS];
     int top, bottom;
+    /* Nesting depth of ERR_suppress_start() */
+    int suppress;
 } ERR_STATE;
 
 /* library */
@@ -251,6 +253,8 @@ int ERR_get_next_error_library(void);
 
 int ERR_set_mark(void);
 int ERR_pop_to_mark(void);
+int ERR_suppress_start(void);
+int ERR_suppress_end(void);
 
 #ifdef  __cplusplus
 }
@@ -182,6 +182,7 @@ int ERR_load_OBJ_strings(void);
 # define OBJ_F_OBJ_CREATE                                 100
 # define OBJ_F_OBJ_DUP                                    101
 # define OBJ_F_OBJ_NAME_NEW_INDEX                         106
+# define OBJ_F_OBJ_NAME_SNAPSHOT_INT                      107
 # define OBJ_F_OBJ_NID2LN                                 102
 # define OBJ_F_OBJ_NID2OBJ                                103
 # define OBJ_F_OBJ_NID2SN                                 104
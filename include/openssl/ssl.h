@@ -413,6 +413,18 @@ typedef int (*SSL_verify_cb)(int preverify_ok, X509_STORE_CTX *x509_ctx);
  * Support Asynchronous operation
  */
 # define SSL_MODE_ASYNC 0x00000100U
+/*
+ * Hold back small application data writes and send them in as few records
+ * as possible once enough data has been collected or SSL_flush() is called.
+ * (TLS only.)
+ */
+# define SSL_MODE_COALESCE_WRITES 0x00000200U
+/*
+ * Encrypt large application data writes with an AEAD cipher into packs of
+ * 4 or 8 records that are sent with a single write. This needs a write
+ * buffer of up to 8 records. (TLS only.)
+ */
+# define SSL_MODE_PACK_RECORDS 0x00000400U
 
 /* Cert related flags */
 /*
@@ -557,6 +569,8 @@ __owur int SRP_Calc_A_param(SSL *s);
 # define SSL_MAX_CERT_LIST_DEFAULT 1024*100
 
 # define SSL_SESSION_CACHE_MAX_SIZE_DEFAULT      (1024*20)
+/* The maximum number of independently locked session cache shards */
+# define SSL_MAX_SESS_CACHE_SHARDS               256
 
 /*
  * This callback type is used inside SSL_CTX, SSL, and in the functions that
@@ -583,6 +597,7 @@ typedef int (*GEN_SESSION_CB) (const SSL *ssl, unsigned char *id,
 # define SSL_SESS_CACHE_NO_INTERNAL_STORE        0x0200
 # define SSL_SESS_CACHE_NO_INTERNAL \
         (SSL_SESS_CACHE_NO_INTERNAL_LOOKUP|SSL_SESS_CACHE_NO_INTERNAL_STORE)
+# define SSL_SESS_CACHE_CLIENT_AUTO              0x0400
 
 LHASH_OF(SSL_SESSION) *SSL_CTX_sessions(SSL_CTX *ctx);
 # define SSL_CTX_sess_number(ctx) \
@@ -1164,6 +1179,15 @@ DECLARE_PEM_rw(SSL_SESSION, SSL_SESSION)
 # define SSL_CTRL_GET_TLSEXT_STATUS_REQ_TYPE     127
 # define SSL_CTRL_GET_TLSEXT_STATUS_REQ_CB       128
 # define SSL_CTRL_GET_TLSEXT_STATUS_REQ_CB_ARG   129
+# define SSL_CTRL_SET_SESS_CACHE_SHARDS          130
+# define SSL_CTRL_GET_SESS_CACHE_SHARDS          131
+# define SSL_CTRL_SET_BUFFER_POOL_SIZE           132
+# define SSL_CTRL_GET_BUFFER_POOL_SIZE           133
+# define SSL_CTRL_BUFFER_POOL_HITS               134
+# define SSL_CTRL_BUFFER_POOL_MISSES             135
+# define SSL_CTRL_SET_WRITE_COALESCE_THRESHOLD   136
+# define SSL_CTRL_SET_TICKET_KEY_RING_SIZE       137
+# define SSL_CTRL_GET_TICKET_KEY_RING_SIZE       138
 # define SSL_CERT_SET_FIRST                      1
 # define SSL_CERT_SET_NEXT                       2
 # define SSL_CERT_SET_SERVER                     3
@@ -1348,6 +1372,12 @@ __owur int SSL_want(const SSL *s);
 __owur int SSL_clear(SSL *s);
 
 void SSL_CTX_flush_sessions(SSL_CTX *ctx, long tm);
+size_t SSL_CTX_expire_sessions(SSL_CTX *ctx, long tm, size_t max);
+__owur int SSL_CTX_rotate_ticket_keys(SSL_CTX *ctx, const unsigned char *keys,
+                                      size_t keylen);
+__owur int SSL_CTX_add_ticket_key(SSL_CTX *ctx, const unsigned char *keys,
+                                  size_t keylen);
+int SSL_CTX_remove_ticket_key(SSL_CTX *ctx, const unsigned char *name);
 
 __owur const SSL_CIPHER *SSL_get_current_cipher(const SSL *s);
 __owur int SSL_CIPHER_get_bits(const SSL_CIPHER *c, int *alg_bits);
@@ -1464,6 +1494,8 @@ int SSL_SESSION_up_ref(SSL_SESSION *ses);
 void SSL_SESSION_free(SSL_SESSION *ses);
 __owur int i2d_SSL_SESSION(SSL_SESSION *in, unsigned char **pp);
 __owur int SSL_set_session(SSL *to, SSL_SESSION *session);
+__owur int SSL_set1_client_cache_peer(SSL *s, const char *host,
+                                      unsigned short port);
 __owur int SSL_CTX_add_session(SSL_CTX *s, SSL_SESSION *c);
 int SSL_CTX_remove_session(SSL_CTX *, SSL_SESSION *c);
 __owur int SSL_CTX_set_generate_session_id(SSL_CTX *, GEN_SESSION_CB);
@@ -1624,8 +1656,12 @@ __owur int SSL_read_early_data(SSL *s, void *buf, size_t num,
                                size_t *readbytes);
 __owur int SSL_peek(SSL *ssl, void *buf, int num);
 __owur int SSL_peek_ex(SSL *ssl, void *buf, size_t num, size_t *readbytes);
+__owur int SSL_get0_read_data(SSL *ssl, const unsigned char **data,
+                              size_t *len);
+__owur int SSL_release_read_data(SSL *ssl, size_t len);
 __owur int SSL_write(SSL *ssl, const void *buf, int num);
 __owur int SSL_write_ex(SSL *s, const void *buf, size_t num, size_t *written);
+int SSL_flush(SSL *s);
 __owur int SSL_write_early_data(SSL *s, const void *buf, size_t num,
                                 size_t *written);
 long SSL_ctrl(SSL *ssl, int cmd, long larg, void *parg);
@@ -1804,6 +1840,10 @@ __owur int SSL_get_ex_data_X509_STORE_CTX_idx(void);
         SSL_CTX_ctrl(ctx,SSL_CTRL_SET_SESS_CACHE_MODE,m,NULL)
 # define SSL_CTX_get_session_cache_mode(ctx) \
         SSL_CTX_ctrl(ctx,SSL_CTRL_GET_SESS_CACHE_MODE,0,NULL)
+# define SSL_CTX_set_session_cache_shards(ctx,n) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_SET_SESS_CACHE_SHARDS,n,NULL)
+# define SSL_CTX_get_session_cache_shards(ctx) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_GET_SESS_CACHE_SHARDS,0,NULL)
 
 # define SSL_CTX_get_default_read_ahead(ctx) SSL_CTX_get_read_ahead(ctx)
 # define SSL_CTX_set_default_read_ahead(ctx,m) SSL_CTX_set_read_ahead(ctx,m)
@@ -1832,6 +1872,18 @@ __owur int SSL_get_ex_data_X509_STORE_CTX_idx(void);
         SSL_CTX_ctrl(ctx,SSL_CTRL_SET_MAX_PIPELINES,m,NULL)
 # define SSL_set_max_pipelines(ssl,m) \
         SSL_ctrl(ssl,SSL_CTRL_SET_MAX_PIPELINES,m,NULL)
+# define SSL_CTX_set_write_coalesce_threshold(ctx,n) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_SET_WRITE_COALESCE_THRESHOLD,n,NULL)
+# define SSL_set_write_coalesce_threshold(ssl,n) \
+        SSL_ctrl(ssl,SSL_CTRL_SET_WRITE_COALESCE_THRESHOLD,n,NULL)
+# define SSL_CTX_set_buffer_pool_size(ctx,n) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_SET_BUFFER_POOL_SIZE,n,NULL)
+# define SSL_CTX_get_buffer_pool_size(ctx) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_GET_BUFFER_POOL_SIZE,0,NULL)
+# define SSL_CTX_buffer_pool_hits(ctx) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_BUFFER_POOL_HITS,0,NULL)
+# define SSL_CTX_buffer_pool_misses(ctx) \
+        SSL_CTX_ctrl(ctx,SSL_CTRL_BUFFER_POOL_MISSES,0,NULL)
 
 void SSL_CTX_set_default_read_buffer_len(SSL_CTX *ctx, size_t len);
 void SSL_set_default_read_buffer_len(SSL *s, size_t len);
@@ -2192,6 +2244,7 @@ int ERR_load_SSL_strings(void);
 # define SSL_F_SSL3_SETUP_READ_BUFFER                     156
 # define SSL_F_SSL3_SETUP_WRITE_BUFFER                    291
 # define SSL_F_SSL3_WRITE_BYTES                           158
+# define SSL_F_SSL3_WRITE_COALESCE                        539
 # define SSL_F_SSL3_WRITE_PENDING                         159
 # define SSL_F_SSL_ADD_CERT_CHAIN                         316
 # define SSL_F_SSL_ADD_CERT_TO_BUF                        319
@@ -2219,19 +2272,23 @@ int ERR_load_SSL_strings(void);
 # define SSL_F_SSL_CIPHER_PROCESS_RULESTR                 230
 # define SSL_F_SSL_CIPHER_STRENGTH_SORT                   231
 # define SSL_F_SSL_CLEAR                                  164
+# define SSL_F_SSL_CLIENT_CACHE_NEW                       544
 # define SSL_F_SSL_COMP_ADD_COMPRESSION_METHOD            165
 # define SSL_F_SSL_CONF_CMD                               334
 # define SSL_F_SSL_CREATE_CIPHER_LIST                     166
 # define SSL_F_SSL_CTRL                                   232
+# define SSL_F_SSL_CTX_ADD_TICKET_KEY                     541
 # define SSL_F_SSL_CTX_CHECK_PRIVATE_KEY                  168
 # define SSL_F_SSL_CTX_ENABLE_CT                          398
 # define SSL_F_SSL_CTX_MAKE_PROFILES                      309
 # define SSL_F_SSL_CTX_NEW                                169
+# define SSL_F_SSL_CTX_ROTATE_TICKET_KEYS                 542
 # define SSL_F_SSL_CTX_SET_ALPN_PROTOS                    343
 # define SSL_F_SSL_CTX_SET_CIPHER_LIST                    269
 # define SSL_F_SSL_CTX_SET_CLIENT_CERT_ENGINE             290
 # define SSL_F_SSL_CTX_SET_CT_VALIDATION_CALLBACK         396
 # define SSL_F_SSL_CTX_SET_SESSION_ID_CONTEXT             219
+# define SSL_F_SSL_CTX_SET_SESS_SHARDS                    536
 # define SSL_F_SSL_CTX_SET_SSL_VERSION                    170
 # define SSL_F_SSL_CTX_USE_CERTIFICATE                    171
 # define SSL_F_SSL_CTX_USE_CERTIFICATE_ASN1               172
@@ -2251,6 +2308,8 @@ int ERR_load_SSL_strings(void);
 # define SSL_F_SSL_DO_HANDSHAKE                           180
 # define SSL_F_SSL_DUP_CA_LIST                            408
 # define SSL_F_SSL_ENABLE_CT                              402
+# define SSL_F_SSL_FLUSH                                  540
+# define SSL_F_SSL_GET0_READ_DATA                         537
 # define SSL_F_SSL_GET_NEW_SESSION                        181
 # define SSL_F_SSL_GET_PREV_SESSION                       217
 # define SSL_F_SSL_GET_SERVER_CERT_INDEX                  322
@@ -2275,6 +2334,7 @@ int ERR_load_SSL_strings(void);
 # define SSL_F_SSL_READ_EARLY_DATA                        529
 # define SSL_F_SSL_READ_EX                                434
 # define SSL_F_SSL_READ_INTERNAL                          523
+# define SSL_F_SSL_RELEASE_READ_DATA                      538
 # define SSL_F_SSL_RENEGOTIATE                            516
 # define SSL_F_SSL_SCAN_CLIENTHELLO_TLSEXT                320
 # define SSL_F_SSL_SCAN_SERVERHELLO_TLSEXT                321
@@ -2283,6 +2343,7 @@ int ERR_load_SSL_strings(void);
 # define SSL_F_SSL_SESSION_PRINT_FP                       190
 # define SSL_F_SSL_SESSION_SET1_ID                        423
 # define SSL_F_SSL_SESSION_SET1_ID_CONTEXT                312
+# define SSL_F_SSL_SET1_CLIENT_CACHE_PEER                 543
 # define SSL_F_SSL_SET_ALPN_PROTOS                        344
 # define SSL_F_SSL_SET_CERT                               191
 # define SSL_F_SSL_SET_CIPHER_LIST                        271
@@ -2598,6 +2659,7 @@ int ERR_load_SSL_strings(void);
 # define SSL_R_NO_SRTP_PROFILES                           359
 # define SSL_R_NO_SUITABLE_KEY_SHARE                      101
 # define SSL_R_NO_SUITABLE_SIGNATURE_ALGORITHM            118
+# define SSL_R_NO_TICKET_KEY_RING                         194
 # define SSL_R_NO_VALID_SCTS                              216
 # define SSL_R_NO_VERIFY_COOKIE_CALLBACK                  403
 # define SSL_R_NULL_SSL_CTX                               195
@@ -2627,6 +2689,7 @@ int ERR_load_SSL_strings(void);
 # define SSL_R_SCSV_RECEIVED_WHEN_RENEGOTIATING           345
 # define SSL_R_SCT_VERIFICATION_FAILED                    208
 # define SSL_R_SERVERHELLO_TLSEXT                         275
+# define SSL_R_SESSION_CACHE_NOT_EMPTY                    186
 # define SSL_R_SESSION_ID_CONTEXT_UNINITIALIZED           277
 # define SSL_R_SHUTDOWN_WHILE_IN_INIT                     407
 # define SSL_R_SIGNATURE_ALGORITHMS_ERROR                 360
@@ -2664,6 +2727,7 @@ int ERR_load_SSL_strings(void);
 # define SSL_R_SSL_SESSION_ID_TOO_LONG                    408
 # define SSL_R_SSL_SESSION_VERSION_MISMATCH               210
 # define SSL_R_STILL_IN_INIT                              121
+# define SSL_R_TICKET_KEY_IN_USE                          205
 # define SSL_R_TLSV1_ALERT_ACCESS_DENIED                  1049
 # define SSL_R_TLSV1_ALERT_DECODE_ERROR                   1050
 # define SSL_R_TLSV1_ALERT_DECRYPTION_FAILED              1021
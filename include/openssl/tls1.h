@@ -317,6 +317,10 @@ SSL_CTX_ctrl(ctx,SSL_CTRL_SET_TLSEXT_SERVERNAME_ARG,0, (void *)arg)
         SSL_CTX_ctrl((ctx),SSL_CTRL_GET_TLSEXT_TICKET_KEYS,(keylen),(keys))
 # define SSL_CTX_set_tlsext_ticket_keys(ctx, keys, keylen) \
         SSL_CTX_ctrl((ctx),SSL_CTRL_SET_TLSEXT_TICKET_KEYS,(keylen),(keys))
+# define SSL_CTX_set_ticket_key_ring_size(ctx, n) \
+        SSL_CTX_ctrl((ctx),SSL_CTRL_SET_TICKET_KEY_RING_SIZE,(n),NULL)
+# define SSL_CTX_get_ticket_key_ring_size(ctx) \
+        SSL_CTX_ctrl((ctx),SSL_CTRL_GET_TICKET_KEY_RING_SIZE,0,NULL)
 
 # define SSL_CTX_get_tlsext_status_cb(ssl, cb) \
 SSL_CTX_ctrl(ssl,SSL_CTRL_GET_TLSEXT_STATUS_REQ_CB,0, (void (**)(void))cb)
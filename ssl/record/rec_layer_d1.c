@@ -302,6 +302,21 @@ int dtls1_process_buffered_records(SSL *s)
     return 1;
 }
 
+/*
+ * Checks if there are records that can be processed without waiting for the
+ * network: application data buffered during the handshake, or datagrams that
+ * were received in the same batch as the last one, see
+ * BIO_dgram_set_recv_batch(). As such a batch empties the socket, callers
+ * must drain it with further reads before waiting for the socket again.
+ */
+int dtls1_read_pending(const SSL *s)
+{
+    if (pqueue_peek(s->rlayer.d->buffered_app_data.q) != NULL)
+        return 1;
+
+    return s->rbio != NULL && BIO_pending(s->rbio) > 0;
+}
+
 /*-
  * Return up to 'len' payload bytes received in 'type' records.
  * 'type' is one of the following:
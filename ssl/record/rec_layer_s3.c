@@ -55,6 +55,8 @@ void RECORD_LAYER_clear(RECORD_LAYER *rl)
     rl->wpend_type = 0;
     rl->wpend_ret = 0;
     rl->wpend_buf = NULL;
+    rl->cbuf_len = 0;
+    rl->cbuf_flushing = 0;
 
     SSL3_BUFFER_clear(&rl->rbuf);
     ssl3_release_write_buffer(rl->s);
@@ -75,6 +77,9 @@ void RECORD_LAYER_release(RECORD_LAYER *rl)
     if (rl->numwpipes > 0)
         ssl3_release_write_buffer(rl->s);
     SSL3_RECORD_release(rl->rrec, SSL_MAX_PIPELINES);
+    OPENSSL_free(rl->cbuf);
+    rl->cbuf = NULL;
+    rl->cbuf_len = 0;
 }
 
 /* Checks if we have unprocessed read ahead data pending */
@@ -95,6 +100,69 @@ int RECORD_LAYER_processed_read_pending(const RECORD_LAYER *rl)
     return curr_rec < num_recs;
 }
 
+/*
+ * Returns the application data record which has been peeked at last, i.e. the
+ * first record that has not been fully read, or NULL if there is none.
+ */
+static SSL3_RECORD *ssl3_get_unread_record(SSL *s)
+{
+    size_t curr_rec = 0, num_recs = RECORD_LAYER_get_numrpipes(&s->rlayer);
+    SSL3_RECORD *rr = s->rlayer.rrec;
+
+    while (curr_rec < num_recs && SSL3_RECORD_is_read(&rr[curr_rec]))
+        curr_rec++;
+
+    if (curr_rec == num_recs
+            || SSL3_RECORD_get_type(&rr[curr_rec]) != SSL3_RT_APPLICATION_DATA
+            || SSL3_RECORD_get_length(&rr[curr_rec]) == 0)
+        return NULL;
+
+    return &rr[curr_rec];
+}
+
+/*
+ * Point |*data| at the unread plaintext of the current application data record
+ * without copying it. Only valid directly after a successful peek.
+ */
+int ssl3_get0_read_data(SSL *s, const unsigned char **data, size_t *len)
+{
+    SSL3_RECORD *rr = ssl3_get_unread_record(s);
+
+    if (rr == NULL)
+        return 0;
+
+    *data = &(SSL3_RECORD_get_data(rr)[SSL3_RECORD_get_off(rr)]);
+    *len = SSL3_RECORD_get_length(rr);
+    return 1;
+}
+
+/*
+ * Mark |len| bytes of the data returned by ssl3_get0_read_data() as read. This
+ * mirrors what ssl3_read_bytes() does after copying the data out.
+ */
+int ssl3_release_read_data(SSL *s, size_t len)
+{
+    SSL3_RECORD *rr = ssl3_get_unread_record(s);
+
+    if (rr == NULL || len > SSL3_RECORD_get_length(rr))
+        return 0;
+
+    SSL3_RECORD_sub_length(rr, len);
+    SSL3_RECORD_add_off(rr, len);
+    if (SSL3_RECORD_get_length(rr) == 0) {
+        s->rlayer.rstate = SSL_ST_READ_HEADER;
+        SSL3_RECORD_set_off(rr, 0);
+        SSL3_RECORD_set_read(rr);
+    }
+
+    if (!RECORD_LAYER_processed_read_pending(&s->rlayer)
+            && (s->mode & SSL_MODE_RELEASE_BUFFERS)
+            && SSL3_BUFFER_get_left(&s->rlayer.rbuf) == 0)
+        ssl3_release_read_buffer(s);
+
+    return 1;
+}
+
 int RECORD_LAYER_write_pending(const RECORD_LAYER *rl)
 {
     return (rl->numwpipes > 0)
@@ -328,6 +396,99 @@ int ssl3_read_n(SSL *s, size_t n, size_t max, int extend, int clearold,
     return 1;
 }
 
+/*
+ * Write application data with SSL_MODE_COALESCE_WRITES. Small writes are
+ * copied to |cbuf| and only sent once the next write would exceed the
+ * coalescing threshold, or on ssl3_write_flush(). Writes of at least the
+ * threshold are sent straight away, after anything collected before them.
+ * Nothing of |buf| is consumed if sending the collected data fails, so the
+ * usual SSL_write() retry rules apply.
+ */
+int ssl3_write_coalesce(SSL *s, const void *buf, size_t len, size_t *written)
+{
+    RECORD_LAYER *rl = &s->rlayer;
+    size_t limit;
+    int direct, ret;
+
+    limit = s->max_send_fragment;
+    if (s->write_coalesce_threshold != 0
+            && s->write_coalesce_threshold < limit)
+        limit = s->write_coalesce_threshold;
+
+    direct = (s->mode & SSL_MODE_COALESCE_WRITES) == 0 || SSL_IS_DTLS(s)
+             || !SSL_is_init_finished(s) || len >= limit;
+
+    if (direct || rl->cbuf_flushing || rl->cbuf_len + len > limit) {
+        ret = ssl3_write_flush(s);
+        if (ret <= 0)
+            return ret;
+    }
+    if (direct)
+        return s->method->ssl_write_bytes(s, SSL3_RT_APPLICATION_DATA, buf,
+                                          len, written);
+
+    if (rl->cbuf == NULL) {
+        rl->cbuf = OPENSSL_malloc(SSL3_RT_MAX_PLAIN_LENGTH);
+        if (rl->cbuf == NULL) {
+            SSLerr(SSL_F_SSL3_WRITE_COALESCE, ERR_R_MALLOC_FAILURE);
+            return -1;
+        }
+    }
+    memcpy(rl->cbuf + rl->cbuf_len, buf, len);
+    rl->cbuf_len += len;
+    *written = len;
+    return 1;
+}
+
+/*
+ * Send the application data collected by ssl3_write_coalesce(). Returns 1 once
+ * all of it has been written, or <= 0 if the write needs to be retried or
+ * failed.
+ */
+int ssl3_write_flush(SSL *s)
+{
+    RECORD_LAYER *rl = &s->rlayer;
+    size_t written;
+    int ret;
+
+    while (rl->cbuf_len > 0) {
+        ret = s->method->ssl_write_bytes(s, SSL3_RT_APPLICATION_DATA, rl->cbuf,
+                                         rl->cbuf_len, &written);
+        if (ret <= 0) {
+            rl->cbuf_flushing = 1;
+            return ret;
+        }
+        /* Only a part may have been sent with SSL_MODE_ENABLE_PARTIAL_WRITE */
+        rl->cbuf_len -= written;
+        memmove(rl->cbuf, rl->cbuf + written, rl->cbuf_len);
+    }
+    rl->cbuf_flushing = 0;
+
+    if ((s->mode & SSL_MODE_RELEASE_BUFFERS) != 0) {
+        OPENSSL_free(rl->cbuf);
+        rl->cbuf = NULL;
+    }
+    return 1;
+}
+
+/*
+ * Return 1 if several application data records can be packed into one write
+ * buffer, see do_ssl3_write(). This is the case for AEAD ciphers without
+ * pipelining support, whose records only grow by a fixed amount when
+ * encrypted.
+ */
+static int ssl3_write_can_pack(SSL *s)
+{
+    unsigned long flags;
+
+    if (SSL_IS_DTLS(s) || s->compress != NULL || s->enc_write_ctx == NULL)
+        return 0;
+
+    flags = EVP_CIPHER_flags(EVP_CIPHER_CTX_cipher(s->enc_write_ctx));
+    return (flags & EVP_CIPH_FLAG_AEAD_CIPHER) != 0
+           && (flags & EVP_CIPH_FLAG_PIPELINE) == 0;
+}
+
 /*
  * Call this to write data in records of type 'type' It will return <= 0 if
  * not all data has been sent or non-blocking IO.
@@ -552,6 +713,15 @@ int ssl3_write_bytes(SSL *s, int type, const void *buf_, size_t len,
              & EVP_CIPH_FLAG_PIPELINE)
         || !SSL_USE_EXPLICIT_IV(s))
         maxpipes = 1;
+    /*
+     * With SSL_MODE_PACK_RECORDS large writes with AEAD ciphers are sent in
+     * packs of 4 or 8 records, which do_ssl3_write() encrypts back to back
+     * into a single buffer so that they go out with one write.
+     */
+    if (maxpipes == 1 && (s->mode & SSL_MODE_PACK_RECORDS) != 0
+            && type == SSL3_RT_APPLICATION_DATA
+            && n >= 4 * s->max_send_fragment && ssl3_write_can_pack(s))
+        maxpipes = n >= 8 * s->max_send_fragment ? 8 : 4;
     if (s->max_send_fragment == 0 || split_send_fragment > s->max_send_fragment
         || split_send_fragment == 0) {
         /*
@@ -622,6 +792,66 @@ int ssl3_write_bytes(SSL *s, int type, const void *buf_, size_t len,
     }
 }
 
+/* Encrypt the |n_recs| records in |wr| */
+static int do_ssl3_enc(SSL *s, SSL3_RECORD *wr, size_t n_recs)
+{
+    if (s->early_data_state == SSL_EARLY_DATA_WRITING) {
+        /*
+         * We haven't actually negotiated the version yet, but we're trying to
+         * send early data - so we need to use the the tls13enc function.
+         */
+        return tls13_enc(s, wr, n_recs, 1);
+    }
+    return s->method->ssl3_enc->enc(s, wr, n_recs, 1);
+}
+
+/*
+ * Complete the encrypted record |wr| in the current sub-packet of |pkt|: add
+ * the encryption overhead and any encrypt-then-MAC MAC, then close the
+ * sub-packet holding the record length. Returns 1 on success, 0 on error.
+ */
+static int ssl3_finish_record(SSL *s, WPACKET *pkt, SSL3_RECORD *wr, int type,
+                              int mac_size)
+{
+    size_t origlen, len;
+
+    /* Allocate bytes for the encryption overhead */
+    if (!WPACKET_get_length(pkt, &origlen)
+               /* Encryption should never shrink the data! */
+            || origlen > wr->length
+            || (wr->length > origlen
+                && !WPACKET_allocate_bytes(pkt, wr->length - origlen, NULL)))
+        return 0;
+    if (SSL_WRITE_ETM(s) && mac_size != 0) {
+        unsigned char *mac;
+
+        if (!WPACKET_allocate_bytes(pkt, mac_size, &mac)
+                || !s->method->ssl3_enc->mac(s, wr, mac, 1))
+            return 0;
+        SSL3_RECORD_add_length(wr, mac_size);
+    }
+
+    if (!WPACKET_get_length(pkt, &len)
+            || !WPACKET_close(pkt))
+        return 0;
+
+    if (s->msg_callback) {
+        unsigned char *recordstart = WPACKET_get_curr(pkt) - len
+                                     - SSL3_RT_HEADER_LENGTH;
+
+        s->msg_callback(1, 0, SSL3_RT_HEADER, recordstart,
+                        SSL3_RT_HEADER_LENGTH, s, s->msg_callback_arg);
+    }
+
+    /*
+     * we should now have wr->data pointing to the encrypted data, which is
+     * wr->length long
+     */
+    SSL3_RECORD_set_type(wr, type); /* not needed but helps for debugging */
+    SSL3_RECORD_add_length(wr, SSL3_RT_HEADER_LENGTH);
+    return 1;
+}
+
 int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
                   size_t *pipelens, size_t numpipes,
                   int create_empty_fragment, size_t *written)
@@ -637,8 +867,9 @@ int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
     size_t align = 0;
     SSL3_BUFFER *wb;
     SSL_SESSION *sess;
-    size_t totlen = 0, len, wpinited = 0;
+    size_t totlen = 0, len, wpinited = 0, numpkts;
     size_t j;
+    int packed;
 
     for (j = 0; j < numpipes; j++)
         totlen += pipelens[j];
@@ -657,9 +888,31 @@ int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
         /* if it went, fall through and send more stuff */
     }
 
-    if (s->rlayer.numwpipes < numpipes)
+    /*
+     * Several records for a cipher without pipelining support are packed:
+     * each one is encrypted as soon as it has been built and the next one is
+     * built right behind it in the first write buffer.
+     */
+    packed = numpipes > 1 && s->enc_write_ctx != NULL
+             && !(EVP_CIPHER_flags(EVP_CIPHER_CTX_cipher(s->enc_write_ctx))
+                  & EVP_CIPH_FLAG_PIPELINE);
+    numpkts = packed ? 1 : numpipes;
+
+    if (packed) {
+        size_t packlen = SSL3_ALIGN_PAYLOAD + numpipes
+            * (SSL3_RT_HEADER_LENGTH + s->max_send_fragment
+               + SSL3_RT_SEND_MAX_ENCRYPTED_OVERHEAD);
+
+        if (s->rlayer.numwpipes != 1
+                || SSL3_BUFFER_get_len(&s->rlayer.wbuf[0]) < packlen) {
+            ssl3_release_write_buffer(s);
+            if (!ssl3_setup_write_buffer(s, 1, packlen))
+                return -1;
+        }
+    } else if (s->rlayer.numwpipes < numpipes) {
         if (!ssl3_setup_write_buffer(s, numpipes, 0))
             return -1;
+    }
 
     if (totlen == 0 && !create_empty_fragment)
         return 0;
@@ -742,7 +995,7 @@ int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
         }
         wpinited = 1;
     } else {
-        for (j = 0; j < numpipes; j++) {
+        for (j = 0; j < numpkts; j++) {
             thispkt = &pkt[j];
 
             wb = &s->rlayer.wbuf[j];
@@ -786,7 +1039,7 @@ int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
         size_t maxcomplen;
         unsigned int rectype;
 
-        thispkt = &pkt[j];
+        thispkt = &pkt[packed ? 0 : j];
         thiswr = &wr[j];
 
         SSL3_RECORD_set_type(thiswr, type);
@@ -902,91 +1155,56 @@ int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
         SSL3_RECORD_set_data(thiswr, recordstart);
         SSL3_RECORD_reset_input(thiswr);
         SSL3_RECORD_set_length(thiswr, len);
-    }
 
-    if (s->early_data_state == SSL_EARLY_DATA_WRITING) {
-        /*
-         * We haven't actually negotiated the version yet, but we're trying to
-         * send early data - so we need to use the the tls13enc function.
-         */
-        if (tls13_enc(s, wr, numpipes, 1) < 1)
-            goto err;
-    } else {
-        if (s->method->ssl3_enc->enc(s, wr, numpipes, 1) < 1)
-            goto err;
-    }
-
-    for (j = 0; j < numpipes; j++) {
-        size_t origlen;
-
-        thispkt = &pkt[j];
-        thiswr = &wr[j];
-
-        /* Allocate bytes for the encryption overhead */
-        if (!WPACKET_get_length(thispkt, &origlen)
-                   /* Encryption should never shrink the data! */
-                || origlen > thiswr->length
-                || (thiswr->length > origlen
-                    && !WPACKET_allocate_bytes(thispkt,
-                                               thiswr->length - origlen, NULL))) {
-            SSLerr(SSL_F_DO_SSL3_WRITE, ERR_R_INTERNAL_ERROR);
-            goto err;
-        }
-        if (SSL_WRITE_ETM(s) && mac_size != 0) {
-            unsigned char *mac;
-
-            if (!WPACKET_allocate_bytes(thispkt, mac_size, &mac)
-                    || !s->method->ssl3_enc->mac(s, thiswr, mac, 1)) {
+        if (packed) {
+            if (do_ssl3_enc(s, thiswr, 1) < 1)
+                goto err;
+            if (!ssl3_finish_record(s, thispkt, thiswr, type, mac_size)) {
                 SSLerr(SSL_F_DO_SSL3_WRITE, ERR_R_INTERNAL_ERROR);
                 goto err;
             }
-            SSL3_RECORD_add_length(thiswr, mac_size);
         }
+    }
 
-        if (!WPACKET_get_length(thispkt, &len)
-                || !WPACKET_close(thispkt)) {
+    if (packed) {
+        if (!WPACKET_get_total_written(&pkt[0], &len)
+                || !WPACKET_finish(&pkt[0])) {
             SSLerr(SSL_F_DO_SSL3_WRITE, ERR_R_INTERNAL_ERROR);
             goto err;
         }
-
-        if (s->msg_callback) {
-            recordstart = WPACKET_get_curr(thispkt) - len
-                          - SSL3_RT_HEADER_LENGTH;
-            s->msg_callback(1, 0, SSL3_RT_HEADER, recordstart,
-                            SSL3_RT_HEADER_LENGTH, s,
-                            s->msg_callback_arg);
-        }
-
-        if (!WPACKET_finish(thispkt)) {
-            SSLerr(SSL_F_DO_SSL3_WRITE, ERR_R_INTERNAL_ERROR);
+        SSL3_BUFFER_set_left(&s->rlayer.wbuf[0], len - align);
+    } else {
+        if (do_ssl3_enc(s, wr, numpipes) < 1)
             goto err;
-        }
 
-        /*
-         * we should now have thiswr->data pointing to the encrypted data, which
-         * is thiswr->length long
-         */
-        SSL3_RECORD_set_type(thiswr, type); /* not needed but helps for
-                                             * debugging */
-        SSL3_RECORD_add_length(thiswr, SSL3_RT_HEADER_LENGTH);
+        for (j = 0; j < numpipes; j++) {
+            thispkt = &pkt[j];
+            thiswr = &wr[j];
 
-        if (create_empty_fragment) {
-            /*
-             * we are in a recursive call; just return the length, don't write
-             * out anything here
-             */
-            if (j > 0) {
-                /* We should never be pipelining an empty fragment!! */
+            if (!ssl3_finish_record(s, thispkt, thiswr, type, mac_size)
+                    || !WPACKET_finish(thispkt)) {
                 SSLerr(SSL_F_DO_SSL3_WRITE, ERR_R_INTERNAL_ERROR);
                 goto err;
             }
-            *written = SSL3_RECORD_get_length(thiswr);
-            return 1;
-        }
 
-        /* now let's set up wb */
-        SSL3_BUFFER_set_left(&s->rlayer.wbuf[j],
-                             prefix_len + SSL3_RECORD_get_length(thiswr));
+            if (create_empty_fragment) {
+                /*
+                 * we are in a recursive call; just return the length, don't
+                 * write out anything here
+                 */
+                if (j > 0) {
+                    /* We should never be pipelining an empty fragment!! */
+                    SSLerr(SSL_F_DO_SSL3_WRITE, ERR_R_INTERNAL_ERROR);
+                    goto err;
+                }
+                *written = SSL3_RECORD_get_length(thiswr);
+                return 1;
+            }
+
+            /* now let's set up wb */
+            SSL3_BUFFER_set_left(&s->rlayer.wbuf[j],
+                                 prefix_len + SSL3_RECORD_get_length(thiswr));
+        }
     }
 
     /*
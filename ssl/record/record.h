@@ -27,6 +27,22 @@ typedef struct ssl3_buffer_st {
     size_t left;
 } SSL3_BUFFER;
 
+/*
+ * A list of released record buffers of a single size, used to share buffers
+ * between the SSL objects of an SSL_CTX. See ssl3_buffer.c
+ */
+typedef struct ssl3_buf_freelist_entry_st {
+    struct ssl3_buf_freelist_entry_st *next;
+} SSL3_BUF_FREELIST_ENTRY;
+
+typedef struct ssl3_buf_freelist_st {
+    /* size of the buffers in the list, 0 if the list is empty */
+    size_t chunklen;
+    /* number of buffers in the list */
+    size_t len;
+    SSL3_BUF_FREELIST_ENTRY *head;
+} SSL3_BUF_FREELIST;
+
 #define SEQ_NUM_SIZE                            8
 
 typedef struct ssl3_record_st {
@@ -180,6 +196,11 @@ typedef struct record_layer_st {
     unsigned int is_first_record;
     /* Count of the number of consecutive warning alerts received */
     unsigned int alert_count;
+    /* application data held back by SSL_MODE_COALESCE_WRITES */
+    unsigned char *cbuf;
+    size_t cbuf_len;
+    /* set if sending |cbuf| did not complete and must be retried */
+    int cbuf_flushing;
     DTLS_RECORD_LAYER *d;
 } RECORD_LAYER;
 
@@ -194,6 +215,7 @@ typedef struct record_layer_st {
 
 #define RECORD_LAYER_set_read_ahead(rl, ra)     ((rl)->read_ahead = (ra))
 #define RECORD_LAYER_get_read_ahead(rl)         ((rl)->read_ahead)
+#define RECORD_LAYER_get_coalesced_len(rl)      ((rl)->cbuf_len)
 #define RECORD_LAYER_get_packet(rl)             ((rl)->packet)
 #define RECORD_LAYER_get_packet_length(rl)      ((rl)->packet_length)
 #define RECORD_LAYER_add_packet_length(rl, inc) ((rl)->packet_length += (inc))
@@ -214,6 +236,9 @@ void RECORD_LAYER_reset_write_sequence(RECORD_LAYER *rl);
 int RECORD_LAYER_is_sslv2_record(RECORD_LAYER *rl);
 size_t RECORD_LAYER_get_rrec_length(RECORD_LAYER *rl);
 __owur size_t ssl3_pending(const SSL *s);
+__owur int ssl3_write_coalesce(SSL *s, const void *buf, size_t len,
+                               size_t *written);
+__owur int ssl3_write_flush(SSL *s);
 __owur int ssl3_write_bytes(SSL *s, int type, const void *buf, size_t len,
                             size_t *written);
 int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
@@ -222,7 +247,11 @@ int do_ssl3_write(SSL *s, int type, const unsigned char *buf,
 __owur int ssl3_read_bytes(SSL *s, int type, int *recvd_type,
                            unsigned char *buf, size_t len, int peek,
                            size_t *readbytes);
+__owur int ssl3_get0_read_data(SSL *s, const unsigned char **data,
+                               size_t *len);
+__owur int ssl3_release_read_data(SSL *s, size_t len);
 __owur int ssl3_setup_buffers(SSL *s);
+void ssl3_buf_freelist_trim(SSL3_BUF_FREELIST *list, size_t max);
 __owur int ssl3_enc(SSL *s, SSL3_RECORD *inrecs, size_t n_recs, int send);
 __owur int n_ssl3_mac(SSL *ssl, SSL3_RECORD *rec, unsigned char *md, int send);
 __owur int ssl3_write_pending(SSL *s, int type, const unsigned char *buf, size_t len,
@@ -244,3 +273,4 @@ __owur int dtls1_write_bytes(SSL *s, int type, const void *buf, size_t len,
 int do_dtls1_write(SSL *s, int type, const unsigned char *buf,
                    size_t len, int create_empty_fragment, size_t *written);
 void dtls1_reset_seq_numbers(SSL *s, int rw);
+int dtls1_read_pending(const SSL *s);
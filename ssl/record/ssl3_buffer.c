@@ -34,6 +34,87 @@ void SSL3_BUFFER_release(SSL3_BUFFER *b)
     b->buf = NULL;
 }
 
+/*
+ * Record buffers released by an SSL object are kept on a freelist in its
+ * SSL_CTX, up to SSL_CTX_set_buffer_pool_size() buffers for reading and as
+ * many for writing, and handed out again to the next SSL object of that
+ * SSL_CTX that needs a buffer of the same size. Each list only holds buffers
+ * of one size: the size of the first buffer inserted into an empty list.
+ */
+static unsigned char *freelist_extract(SSL_CTX *ctx, int for_read, size_t sz)
+{
+    SSL3_BUF_FREELIST *list;
+    SSL3_BUF_FREELIST_ENTRY *ent = NULL;
+
+    if (ctx->buf_freelist_max_len == 0)
+        return OPENSSL_malloc(sz);
+
+    CRYPTO_THREAD_write_lock(ctx->buf_freelist_lock);
+    list = for_read ? &ctx->rbuf_freelist : &ctx->wbuf_freelist;
+    if (sz == list->chunklen)
+        ent = list->head;
+    if (ent != NULL) {
+        list->head = ent->next;
+        if (--list->len == 0)
+            list->chunklen = 0;
+        ctx->buf_freelist_hits++;
+    } else {
+        ctx->buf_freelist_misses++;
+    }
+    CRYPTO_THREAD_unlock(ctx->buf_freelist_lock);
+
+    if (ent == NULL)
+        return OPENSSL_malloc(sz);
+    return (unsigned char *)ent;
+}
+
+static void freelist_insert(SSL_CTX *ctx, int for_read, size_t sz,
+                            unsigned char *mem)
+{
+    SSL3_BUF_FREELIST *list;
+    SSL3_BUF_FREELIST_ENTRY *ent;
+
+    if (mem == NULL)
+        return;
+    if (ctx->buf_freelist_max_len == 0 || sz < sizeof(*ent)) {
+        OPENSSL_free(mem);
+        return;
+    }
+
+    CRYPTO_THREAD_write_lock(ctx->buf_freelist_lock);
+    list = for_read ? &ctx->rbuf_freelist : &ctx->wbuf_freelist;
+    if ((sz == list->chunklen || list->chunklen == 0)
+            && list->len < ctx->buf_freelist_max_len) {
+        list->chunklen = sz;
+        ent = (SSL3_BUF_FREELIST_ENTRY *)mem;
+        ent->next = list->head;
+        list->head = ent;
+        list->len++;
+        mem = NULL;
+    }
+    CRYPTO_THREAD_unlock(ctx->buf_freelist_lock);
+
+    OPENSSL_free(mem);
+}
+
+/*
+ * Free buffers from |list| until at most |max| are left. The caller must hold
+ * the lock protecting the list, if any.
+ */
+void ssl3_buf_freelist_trim(SSL3_BUF_FREELIST *list, size_t max)
+{
+    SSL3_BUF_FREELIST_ENTRY *ent;
+
+    while (list->len > max) {
+        ent = list->head;
+        list->head = ent->next;
+        list->len--;
+        OPENSSL_free(ent);
+    }
+    if (list->len == 0)
+        list->chunklen = 0;
+}
+
 int ssl3_setup_read_buffer(SSL *s)
 {
     unsigned char *p;
@@ -60,7 +141,7 @@ int ssl3_setup_read_buffer(SSL *s)
 #endif
         if (b->default_len > len)
             len = b->default_len;
-        if ((p = OPENSSL_malloc(len)) == NULL)
+        if ((p = freelist_extract(s->ctx, 1, len)) == NULL)
             goto err;
         b->buf = p;
         b->len = len;
@@ -108,7 +189,7 @@ int ssl3_setup_write_buffer(SSL *s, size_t numwpipes, size_t len)
         SSL3_BUFFER *thiswb = &wb[currpipe];
 
         if (thiswb->buf == NULL) {
-            p = OPENSSL_malloc(len);
+            p = freelist_extract(s->ctx, 0, len);
             if (p == NULL) {
                 s->rlayer.numwpipes = currpipe;
                 goto err;
@@ -144,7 +225,7 @@ int ssl3_release_write_buffer(SSL *s)
     while (pipes > 0) {
         wb = &RECORD_LAYER_get_wbuf(&s->rlayer)[pipes - 1];
 
-        OPENSSL_free(wb->buf);
+        freelist_insert(s->ctx, 0, wb->len, wb->buf);
         wb->buf = NULL;
         pipes--;
     }
@@ -157,7 +238,7 @@ int ssl3_release_read_buffer(SSL *s)
     SSL3_BUFFER *b;
 
     b = RECORD_LAYER_get_rbuf(&s->rlayer);
-    OPENSSL_free(b->buf);
+    freelist_insert(s->ctx, 1, b->len, b->buf);
     b->buf = NULL;
     return 1;
 }
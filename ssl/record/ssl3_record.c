@@ -144,6 +144,29 @@ int early_data_count_ok(SSL *s, size_t length, size_t overhead, int *al)
 #define MAX_EMPTY_RECORDS 32
 
 #define SSL2_RT_HEADER_LENGTH   2
+/*
+ * Return 1 if several application data records may be decrypted with a single
+ * call to the enc method, 0 otherwise. This requires an explicit IV and either
+ * a cipher supporting pipelining, or a TLSv1.2 AEAD cipher whose records
+ * tls1_enc() decrypts one after the other. TLSv1.3 is excluded because the
+ * inner content type of a record, which is only known after decryption, may
+ * change the keys for the records following it.
+ */
+static int ssl3_record_read_pipelining(SSL *s)
+{
+    unsigned long flags;
+
+    if (!SSL_USE_EXPLICIT_IV(s) || s->enc_read_ctx == NULL)
+        return 0;
+
+    flags = EVP_CIPHER_flags(EVP_CIPHER_CTX_cipher(s->enc_read_ctx));
+    if ((flags & EVP_CIPH_FLAG_PIPELINE) != 0)
+        return 1;
+
+    return (flags & EVP_CIPH_FLAG_AEAD_CIPHER) != 0
+           && !SSL_IS_DTLS(s) && !SSL_IS_TLS13(s);
+}
+
 /*-
  * Call this to get new input records.
  * It will return <= 0 if more data is needed, normally due to an error
@@ -427,10 +450,7 @@ int ssl3_get_record(SSL *s)
         RECORD_LAYER_clear_first_record(&s->rlayer);
     } while (num_recs < max_recs
              && thisrr->type == SSL3_RT_APPLICATION_DATA
-             && SSL_USE_EXPLICIT_IV(s)
-             && s->enc_read_ctx != NULL
-             && (EVP_CIPHER_flags(EVP_CIPHER_CTX_cipher(s->enc_read_ctx))
-                 & EVP_CIPH_FLAG_PIPELINE)
+             && ssl3_record_read_pipelining(s)
              && ssl3_record_app_data_waiting(s));
 
     /*
@@ -902,11 +922,22 @@ int tls1_enc(SSL *s, SSL3_RECORD *recs, size_t n_recs, int send)
             if (!(EVP_CIPHER_flags(EVP_CIPHER_CTX_cipher(ds))
                   & EVP_CIPH_FLAG_PIPELINE)) {
                 /*
-                 * We shouldn't have been called with pipeline data if the
-                 * cipher doesn't support pipelining
+                 * AEAD records are authenticated and decrypted independently
+                 * of each other, so without pipelining support in the cipher
+                 * just process them one by one. We shouldn't have been called
+                 * with pipeline data for any other cipher.
                  */
-                SSLerr(SSL_F_TLS1_ENC, SSL_R_PIPELINE_FAILURE);
-                return -1;
+                if (!(EVP_CIPHER_flags(EVP_CIPHER_CTX_cipher(ds))
+                      & EVP_CIPH_FLAG_AEAD_CIPHER)) {
+                    SSLerr(SSL_F_TLS1_ENC, SSL_R_PIPELINE_FAILURE);
+                    return -1;
+                }
+                for (ctr = 0; ctr < n_recs; ctr++) {
+                    ret = tls1_enc(s, &recs[ctr], 1, send);
+                    if (ret != 1)
+                        return ret;
+                }
+                return 1;
             }
         }
         for (ctr = 0; ctr < n_recs; ctr++) {
@@ -3395,6 +3395,7 @@ long ssl3_ctx_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
                 SSLerr(SSL_F_SSL3_CTX_CTRL, SSL_R_INVALID_TICKET_KEYS_LENGTH);
                 return 0;
             }
+            CRYPTO_THREAD_write_lock(ctx->ext.tick_lock);
             if (cmd == SSL_CTRL_SET_TLSEXT_TICKET_KEYS) {
                 memcpy(ctx->ext.tick_key_name, keys,
                        sizeof(ctx->ext.tick_key_name));
@@ -3416,9 +3417,19 @@ long ssl3_ctx_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
                        ctx->ext.tick_aes_key,
                        sizeof(ctx->ext.tick_aes_key));
             }
+            CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
             return 1;
         }
 
+    case SSL_CTRL_SET_TICKET_KEY_RING_SIZE:
+        if (larg < 0)
+            return 0;
+        tls_set_ticket_key_ring_size(ctx, (size_t)larg);
+        return 1;
+
+    case SSL_CTRL_GET_TICKET_KEY_RING_SIZE:
+        return (long)ctx->ext.tick_keys_max;
+
     case SSL_CTRL_GET_TLSEXT_STATUS_REQ_TYPE:
         return ctx->ext.status_type;
 
@@ -3853,6 +3864,10 @@ int ssl3_shutdown(SSL *s)
     }
 
     if (!(s->shutdown & SSL_SENT_SHUTDOWN)) {
+        /* Send any data held back by SSL_MODE_COALESCE_WRITES first */
+        ret = ssl3_write_flush(s);
+        if (ret <= 0)
+            return ret;
         s->shutdown |= SSL_SENT_SHUTDOWN;
         ssl3_send_alert(s, SSL3_AL_WARNING, SSL_AD_CLOSE_NOTIFY);
         /*
@@ -3896,6 +3911,10 @@ int ssl3_write(SSL *s, const void *buf, size_t len, size_t *written)
     if (s->s3->renegotiate)
         ssl3_renegotiate_check(s, 0);
 
+    if ((s->mode & SSL_MODE_COALESCE_WRITES) != 0
+            || RECORD_LAYER_get_coalesced_len(&s->rlayer) != 0)
+        return ssl3_write_coalesce(s, buf, len, written);
+
     return s->method->ssl_write_bytes(s, SSL3_RT_APPLICATION_DATA, buf, len,
                                       written);
 }
@@ -152,6 +152,11 @@ static void ssl_library_stop(void)
 # endif
         ssl_comp_free_compression_methods_int();
 #endif
+#ifdef OPENSSL_INIT_DEBUG
+        fprintf(stderr, "OPENSSL_INIT: ssl_library_stop: "
+                "ssl_client_cache_cleanup_int()\n");
+#endif
+        ssl_client_cache_cleanup_int();
     }
 
     if (ssl_strings_inited) {
@@ -106,6 +106,7 @@ static const struct {
 };
 
 static int ssl_write_early_finish(SSL *s);
+static int ssl_ctx_set_sess_shards(SSL_CTX *ctx, size_t num);
 
 static int dane_ctx_enable(struct dane_ctx_st *dctx)
 {
@@ -586,6 +587,7 @@ SSL *SSL_new(SSL_CTX *ctx)
     s->quiet_shutdown = ctx->quiet_shutdown;
     s->max_send_fragment = ctx->max_send_fragment;
     s->split_send_fragment = ctx->split_send_fragment;
+    s->write_coalesce_threshold = ctx->write_coalesce_threshold;
     s->max_pipelines = ctx->max_pipelines;
     if (s->max_pipelines > 1)
         RECORD_LAYER_set_read_ahead(&s->rlayer, 1);
@@ -749,6 +751,7 @@ int SSL_has_matching_session_id(const SSL *ssl, const unsigned char *id,
      * by this SSL.
      */
     SSL_SESSION r, *p;
+    SSL_SESS_SHARD *shard;
 
     if (id_len > sizeof r.session_id)
         return 0;
@@ -757,9 +760,10 @@ int SSL_has_matching_session_id(const SSL *ssl, const unsigned char *id,
     r.session_id_length = id_len;
     memcpy(r.session_id, id, id_len);
 
-    CRYPTO_THREAD_read_lock(ssl->session_ctx->lock);
-    p = lh_SSL_SESSION_retrieve(ssl->session_ctx->sessions, &r);
-    CRYPTO_THREAD_unlock(ssl->session_ctx->lock);
+    shard = ssl_session_get_shard(ssl->session_ctx, &r);
+    CRYPTO_THREAD_read_lock(shard->lock);
+    p = lh_SSL_SESSION_retrieve(shard->sessions, &r);
+    CRYPTO_THREAD_unlock(shard->lock);
     return (p != NULL);
 }
 
@@ -1002,6 +1006,7 @@ void SSL_free(SSL *s)
     /* Free up if allocated */
 
     OPENSSL_free(s->ext.hostname);
+    OPENSSL_free(s->cache_host);
     SSL_CTX_free(s->session_ctx);
 #ifndef OPENSSL_NO_EC
     OPENSSL_free(s->ext.ecpointformats);
@@ -1326,6 +1331,9 @@ int SSL_has_pending(const SSL *s)
     if (RECORD_LAYER_processed_read_pending(&s->rlayer))
         return 1;
 
+    if (SSL_IS_DTLS(s) && dtls1_read_pending(s))
+        return 1;
+
     return RECORD_LAYER_read_pending(&s->rlayer);
 }
 
@@ -1740,6 +1748,45 @@ int SSL_peek_ex(SSL *s, void *buf, size_t num, size_t *readbytes)
     return ret;
 }
 
+int SSL_get0_read_data(SSL *s, const unsigned char **data, size_t *len)
+{
+    unsigned char c;
+    size_t readbytes;
+
+    if (SSL_IS_DTLS(s)) {
+        SSLerr(SSL_F_SSL_GET0_READ_DATA, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+        return 0;
+    }
+
+    /*
+     * Peeking at a single byte takes care of any handshake, alert or empty
+     * record processing and leaves us with a decrypted application data
+     * record that we can hand out a pointer into.
+     */
+    if (ssl_peek_internal(s, &c, 1, &readbytes) <= 0)
+        return 0;
+
+    if (!ssl3_get0_read_data(s, data, len)) {
+        SSLerr(SSL_F_SSL_GET0_READ_DATA, ERR_R_INTERNAL_ERROR);
+        return 0;
+    }
+    return 1;
+}
+
+int SSL_release_read_data(SSL *s, size_t len)
+{
+    if (SSL_IS_DTLS(s)) {
+        SSLerr(SSL_F_SSL_RELEASE_READ_DATA, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+        return 0;
+    }
+
+    if (!ssl3_release_read_data(s, len)) {
+        SSLerr(SSL_F_SSL_RELEASE_READ_DATA, SSL_R_BAD_LENGTH);
+        return 0;
+    }
+    return 1;
+}
+
 int ssl_write_internal(SSL *s, const void *buf, size_t num, size_t *written)
 {
     if (s->handshake_func == NULL) {
@@ -1818,6 +1865,29 @@ int SSL_write_ex(SSL *s, const void *buf, size_t num, size_t *written)
     return ret;
 }
 
+int SSL_flush(SSL *s)
+{
+    int ret;
+
+    if (s->handshake_func == NULL) {
+        SSLerr(SSL_F_SSL_FLUSH, SSL_R_UNINITIALIZED);
+        return -1;
+    }
+
+    clear_sys_error();
+    s->rwstate = SSL_NOTHING;
+    ret = ssl3_write_flush(s);
+    if (ret <= 0 || s->wbio == NULL)
+        return ret;
+
+    /* Also send anything the BIO holds back, e.g. batched datagrams */
+    s->rwstate = SSL_WRITING;
+    if (BIO_flush(s->wbio) <= 0)
+        return -1;
+    s->rwstate = SSL_NOTHING;
+    return 1;
+}
+
 int SSL_write_early_data(SSL *s, const void *buf, size_t num, size_t *written)
 {
     int ret;
@@ -2038,6 +2108,11 @@ long SSL_ctrl(SSL *s, int cmd, long larg, void *parg)
         if (larg > 1)
             RECORD_LAYER_set_read_ahead(&s->rlayer, 1);
         return 1;
+    case SSL_CTRL_SET_WRITE_COALESCE_THRESHOLD:
+        if (larg < 0 || larg > SSL3_RT_MAX_PLAIN_LENGTH)
+            return 0;
+        s->write_coalesce_threshold = larg;
+        return 1;
     case SSL_CTRL_GET_RI_SUPPORT:
         if (s->s3)
             return s->s3->send_connection_binding;
@@ -2092,7 +2167,30 @@ long SSL_callback_ctrl(SSL *s, int cmd, void (*fp) (void))
 
 LHASH_OF(SSL_SESSION) *SSL_CTX_sessions(SSL_CTX *ctx)
 {
-    return ctx->sessions;
+    /* There is no single hash table if the cache is sharded */
+    if (ctx->sess_num_shards != 1)
+        return NULL;
+    return ctx->sess_shards[0].sessions;
+}
+
+static unsigned long ssl_ctx_sess_number(const SSL_CTX *ctx)
+{
+    unsigned long num = 0;
+    size_t i;
+
+    for (i = 0; i < ctx->sess_num_shards; i++)
+        num += lh_SSL_SESSION_num_items(ctx->sess_shards[i].sessions);
+    return num;
+}
+
+static int ssl_ctx_sess_cache_full(const SSL_CTX *ctx)
+{
+    int num = 0;
+    size_t i;
+
+    for (i = 0; i < ctx->sess_num_shards; i++)
+        num += ctx->sess_shards[i].sess_cache_full;
+    return num;
 }
 
 long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
@@ -2144,13 +2242,22 @@ long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
         return (long)(ctx->session_cache_size);
     case SSL_CTRL_SET_SESS_CACHE_MODE:
         l = ctx->session_cache_mode;
+        if ((larg & SSL_SESS_CACHE_CLIENT_AUTO) != 0
+                && !ssl_client_cache_new(ctx))
+            return 0;
         ctx->session_cache_mode = larg;
         return (l);
     case SSL_CTRL_GET_SESS_CACHE_MODE:
         return (ctx->session_cache_mode);
+    case SSL_CTRL_SET_SESS_CACHE_SHARDS:
+        if (larg < 1 || larg > SSL_MAX_SESS_CACHE_SHARDS)
+            return 0;
+        return ssl_ctx_set_sess_shards(ctx, (size_t)larg);
+    case SSL_CTRL_GET_SESS_CACHE_SHARDS:
+        return (long)ctx->sess_num_shards;
 
     case SSL_CTRL_SESS_NUMBER:
-        return (lh_SSL_SESSION_num_items(ctx->sessions));
+        return (long)ssl_ctx_sess_number(ctx);
     case SSL_CTRL_SESS_CONNECT:
         return (ctx->stats.sess_connect);
     case SSL_CTRL_SESS_CONNECT_GOOD:
@@ -2172,7 +2279,7 @@ long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
     case SSL_CTRL_SESS_TIMEOUTS:
         return (ctx->stats.sess_timeout);
     case SSL_CTRL_SESS_CACHE_FULL:
-        return (ctx->stats.sess_cache_full);
+        return ssl_ctx_sess_cache_full(ctx);
     case SSL_CTRL_MODE:
         return (ctx->mode |= larg);
     case SSL_CTRL_CLEAR_MODE:
@@ -2194,6 +2301,27 @@ long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
             return 0;
         ctx->max_pipelines = larg;
         return 1;
+    case SSL_CTRL_SET_WRITE_COALESCE_THRESHOLD:
+        if (larg < 0 || larg > SSL3_RT_MAX_PLAIN_LENGTH)
+            return 0;
+        ctx->write_coalesce_threshold = larg;
+        return 1;
+    case SSL_CTRL_SET_BUFFER_POOL_SIZE:
+        if (larg < 0)
+            return 0;
+        CRYPTO_THREAD_write_lock(ctx->buf_freelist_lock);
+        l = (long)ctx->buf_freelist_max_len;
+        ctx->buf_freelist_max_len = (size_t)larg;
+        ssl3_buf_freelist_trim(&ctx->rbuf_freelist, (size_t)larg);
+        ssl3_buf_freelist_trim(&ctx->wbuf_freelist, (size_t)larg);
+        CRYPTO_THREAD_unlock(ctx->buf_freelist_lock);
+        return l;
+    case SSL_CTRL_GET_BUFFER_POOL_SIZE:
+        return (long)ctx->buf_freelist_max_len;
+    case SSL_CTRL_BUFFER_POOL_HITS:
+        return ctx->buf_freelist_hits;
+    case SSL_CTRL_BUFFER_POOL_MISSES:
+        return ctx->buf_freelist_misses;
     case SSL_CTRL_CERT_FLAGS:
         return (ctx->cert->cert_flags |= larg);
     case SSL_CTRL_CLEAR_CERT_FLAGS:
@@ -2666,6 +2794,61 @@ static int ssl_session_cmp(const SSL_SESSION *a, const SSL_SESSION *b)
  * via ssl.h.
  */
 
+static void ssl_sess_shards_free(SSL_SESS_SHARD *shards, size_t num,
+                                 CRYPTO_RWLOCK *ctx_lock)
+{
+    size_t i;
+
+    if (shards == NULL)
+        return;
+    for (i = 0; i < num; i++) {
+        lh_SSL_SESSION_free(shards[i].sessions);
+        OPENSSL_free(shards[i].expire_heap);
+        if (shards[i].lock != ctx_lock)
+            CRYPTO_THREAD_lock_free(shards[i].lock);
+    }
+    OPENSSL_free(shards);
+}
+
+/*
+ * Replace the (empty) internal session cache of |ctx| with |num| shards. A
+ * single shard is protected by the SSL_CTX lock, otherwise every shard gets
+ * a lock of its own.
+ */
+static int ssl_ctx_set_sess_shards(SSL_CTX *ctx, size_t num)
+{
+    SSL_SESS_SHARD *shards;
+    size_t i;
+
+    if (ctx->sess_shards != NULL && ssl_ctx_sess_number(ctx) != 0) {
+        SSLerr(SSL_F_SSL_CTX_SET_SESS_SHARDS, SSL_R_SESSION_CACHE_NOT_EMPTY);
+        return 0;
+    }
+
+    shards = OPENSSL_zalloc(num * sizeof(*shards));
+    if (shards == NULL) {
+        SSLerr(SSL_F_SSL_CTX_SET_SESS_SHARDS, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    for (i = 0; i < num; i++) {
+        shards[i].lock = num == 1 ? ctx->lock : CRYPTO_THREAD_lock_new();
+        shards[i].sessions = lh_SSL_SESSION_new(ssl_session_hash,
+                                                ssl_session_cmp);
+        if (shards[i].lock == NULL || shards[i].sessions == NULL) {
+            ssl_sess_shards_free(shards, i + 1, ctx->lock);
+            SSLerr(SSL_F_SSL_CTX_SET_SESS_SHARDS, ERR_R_MALLOC_FAILURE);
+            return 0;
+        }
+    }
+
+    /* Keep the cache full statistics across the change */
+    shards[0].sess_cache_full = ssl_ctx_sess_cache_full(ctx);
+    ssl_sess_shards_free(ctx->sess_shards, ctx->sess_num_shards, ctx->lock);
+    ctx->sess_shards = shards;
+    ctx->sess_num_shards = num;
+    return 1;
+}
+
 SSL_CTX *SSL_CTX_new(const SSL_METHOD *meth)
 {
     SSL_CTX *ret = NULL;
@@ -2700,13 +2883,15 @@ SSL_CTX *SSL_CTX_new(const SSL_METHOD *meth)
         OPENSSL_free(ret);
         return NULL;
     }
+    ret->buf_freelist_lock = CRYPTO_THREAD_lock_new();
+    if (ret->buf_freelist_lock == NULL)
+        goto err;
     ret->max_cert_list = SSL_MAX_CERT_LIST_DEFAULT;
     ret->verify_mode = SSL_VERIFY_NONE;
     if ((ret->cert = ssl_cert_new()) == NULL)
         goto err;
 
-    ret->sessions = lh_SSL_SESSION_new(ssl_session_hash, ssl_session_cmp);
-    if (ret->sessions == NULL)
+    if (!ssl_ctx_set_sess_shards(ret, 1))
         goto err;
     ret->cert_store = X509_STORE_new();
     if (ret->cert_store == NULL)
@@ -2751,6 +2936,10 @@ SSL_CTX *SSL_CTX_new(const SSL_METHOD *meth)
     ret->split_send_fragment = SSL3_RT_MAX_PLAIN_LENGTH;
 
     /* Setup RFC5077 ticket keys */
+    ret->ext.tick_lock = CRYPTO_THREAD_lock_new();
+    if (ret->ext.tick_lock == NULL)
+        goto err;
+    ret->ext.tick_keys_max = SSL_TICKET_KEY_RING_SIZE_DEFAULT;
     if ((RAND_bytes(ret->ext.tick_key_name,
                     sizeof(ret->ext.tick_key_name)) <= 0)
         || (RAND_bytes(ret->ext.tick_hmac_key,
@@ -2847,11 +3036,12 @@ void SSL_CTX_free(SSL_CTX *a)
      * free ex_data, then finally free the cache.
      * (See ticket [openssl.org #212].)
      */
-    if (a->sessions != NULL)
+    if (a->sess_shards != NULL)
         SSL_CTX_flush_sessions(a, 0);
 
     CRYPTO_free_ex_data(CRYPTO_EX_INDEX_SSL_CTX, a, &a->ex_data);
-    lh_SSL_SESSION_free(a->sessions);
+    ssl_sess_shards_free(a->sess_shards, a->sess_num_shards, a->lock);
+    ssl_client_cache_free(a->client_cache);
     X509_STORE_free(a->cert_store);
 #ifndef OPENSSL_NO_CT
     CTLOG_STORE_free(a->ctlog_store);
@@ -2877,7 +3067,12 @@ void SSL_CTX_free(SSL_CTX *a)
     OPENSSL_free(a->ext.supportedgroups);
 #endif
     OPENSSL_free(a->ext.alpn);
+    tls_free_ticket_keys(a);
+    CRYPTO_THREAD_lock_free(a->ext.tick_lock);
 
+    ssl3_buf_freelist_trim(&a->rbuf_freelist, 0);
+    ssl3_buf_freelist_trim(&a->wbuf_freelist, 0);
+    CRYPTO_THREAD_lock_free(a->buf_freelist_lock);
     CRYPTO_THREAD_lock_free(a->lock);
 
     OPENSSL_free(a);
@@ -3094,6 +3289,9 @@ void ssl_update_cache(SSL *s, int mode)
         return;
 
     i = s->session_ctx->session_cache_mode;
+    if (mode == SSL_SESS_CACHE_CLIENT && (i & SSL_SESS_CACHE_CLIENT_AUTO))
+        ssl_client_cache_add(s);
+
     if ((i & mode) && (!s->hit)
         && ((i & SSL_SESS_CACHE_NO_INTERNAL_STORE)
             || SSL_CTX_add_session(s->session_ctx, s->session))
@@ -3103,12 +3301,16 @@ void ssl_update_cache(SSL *s, int mode)
             SSL_SESSION_free(s->session);
     }
 
-    /* auto flush every 255 connections */
+    /*
+     * auto expire every 255 connections, bounded so that a large cache does
+     * not cause a latency spike
+     */
     if ((!(i & SSL_SESS_CACHE_NO_AUTO_CLEAR)) && ((i & mode) == mode)) {
         if ((((mode & SSL_SESS_CACHE_CLIENT)
               ? s->session_ctx->stats.sess_connect_good
               : s->session_ctx->stats.sess_accept_good) & 0xff) == 0xff) {
-            SSL_CTX_flush_sessions(s->session_ctx, (unsigned long)time(NULL));
+            SSL_CTX_expire_sessions(s->session_ctx, (long)time(NULL),
+                                    SSL_SESS_AUTO_EXPIRE_MAX);
         }
     }
 }
@@ -3417,6 +3619,8 @@ SSL *SSL_dup(SSL *s)
     SSL_set_verify(ret, SSL_get_verify_mode(s), SSL_get_verify_callback(s));
     SSL_set_verify_depth(ret, SSL_get_verify_depth(s));
     ret->generate_session_id = s->generate_session_id;
+    if (!SSL_set1_client_cache_peer(ret, s->cache_host, s->cache_port))
+        goto err;
 
     SSL_set_info_callback(ret, SSL_get_info_callback(s));
 
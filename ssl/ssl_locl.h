@@ -562,6 +562,12 @@ struct ssl_session_st {
      * implement a maximum cache size.
      */
     struct ssl_session_st *prev, *next;
+    /*
+     * Position (1-based, 0 if none) and key of this session in the expiry
+     * heap of the session cache shard it is stored in.
+     */
+    size_t expire_pos;
+    long expire_at;
 
     struct {
         char *hostname;
@@ -691,20 +697,101 @@ DEFINE_LHASH_OF(X509_NAME);
 
 # define TLSEXT_KEYNAME_LENGTH 16
 
+/*
+ * A partition of the internal session cache. By default an SSL_CTX has a
+ * single shard which is protected by the SSL_CTX lock. When sharding is
+ * enabled via SSL_CTX_set_session_cache_shards() every shard has its own
+ * lock, hash table and LRU list so that lookups and inserts of sessions
+ * which fall into different shards do not contend with each other.
+ */
+typedef struct ssl_sess_shard_st {
+    CRYPTO_RWLOCK *lock;
+    LHASH_OF(SSL_SESSION) *sessions;
+    struct ssl_session_st *session_cache_head;
+    struct ssl_session_st *session_cache_tail;
+    /* binary min-heap of the sessions ordered by their expiry time */
+    struct ssl_session_st **expire_heap;
+    size_t expire_num;
+    size_t expire_max;
+    /* session removed due to full shard, protected by |lock| */
+    int sess_cache_full;
+} SSL_SESS_SHARD;
+
+/*
+ * Maximum number of expired sessions removed from the internal session cache
+ * by the automatic expiry every 255 connections.
+ */
+# define SSL_SESS_AUTO_EXPIRE_MAX 512
+
+/*
+ * A session ticket key which is still accepted for decryption after it has
+ * been replaced, see SSL_CTX_rotate_ticket_keys(). The keys of an SSL_CTX are
+ * kept in a hash table indexed by name and in a list ordered by age, newest
+ * first, from which the oldest keys are dropped when the ring is full.
+ */
+typedef struct ssl_ticket_key_st {
+    unsigned char name[TLSEXT_KEYNAME_LENGTH];
+    unsigned char hmac_key[32];
+    unsigned char aes_key[32];
+    struct ssl_ticket_key_st *prev, *next;
+} SSL_TICKET_KEY;
+
+DEFINE_LHASH_OF(SSL_TICKET_KEY);
+
+/* Number of earlier ticket keys accepted by default */
+# define SSL_TICKET_KEY_RING_SIZE_DEFAULT 4
+
+/*
+ * An entry of the client session cache, see SSL_SESS_CACHE_CLIENT_AUTO. The
+ * key identifies the peer and is built from the host and port set with
+ * SSL_set1_client_cache_peer(), the SNI name and the offered ALPN protocols.
+ */
+typedef struct ssl_client_sess_st {
+    unsigned long hash;
+    unsigned char *key;
+    size_t keylen;
+    SSL_SESSION *session;
+    struct ssl_client_sess_st *prev, *next;
+} SSL_CLIENT_SESS;
+
+DEFINE_LHASH_OF(SSL_CLIENT_SESS);
+
+/*
+ * The client session cache of an SSL_CTX. The shared table holds up to
+ * session_cache_size entries and is protected by |lock|; its list is ordered
+ * by the time the entries were stored, newest first. In front of it every
+ * thread has a small direct-mapped table in thread local storage which is
+ * looked at first, so that repeated connections to the same peer from one
+ * thread touch neither |lock| nor the SSL_CTX lock. All caches share one
+ * thread local key; |index| selects the table of this cache among the tables
+ * of a thread.
+ */
+typedef struct ssl_client_cache_st {
+    CRYPTO_RWLOCK *lock;
+    LHASH_OF(SSL_CLIENT_SESS) *sessions;
+    SSL_CLIENT_SESS *head, *tail;
+    size_t index;
+} SSL_CLIENT_CACHE;
+
+/* Number of entries in the per-thread table of the client session cache */
+# define SSL_CLIENT_CACHE_L1_SIZE 64
+
 struct ssl_ctx_st {
     const SSL_METHOD *method;
     STACK_OF(SSL_CIPHER) *cipher_list;
     /* same as above but sorted for lookup */
     STACK_OF(SSL_CIPHER) *cipher_list_by_id;
     struct x509_store_st /* X509_STORE */ *cert_store;
-    LHASH_OF(SSL_SESSION) *sessions;
+    /* The internal session cache, split into |sess_num_shards| shards */
+    SSL_SESS_SHARD *sess_shards;
+    size_t sess_num_shards;
+    /* Client session cache, allocated with SSL_SESS_CACHE_CLIENT_AUTO */
+    SSL_CLIENT_CACHE *client_cache;
     /*
      * Most session-ids that will be cached, default is
      * SSL_SESSION_CACHE_MAX_SIZE_DEFAULT. 0 is unlimited.
      */
     size_t session_cache_size;
-    struct ssl_session_st *session_cache_head;
-    struct ssl_session_st *session_cache_tail;
     /*
      * This can have one of 2 values, ored together, SSL_SESS_CACHE_CLIENT,
      * SSL_SESS_CACHE_SERVER, Default is SSL_SESSION_CACHE_SERVER, which
@@ -740,7 +827,6 @@ struct ssl_ctx_st {
         int sess_accept_good;   /* SSL accept/reneg - finished */
         int sess_miss;          /* session lookup misses */
         int sess_timeout;       /* reuse attempt on timeouted session */
-        int sess_cache_full;    /* session removed due to full cache */
         int sess_hit;           /* session reuse actually done */
         int sess_cb_hit;        /* session-id that was not in the cache was
                                  * passed back via the callback.  This
@@ -847,10 +933,28 @@ struct ssl_ctx_st {
 
     /* Up to how many pipelines should we use? If 0 then 1 is assumed */
     size_t max_pipelines;
+    /*
+     * Amount of application data to collect with SSL_MODE_COALESCE_WRITES
+     * before sending it. If 0 then |max_send_fragment| is assumed.
+     */
+    size_t write_coalesce_threshold;
 
     /* The default read buffer length to use (0 means not set) */
     size_t default_read_buf_len;
 
+    /*
+     * Record buffers released by the SSL objects of this SSL_CTX, kept for
+     * reuse. Each list holds at most |buf_freelist_max_len| buffers, 0
+     * disables pooling. Protected by |buf_freelist_lock|.
+     */
+    CRYPTO_RWLOCK *buf_freelist_lock;
+    size_t buf_freelist_max_len;
+    SSL3_BUF_FREELIST rbuf_freelist;
+    SSL3_BUF_FREELIST wbuf_freelist;
+    /* buffer requests served from / missed in the lists */
+    long buf_freelist_hits;
+    long buf_freelist_misses;
+
 # ifndef OPENSSL_NO_ENGINE
     /*
      * Engine to pass requests for client certs to
@@ -871,6 +975,12 @@ struct ssl_ctx_st {
         unsigned char tick_key_name[TLSEXT_KEYNAME_LENGTH];
         unsigned char tick_hmac_key[32];
         unsigned char tick_aes_key[32];
+        /* Earlier ticket keys which are still accepted */
+        LHASH_OF(SSL_TICKET_KEY) *tick_keys;
+        SSL_TICKET_KEY *tick_keys_head, *tick_keys_tail;
+        size_t tick_keys_num, tick_keys_max;
+        /* Protects all of the ticket keys above */
+        CRYPTO_RWLOCK *tick_lock;
         /* Callback to support customisation of ticket key setting */
         int (*ticket_key_cb) (SSL *ssl,
                               unsigned char *name, unsigned char *iv,
@@ -1087,6 +1197,9 @@ struct ssl_st {
     unsigned char sid_ctx[SSL_MAX_SID_CTX_LENGTH];
     /* This can also be in the session once a session is established */
     SSL_SESSION *session;
+    /* Peer for the client session cache, see SSL_set1_client_cache_peer() */
+    char *cache_host;
+    unsigned short cache_port;
     /* Default generate session ID callback. */
     GEN_SESSION_CB generate_session_id;
     /* Used in SSL3 */
@@ -1141,6 +1254,11 @@ struct ssl_st {
     size_t max_send_fragment;
     /* Up to how many pipelines should we use? If 0 then 1 is assumed */
     size_t max_pipelines;
+    /*
+     * Amount of application data to collect with SSL_MODE_COALESCE_WRITES
+     * before sending it. If 0 then |max_send_fragment| is assumed.
+     */
+    size_t write_coalesce_threshold;
 
     struct {
         /* TLS extension debug callback */
@@ -2041,6 +2159,13 @@ void ssl_cert_clear_certs(CERT *c);
 void ssl_cert_free(CERT *c);
 __owur int ssl_get_new_session(SSL *s, int session);
 __owur int ssl_get_prev_session(SSL *s, CLIENTHELLO_MSG *hello, int *al);
+__owur int ssl_client_cache_new(SSL_CTX *ctx);
+void ssl_client_cache_free(SSL_CLIENT_CACHE *cache);
+void ssl_client_cache_get(SSL *s);
+void ssl_client_cache_add(SSL *s);
+void ssl_client_cache_cleanup_int(void);
+__owur SSL_SESS_SHARD *ssl_session_get_shard(const SSL_CTX *ctx,
+                                             const SSL_SESSION *s);
 __owur SSL_SESSION *ssl_session_dup(SSL_SESSION *src, int ticket);
 __owur int ssl_cipher_id_cmp(const SSL_CIPHER *a, const SSL_CIPHER *b);
 DECLARE_OBJ_BSEARCH_GLOBAL_CMP_FN(SSL_CIPHER, SSL_CIPHER, ssl_cipher_id);
@@ -2332,6 +2457,13 @@ __owur TICKET_RETURN tls_decrypt_ticket(SSL *s, const unsigned char *etick,
                                         size_t eticklen,
                                         const unsigned char *sess_id,
                                         size_t sesslen, SSL_SESSION **psess);
+void tls_get_ticket_key(SSL_CTX *ctx, unsigned char *name,
+                        unsigned char *hmac_key, unsigned char *aes_key);
+__owur int tls_lookup_ticket_key(SSL_CTX *ctx, const unsigned char *name,
+                                 unsigned char *hmac_key,
+                                 unsigned char *aes_key);
+void tls_set_ticket_key_ring_size(SSL_CTX *ctx, size_t max);
+void tls_free_ticket_keys(SSL_CTX *ctx);
 
 __owur int tls_use_ticket(SSL *s);
 
@@ -38,12 +38,15 @@
 #include <openssl/lhash.h>
 #include <openssl/rand.h>
 #include <openssl/engine.h>
+#include "internal/thread_once.h"
 #include "ssl_locl.h"
 #include "statem/statem_locl.h"
 
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s);
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *s);
+static void SSL_SESSION_list_remove(SSL_SESS_SHARD *shard, SSL_SESSION *s);
+static void SSL_SESSION_list_add(SSL_SESS_SHARD *shard, SSL_SESSION *s);
+static void session_heap_sift_down(SSL_SESS_SHARD *shard, size_t pos);
 static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *c, int lck);
+static void client_cache_flush(SSL_CLIENT_CACHE *cache, long t);
 
 /*
  * TODO(TLS1.3): SSL_get_session() and SSL_get1_session() are problematic in
@@ -156,6 +159,7 @@ SSL_SESSION *ssl_session_dup(SSL_SESSION *src, int ticket)
     /* We deliberately don't copy the prev and next pointers */
     dest->prev = NULL;
     dest->next = NULL;
+    dest->expire_pos = 0;
 
     dest->references = 1;
 
@@ -499,18 +503,20 @@ int ssl_get_prev_session(SSL *s, CLIENTHELLO_MSG *hello, int *al)
         !(s->session_ctx->session_cache_mode &
           SSL_SESS_CACHE_NO_INTERNAL_LOOKUP)) {
         SSL_SESSION data;
+        SSL_SESS_SHARD *shard;
 
         data.ssl_version = s->version;
         memcpy(data.session_id, hello->session_id, hello->session_id_len);
         data.session_id_length = hello->session_id_len;
 
-        CRYPTO_THREAD_read_lock(s->session_ctx->lock);
-        ret = lh_SSL_SESSION_retrieve(s->session_ctx->sessions, &data);
+        shard = ssl_session_get_shard(s->session_ctx, &data);
+        CRYPTO_THREAD_read_lock(shard->lock);
+        ret = lh_SSL_SESSION_retrieve(shard->sessions, &data);
         if (ret != NULL) {
             /* don't allow other threads to steal it: */
             SSL_SESSION_up_ref(ret);
         }
-        CRYPTO_THREAD_unlock(s->session_ctx->lock);
+        CRYPTO_THREAD_unlock(shard->lock);
         if (ret == NULL)
             s->session_ctx->stats.sess_miss++;
     }
@@ -644,10 +650,33 @@ int ssl_get_prev_session(SSL *s, CLIENTHELLO_MSG *hello, int *al)
     return 0;
 }
 
+/*
+ * Select the shard of the internal session cache of |ctx| that |s| belongs
+ * to. The shard is chosen by a hash over the whole session ID which is
+ * independent of the bytes that ssl_session_hash() uses for the hash table
+ * inside the shard.
+ */
+SSL_SESS_SHARD *ssl_session_get_shard(const SSL_CTX *ctx,
+                                      const SSL_SESSION *s)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    if (ctx->sess_num_shards == 1)
+        return ctx->sess_shards;
+
+    /* FNV-1a */
+    for (i = 0; i < s->session_id_length; i++)
+        h = (h ^ s->session_id[i]) * 16777619U;
+
+    return &ctx->sess_shards[h % ctx->sess_num_shards];
+}
+
 int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 {
     int ret = 0;
     SSL_SESSION *s;
+    SSL_SESS_SHARD *shard = ssl_session_get_shard(ctx, c);
 
     /*
      * add just 1 reference count for the SSL_CTX's session cache even though
@@ -659,17 +688,17 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
      * if session c is in already in cache, we take back the increment later
      */
 
-    CRYPTO_THREAD_write_lock(ctx->lock);
-    s = lh_SSL_SESSION_insert(ctx->sessions, c);
+    CRYPTO_THREAD_write_lock(shard->lock);
+    s = lh_SSL_SESSION_insert(shard->sessions, c);
 
     /*
      * s != NULL iff we already had a session with the given PID. In this
      * case, s == c should hold (then we did not really modify
-     * ctx->sessions), or we're in trouble.
+     * shard->sessions), or we're in trouble.
      */
     if (s != NULL && s != c) {
         /* We *are* in trouble ... */
-        SSL_SESSION_list_remove(ctx, s);
+        SSL_SESSION_list_remove(shard, s);
         SSL_SESSION_free(s);
         /*
          * ... so pretend the other session did not exist in cache (we cannot
@@ -679,7 +708,7 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
          */
         s = NULL;
     } else if (s == NULL &&
-               lh_SSL_SESSION_retrieve(ctx->sessions, c) == NULL) {
+               lh_SSL_SESSION_retrieve(shard->sessions, c) == NULL) {
         /* s == NULL can also mean OOM error in lh_SSL_SESSION_insert ... */
 
         /*
@@ -691,7 +720,7 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 
     /* Put at the head of the queue unless it is already in the cache */
     if (s == NULL)
-        SSL_SESSION_list_add(ctx, c);
+        SSL_SESSION_list_add(shard, c);
 
     if (s != NULL) {
         /*
@@ -703,21 +732,25 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
         ret = 0;
     } else {
         /*
-         * new cache entry -- remove old ones if cache has become too large
+         * new cache entry -- remove old ones if cache has become too large.
+         * The cache size is split evenly between the shards.
          */
 
         ret = 1;
 
-        if (SSL_CTX_sess_get_cache_size(ctx) > 0) {
-            while (SSL_CTX_sess_number(ctx) > SSL_CTX_sess_get_cache_size(ctx)) {
-                if (!remove_session_lock(ctx, ctx->session_cache_tail, 0))
+        if (ctx->session_cache_size > 0) {
+            size_t max = (ctx->session_cache_size + ctx->sess_num_shards - 1)
+                         / ctx->sess_num_shards;
+
+            while (lh_SSL_SESSION_num_items(shard->sessions) > max) {
+                if (!remove_session_lock(ctx, shard->session_cache_tail, 0))
                     break;
                 else
-                    ctx->stats.sess_cache_full++;
+                    shard->sess_cache_full++;
             }
         }
     }
-    CRYPTO_THREAD_unlock(ctx->lock);
+    CRYPTO_THREAD_unlock(shard->lock);
     return ret;
 }
 
@@ -729,20 +762,22 @@ int SSL_CTX_remove_session(SSL_CTX *ctx, SSL_SESSION *c)
 static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *c, int lck)
 {
     SSL_SESSION *r;
+    SSL_SESS_SHARD *shard;
     int ret = 0;
 
     if ((c != NULL) && (c->session_id_length != 0)) {
+        shard = ssl_session_get_shard(ctx, c);
         if (lck)
-            CRYPTO_THREAD_write_lock(ctx->lock);
-        if ((r = lh_SSL_SESSION_retrieve(ctx->sessions, c)) == c) {
+            CRYPTO_THREAD_write_lock(shard->lock);
+        if ((r = lh_SSL_SESSION_retrieve(shard->sessions, c)) == c) {
             ret = 1;
-            r = lh_SSL_SESSION_delete(ctx->sessions, c);
-            SSL_SESSION_list_remove(ctx, c);
+            r = lh_SSL_SESSION_delete(shard->sessions, c);
+            SSL_SESSION_list_remove(shard, c);
         }
         c->not_resumable = 1;
 
         if (lck)
-            CRYPTO_THREAD_unlock(ctx->lock);
+            CRYPTO_THREAD_unlock(shard->lock);
 
         if (ret)
             SSL_SESSION_free(r);
@@ -996,23 +1031,29 @@ int SSL_set_session_ticket_ext(SSL *s, void *ext_data, int ext_len)
 typedef struct timeout_param_st {
     SSL_CTX *ctx;
     long time;
-    LHASH_OF(SSL_SESSION) *cache;
+    SSL_SESS_SHARD *shard;
 } TIMEOUT_PARAM;
 
+/* locked by the shard lock in the calling function */
+static void session_expire(SSL_CTX *ctx, SSL_SESS_SHARD *shard,
+                           SSL_SESSION *s)
+{
+    /*
+     * The reason we don't call SSL_CTX_remove_session() is to save on
+     * locking overhead
+     */
+    (void)lh_SSL_SESSION_delete(shard->sessions, s);
+    SSL_SESSION_list_remove(shard, s);
+    s->not_resumable = 1;
+    if (ctx->remove_session_cb != NULL)
+        ctx->remove_session_cb(ctx, s);
+    SSL_SESSION_free(s);
+}
+
 static void timeout_cb(SSL_SESSION *s, TIMEOUT_PARAM *p)
 {
-    if ((p->time == 0) || (p->time > (s->time + s->timeout))) { /* timeout */
-        /*
-         * The reason we don't call SSL_CTX_remove_session() is to save on
-         * locking overhead
-         */
-        (void)lh_SSL_SESSION_delete(p->cache, s);
-        SSL_SESSION_list_remove(p->ctx, s);
-        s->not_resumable = 1;
-        if (p->ctx->remove_session_cb != NULL)
-            p->ctx->remove_session_cb(p->ctx, s);
-        SSL_SESSION_free(s);
-    }
+    if ((p->time == 0) || (p->time > (s->time + s->timeout))) /* timeout */
+        session_expire(p->ctx, p->shard, s);
 }
 
 IMPLEMENT_LHASH_DOALL_ARG(SSL_SESSION, TIMEOUT_PARAM);
@@ -1020,19 +1061,64 @@ IMPLEMENT_LHASH_DOALL_ARG(SSL_SESSION, TIMEOUT_PARAM);
 void SSL_CTX_flush_sessions(SSL_CTX *s, long t)
 {
     unsigned long i;
+    size_t n;
     TIMEOUT_PARAM tp;
 
-    tp.ctx = s;
-    tp.cache = s->sessions;
-    if (tp.cache == NULL)
+    if (s->client_cache != NULL)
+        client_cache_flush(s->client_cache, t);
+    if (s->sess_shards == NULL)
         return;
+    tp.ctx = s;
     tp.time = t;
-    CRYPTO_THREAD_write_lock(s->lock);
-    i = lh_SSL_SESSION_get_down_load(s->sessions);
-    lh_SSL_SESSION_set_down_load(s->sessions, 0);
-    lh_SSL_SESSION_doall_TIMEOUT_PARAM(tp.cache, timeout_cb, &tp);
-    lh_SSL_SESSION_set_down_load(s->sessions, i);
-    CRYPTO_THREAD_unlock(s->lock);
+    for (n = 0; n < s->sess_num_shards; n++) {
+        tp.shard = &s->sess_shards[n];
+        if (tp.shard->sessions == NULL)
+            continue;
+        CRYPTO_THREAD_write_lock(tp.shard->lock);
+        i = lh_SSL_SESSION_get_down_load(tp.shard->sessions);
+        lh_SSL_SESSION_set_down_load(tp.shard->sessions, 0);
+        lh_SSL_SESSION_doall_TIMEOUT_PARAM(tp.shard->sessions, timeout_cb,
+                                           &tp);
+        lh_SSL_SESSION_set_down_load(tp.shard->sessions, i);
+        CRYPTO_THREAD_unlock(tp.shard->lock);
+    }
+}
+
+/*
+ * Remove at most |max| sessions (any number if |max| is 0) that have expired
+ * at time |t| from the internal session cache, earliest expiry first. Unlike
+ * SSL_CTX_flush_sessions() this does not walk the whole cache but only
+ * touches the sessions it removes.
+ */
+size_t SSL_CTX_expire_sessions(SSL_CTX *ctx, long t, size_t max)
+{
+    size_t n, count = 0;
+    SSL_SESS_SHARD *shard;
+    SSL_SESSION *s;
+
+    if (ctx->sess_shards == NULL)
+        return 0;
+    for (n = 0; n < ctx->sess_num_shards; n++) {
+        shard = &ctx->sess_shards[n];
+        CRYPTO_THREAD_write_lock(shard->lock);
+        while (shard->expire_num > 0 && (max == 0 || count < max)) {
+            s = shard->expire_heap[0];
+            if (s->expire_at >= t)
+                break;
+            if (s->time + s->timeout >= t) {
+                /* The time or timeout has been changed since it was added */
+                s->expire_at = s->time + s->timeout;
+                session_heap_sift_down(shard, 1);
+                continue;
+            }
+            session_expire(ctx, shard, s);
+            count++;
+        }
+        CRYPTO_THREAD_unlock(shard->lock);
+        if (max != 0 && count == max)
+            break;
+    }
+    return count;
 }
 
 int ssl_clear_bad_session(SSL *s)
@@ -1046,27 +1132,116 @@ int ssl_clear_bad_session(SSL *s)
         return (0);
 }
 
-/* locked by SSL_CTX in the calling function */
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s)
+/*
+ * Alongside the LRU list every shard keeps its sessions in a binary min-heap
+ * ordered by expiry time, so that SSL_CTX_expire_sessions() can find expired
+ * sessions without a walk over the whole cache. Heap positions are 1-based so
+ * that 0 can mean "not in the heap". Locked by the shard lock in the calling
+ * function.
+ */
+static void session_heap_set(SSL_SESS_SHARD *shard, size_t pos,
+                             SSL_SESSION *s)
+{
+    shard->expire_heap[pos - 1] = s;
+    s->expire_pos = pos;
+}
+
+static void session_heap_sift_up(SSL_SESS_SHARD *shard, size_t pos)
+{
+    SSL_SESSION *s = shard->expire_heap[pos - 1], *parent;
+
+    while (pos > 1) {
+        parent = shard->expire_heap[pos / 2 - 1];
+        if (parent->expire_at <= s->expire_at)
+            break;
+        session_heap_set(shard, pos, parent);
+        pos /= 2;
+    }
+    session_heap_set(shard, pos, s);
+}
+
+static void session_heap_sift_down(SSL_SESS_SHARD *shard, size_t pos)
+{
+    SSL_SESSION *s = shard->expire_heap[pos - 1], *child;
+    size_t c;
+
+    while ((c = pos * 2) <= shard->expire_num) {
+        /* pick the earlier of the two children */
+        if (c < shard->expire_num
+                && shard->expire_heap[c]->expire_at
+                   < shard->expire_heap[c - 1]->expire_at)
+            c++;
+        child = shard->expire_heap[c - 1];
+        if (s->expire_at <= child->expire_at)
+            break;
+        session_heap_set(shard, pos, child);
+        pos = c;
+    }
+    session_heap_set(shard, pos, s);
+}
+
+static void session_heap_add(SSL_SESS_SHARD *shard, SSL_SESSION *s)
+{
+    if (shard->expire_num == shard->expire_max) {
+        size_t max = shard->expire_max == 0 ? 64 : shard->expire_max * 2;
+        SSL_SESSION **tmp = OPENSSL_realloc(shard->expire_heap,
+                                            max * sizeof(*tmp));
+
+        /*
+         * Not fatal: the session is still expired by SSL_CTX_flush_sessions()
+         * and checked for expiry when it is looked up
+         */
+        if (tmp == NULL)
+            return;
+        shard->expire_heap = tmp;
+        shard->expire_max = max;
+    }
+    s->expire_at = s->time + s->timeout;
+    shard->expire_heap[shard->expire_num++] = s;
+    session_heap_sift_up(shard, shard->expire_num);
+}
+
+static void session_heap_remove(SSL_SESS_SHARD *shard, SSL_SESSION *s)
+{
+    size_t pos = s->expire_pos;
+    SSL_SESSION *last;
+
+    if (pos == 0 || pos > shard->expire_num
+            || shard->expire_heap[pos - 1] != s)
+        return;
+
+    s->expire_pos = 0;
+    last = shard->expire_heap[--shard->expire_num];
+    if (last == s)
+        return;
+    session_heap_set(shard, pos, last);
+    session_heap_sift_up(shard, pos);
+    session_heap_sift_down(shard, last->expire_pos);
+}
+
+/* locked by the shard lock in the calling function */
+static void SSL_SESSION_list_remove(SSL_SESS_SHARD *shard, SSL_SESSION *s)
 {
+    session_heap_remove(shard, s);
+
     if ((s->next == NULL) || (s->prev == NULL))
         return;
 
-    if (s->next == (SSL_SESSION *)&(ctx->session_cache_tail)) {
+    if (s->next == (SSL_SESSION *)&(shard->session_cache_tail)) {
         /* last element in list */
-        if (s->prev == (SSL_SESSION *)&(ctx->session_cache_head)) {
+        if (s->prev == (SSL_SESSION *)&(shard->session_cache_head)) {
             /* only one element in list */
-            ctx->session_cache_head = NULL;
-            ctx->session_cache_tail = NULL;
+            shard->session_cache_head = NULL;
+            shard->session_cache_tail = NULL;
         } else {
-            ctx->session_cache_tail = s->prev;
-            s->prev->next = (SSL_SESSION *)&(ctx->session_cache_tail);
+            shard->session_cache_tail = s->prev;
+            s->prev->next = (SSL_SESSION *)&(shard->session_cache_tail);
         }
     } else {
-        if (s->prev == (SSL_SESSION *)&(ctx->session_cache_head)) {
+        if (s->prev == (SSL_SESSION *)&(shard->session_cache_head)) {
             /* first element in list */
-            ctx->session_cache_head = s->next;
-            s->next->prev = (SSL_SESSION *)&(ctx->session_cache_head);
+            shard->session_cache_head = s->next;
+            s->next->prev = (SSL_SESSION *)&(shard->session_cache_head);
         } else {
             /* middle of list */
             s->next->prev = s->prev;
@@ -1076,22 +1251,520 @@ static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s)
     s->prev = s->next = NULL;
 }
 
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *s)
+static void SSL_SESSION_list_add(SSL_SESS_SHARD *shard, SSL_SESSION *s)
 {
     if ((s->next != NULL) && (s->prev != NULL))
-        SSL_SESSION_list_remove(ctx, s);
+        SSL_SESSION_list_remove(shard, s);
 
-    if (ctx->session_cache_head == NULL) {
-        ctx->session_cache_head = s;
-        ctx->session_cache_tail = s;
-        s->prev = (SSL_SESSION *)&(ctx->session_cache_head);
-        s->next = (SSL_SESSION *)&(ctx->session_cache_tail);
+    if (shard->session_cache_head == NULL) {
+        shard->session_cache_head = s;
+        shard->session_cache_tail = s;
+        s->prev = (SSL_SESSION *)&(shard->session_cache_head);
+        s->next = (SSL_SESSION *)&(shard->session_cache_tail);
     } else {
-        s->next = ctx->session_cache_head;
+        s->next = shard->session_cache_head;
         s->next->prev = s;
-        s->prev = (SSL_SESSION *)&(ctx->session_cache_head);
-        ctx->session_cache_head = s;
+        s->prev = (SSL_SESSION *)&(shard->session_cache_head);
+        shard->session_cache_head = s;
     }
+    session_heap_add(shard, s);
+}
+
+/*
+ * The client session cache, see SSL_SESS_CACHE_CLIENT_AUTO. A slot of a
+ * per-thread table owns a copy of its key and a reference to its session,
+ * just like an entry of the shared table.
+ *
+ * The per-thread tables of a thread are found through a single thread local
+ * key shared by all caches, in an array indexed by the |index| of the cache.
+ * A thread reads its own array without locking. Changes to the arrays, the
+ * list of all threads that have one and the allocation of cache indexes are
+ * protected by |client_cache_lock|, so that the tables can be freed both on
+ * thread exit and together with their SSL_CTX.
+ */
+typedef struct ssl_client_cache_l1_st {
+    SSL_CLIENT_SESS slots[SSL_CLIENT_CACHE_L1_SIZE];
+} SSL_CLIENT_CACHE_L1;
+
+typedef struct ssl_client_cache_thread_st {
+    SSL_CLIENT_CACHE_L1 **tables;
+    size_t num;
+    struct ssl_client_cache_thread_st *prev, *next;
+} SSL_CLIENT_CACHE_THREAD;
+
+static CRYPTO_ONCE client_cache_once = CRYPTO_ONCE_STATIC_INIT;
+static int client_cache_inited = 0;
+static CRYPTO_THREAD_LOCAL client_cache_key;
+static CRYPTO_RWLOCK *client_cache_lock = NULL;
+static SSL_CLIENT_CACHE_THREAD *client_cache_threads = NULL;
+/* client_cache_used[i] is set while a cache has index i */
+static unsigned char *client_cache_used = NULL;
+static size_t client_cache_num_used = 0;
+
+static unsigned long client_sess_hash(const SSL_CLIENT_SESS *a)
+{
+    return a->hash;
+}
+
+static int client_sess_cmp(const SSL_CLIENT_SESS *a, const SSL_CLIENT_SESS *b)
+{
+    if (a->keylen != b->keylen)
+        return 1;
+    return memcmp(a->key, b->key, a->keylen);
+}
+
+/*
+ * Build the key of the client session cache for |s| in |cs|: the peer host
+ * and port, the SNI name and the ALPN protocol list. The SNI name is used as
+ * the host if none has been set. Returns 0 if |s| has no peer to key the
+ * cache with or on allocation failure.
+ */
+static int client_sess_key(const SSL *s, SSL_CLIENT_SESS *cs)
+{
+    const char *host = s->cache_host != NULL ? s->cache_host : s->ext.hostname;
+    size_t hostlen, snilen, i;
+    unsigned char *p;
+    uint32_t h = 2166136261U;
+
+    if (host == NULL)
+        return 0;
+    hostlen = strlen(host) + 1;
+    snilen = s->ext.hostname != NULL ? strlen(s->ext.hostname) : 0;
+    cs->keylen = hostlen + 2 + snilen + 1 + s->ext.alpn_len;
+    if ((cs->key = p = OPENSSL_malloc(cs->keylen)) == NULL)
+        return 0;
+    memcpy(p, host, hostlen);
+    p += hostlen;
+    *p++ = (unsigned char)(s->cache_port >> 8);
+    *p++ = (unsigned char)(s->cache_port & 0xff);
+    if (snilen > 0)
+        memcpy(p, s->ext.hostname, snilen);
+    p += snilen;
+    *p++ = '\0';
+    if (s->ext.alpn_len > 0)
+        memcpy(p, s->ext.alpn, s->ext.alpn_len);
+
+    /* FNV-1a */
+    for (i = 0; i < cs->keylen; i++)
+        h = (h ^ cs->key[i]) * 16777619U;
+    cs->hash = h;
+    cs->session = NULL;
+    cs->prev = cs->next = NULL;
+    return 1;
+}
+
+static int client_sess_usable(const SSL_SESSION *sess, long t)
+{
+    return !sess->not_resumable && sess->time + sess->timeout > t;
+}
+
+static void client_sess_clear(SSL_CLIENT_SESS *cs)
+{
+    OPENSSL_free(cs->key);
+    cs->key = NULL;
+    cs->keylen = 0;
+    SSL_SESSION_free(cs->session);
+    cs->session = NULL;
+}
+
+static void client_sess_free(SSL_CLIENT_SESS *cs)
+{
+    client_sess_clear(cs);
+    OPENSSL_free(cs);
+}
+
+/* locked by the client cache lock in the calling function */
+static void client_cache_list_remove(SSL_CLIENT_CACHE *cache,
+                                     SSL_CLIENT_SESS *cs)
+{
+    if (cs->prev != NULL)
+        cs->prev->next = cs->next;
+    else
+        cache->head = cs->next;
+    if (cs->next != NULL)
+        cs->next->prev = cs->prev;
+    else
+        cache->tail = cs->prev;
+    cs->prev = cs->next = NULL;
+}
+
+/* locked by the client cache lock in the calling function */
+static void client_cache_list_add(SSL_CLIENT_CACHE *cache,
+                                  SSL_CLIENT_SESS *cs)
+{
+    cs->prev = NULL;
+    cs->next = cache->head;
+    if (cache->head != NULL)
+        cache->head->prev = cs;
+    else
+        cache->tail = cs;
+    cache->head = cs;
+}
+
+static void client_cache_l1_free(SSL_CLIENT_CACHE_L1 *l1)
+{
+    size_t i;
+
+    if (l1 == NULL)
+        return;
+    for (i = 0; i < SSL_CLIENT_CACHE_L1_SIZE; i++)
+        client_sess_clear(&l1->slots[i]);
+    OPENSSL_free(l1);
+}
+
+/* Called on exit of a thread that has per-thread tables */
+static void client_cache_thread_stop(void *arg)
+{
+    SSL_CLIENT_CACHE_THREAD *t = arg;
+    size_t i;
+
+    CRYPTO_THREAD_write_lock(client_cache_lock);
+    if (t->prev != NULL)
+        t->prev->next = t->next;
+    else
+        client_cache_threads = t->next;
+    if (t->next != NULL)
+        t->next->prev = t->prev;
+    for (i = 0; i < t->num; i++)
+        client_cache_l1_free(t->tables[i]);
+    CRYPTO_THREAD_unlock(client_cache_lock);
+    OPENSSL_free(t->tables);
+    OPENSSL_free(t);
+}
+
+DEFINE_RUN_ONCE_STATIC(do_client_cache_init)
+{
+    if ((client_cache_lock = CRYPTO_THREAD_lock_new()) == NULL)
+        return 0;
+    if (!CRYPTO_THREAD_init_local(&client_cache_key,
+                                  client_cache_thread_stop)) {
+        CRYPTO_THREAD_lock_free(client_cache_lock);
+        client_cache_lock = NULL;
+        return 0;
+    }
+    client_cache_inited = 1;
+    return 1;
+}
+
+void ssl_client_cache_cleanup_int(void)
+{
+    SSL_CLIENT_CACHE_THREAD *t;
+    size_t i;
+
+    if (!client_cache_inited)
+        return;
+    CRYPTO_THREAD_cleanup_local(&client_cache_key);
+    while ((t = client_cache_threads) != NULL) {
+        client_cache_threads = t->next;
+        for (i = 0; i < t->num; i++)
+            client_cache_l1_free(t->tables[i]);
+        OPENSSL_free(t->tables);
+        OPENSSL_free(t);
+    }
+    OPENSSL_free(client_cache_used);
+    client_cache_used = NULL;
+    client_cache_num_used = 0;
+    CRYPTO_THREAD_lock_free(client_cache_lock);
+    client_cache_lock = NULL;
+    client_cache_inited = 0;
+}
+
+/* Return the table of |cache| of the calling thread, or NULL if it has none */
+static SSL_CLIENT_CACHE_L1 *client_cache_l1_get(const SSL_CLIENT_CACHE *cache)
+{
+    SSL_CLIENT_CACHE_THREAD *t = CRYPTO_THREAD_get_local(&client_cache_key);
+
+    if (t == NULL || cache->index >= t->num)
+        return NULL;
+    return t->tables[cache->index];
+}
+
+/* Return the table of |cache| of the calling thread, creating it if needed */
+static SSL_CLIENT_CACHE_L1 *client_cache_l1(const SSL_CLIENT_CACHE *cache)
+{
+    SSL_CLIENT_CACHE_THREAD *t = CRYPTO_THREAD_get_local(&client_cache_key);
+    SSL_CLIENT_CACHE_L1 *l1, **tables;
+
+    if (t != NULL && cache->index < t->num
+            && t->tables[cache->index] != NULL)
+        return t->tables[cache->index];
+
+    if (t == NULL) {
+        if ((t = OPENSSL_zalloc(sizeof(*t))) == NULL)
+            return NULL;
+        if (!CRYPTO_THREAD_set_local(&client_cache_key, t)) {
+            OPENSSL_free(t);
+            return NULL;
+        }
+        CRYPTO_THREAD_write_lock(client_cache_lock);
+        t->next = client_cache_threads;
+        if (t->next != NULL)
+            t->next->prev = t;
+        client_cache_threads = t;
+        CRYPTO_THREAD_unlock(client_cache_lock);
+    }
+
+    if ((l1 = OPENSSL_zalloc(sizeof(*l1))) == NULL)
+        return NULL;
+    CRYPTO_THREAD_write_lock(client_cache_lock);
+    if (cache->index >= t->num) {
+        tables = OPENSSL_realloc(t->tables,
+                                 client_cache_num_used * sizeof(*tables));
+        if (tables == NULL) {
+            CRYPTO_THREAD_unlock(client_cache_lock);
+            OPENSSL_free(l1);
+            return NULL;
+        }
+        memset(tables + t->num, 0,
+               (client_cache_num_used - t->num) * sizeof(*tables));
+        t->tables = tables;
+        t->num = client_cache_num_used;
+    }
+    t->tables[cache->index] = l1;
+    CRYPTO_THREAD_unlock(client_cache_lock);
+    return l1;
+}
+
+/* Put |sess| under the key in |cs| into the table of the calling thread */
+static void client_cache_l1_set(SSL_CLIENT_CACHE_L1 *l1,
+                                const SSL_CLIENT_SESS *cs, SSL_SESSION *sess)
+{
+    SSL_CLIENT_SESS *slot = &l1->slots[cs->hash % SSL_CLIENT_CACHE_L1_SIZE];
+
+    client_sess_clear(slot);
+    if ((slot->key = OPENSSL_memdup(cs->key, cs->keylen)) == NULL)
+        return;
+    slot->keylen = cs->keylen;
+    slot->hash = cs->hash;
+    SSL_SESSION_up_ref(sess);
+    slot->session = sess;
+}
+
+/* Reserve an index for |cache|, locked by |client_cache_lock| */
+static int client_cache_index_new(SSL_CLIENT_CACHE *cache)
+{
+    unsigned char *used;
+    size_t i;
+
+    for (i = 0; i < client_cache_num_used; i++)
+        if (!client_cache_used[i])
+            break;
+    if (i == client_cache_num_used) {
+        used = OPENSSL_realloc(client_cache_used, client_cache_num_used + 16);
+        if (used == NULL)
+            return 0;
+        memset(used + client_cache_num_used, 0, 16);
+        client_cache_used = used;
+        client_cache_num_used += 16;
+    }
+    client_cache_used[i] = 1;
+    cache->index = i;
+    return 1;
+}
+
+int ssl_client_cache_new(SSL_CTX *ctx)
+{
+    SSL_CLIENT_CACHE *cache;
+    int ok;
+
+    if (ctx->client_cache != NULL)
+        return 1;
+    if (!RUN_ONCE(&client_cache_once, do_client_cache_init)
+            || !client_cache_inited) {
+        SSLerr(SSL_F_SSL_CLIENT_CACHE_NEW, ERR_R_INTERNAL_ERROR);
+        return 0;
+    }
+    if ((cache = OPENSSL_zalloc(sizeof(*cache))) == NULL) {
+        SSLerr(SSL_F_SSL_CLIENT_CACHE_NEW, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    cache->lock = CRYPTO_THREAD_lock_new();
+    cache->sessions = lh_SSL_CLIENT_SESS_new(client_sess_hash, client_sess_cmp);
+    CRYPTO_THREAD_write_lock(client_cache_lock);
+    ok = cache->lock != NULL && cache->sessions != NULL
+         && client_cache_index_new(cache);
+    CRYPTO_THREAD_unlock(client_cache_lock);
+    if (!ok) {
+        SSLerr(SSL_F_SSL_CLIENT_CACHE_NEW, ERR_R_MALLOC_FAILURE);
+        lh_SSL_CLIENT_SESS_free(cache->sessions);
+        CRYPTO_THREAD_lock_free(cache->lock);
+        OPENSSL_free(cache);
+        return 0;
+    }
+    ctx->client_cache = cache;
+    return 1;
+}
+
+void ssl_client_cache_free(SSL_CLIENT_CACHE *cache)
+{
+    SSL_CLIENT_CACHE_THREAD *t;
+    SSL_CLIENT_SESS *cs;
+
+    if (cache == NULL)
+        return;
+    if (client_cache_inited) {
+        CRYPTO_THREAD_write_lock(client_cache_lock);
+        for (t = client_cache_threads; t != NULL; t = t->next) {
+            if (cache->index < t->num) {
+                client_cache_l1_free(t->tables[cache->index]);
+                t->tables[cache->index] = NULL;
+            }
+        }
+        client_cache_used[cache->index] = 0;
+        CRYPTO_THREAD_unlock(client_cache_lock);
+    }
+    while ((cs = cache->head) != NULL) {
+        cache->head = cs->next;
+        client_sess_free(cs);
+    }
+    lh_SSL_CLIENT_SESS_free(cache->sessions);
+    CRYPTO_THREAD_lock_free(cache->lock);
+    OPENSSL_free(cache);
+}
+
+/*
+ * Remove the sessions that have expired at time |t| (all of them if |t| is 0)
+ * from the shared table. The per-thread tables never offer an expired or
+ * non-resumable session and drop it on their next lookup, so sessions that
+ * have not expired yet are marked non-resumable, as SSL_CTX_remove_session()
+ * does.
+ */
+static void client_cache_flush(SSL_CLIENT_CACHE *cache, long t)
+{
+    SSL_CLIENT_SESS *cs, *next;
+
+    CRYPTO_THREAD_write_lock(cache->lock);
+    for (cs = cache->head; cs != NULL; cs = next) {
+        next = cs->next;
+        if (t != 0 && t <= cs->session->time + cs->session->timeout)
+            continue;
+        (void)lh_SSL_CLIENT_SESS_delete(cache->sessions, cs);
+        client_cache_list_remove(cache, cs);
+        cs->session->not_resumable = 1;
+        client_sess_free(cs);
+    }
+    CRYPTO_THREAD_unlock(cache->lock);
+}
+
+/*
+ * Look for a session to resume for the peer of |s|, first in the table of
+ * the calling thread and then in the shared table, and set it as the session
+ * of |s| if one is found.
+ */
+void ssl_client_cache_get(SSL *s)
+{
+    SSL_CLIENT_CACHE *cache = s->session_ctx->client_cache;
+    SSL_CLIENT_CACHE_L1 *l1;
+    SSL_CLIENT_SESS key, *slot, *cs;
+    SSL_SESSION *sess = NULL;
+    long now = (long)time(NULL);
+
+    if (cache == NULL || !client_sess_key(s, &key))
+        return;
+
+    l1 = client_cache_l1_get(cache);
+    if (l1 != NULL) {
+        slot = &l1->slots[key.hash % SSL_CLIENT_CACHE_L1_SIZE];
+        if (slot->session != NULL && slot->hash == key.hash
+                && client_sess_cmp(slot, &key) == 0) {
+            if (client_sess_usable(slot->session, now)) {
+                sess = slot->session;
+                SSL_SESSION_up_ref(sess);
+                goto found;
+            }
+            client_sess_clear(slot);
+        }
+    }
+
+    CRYPTO_THREAD_read_lock(cache->lock);
+    cs = lh_SSL_CLIENT_SESS_retrieve(cache->sessions, &key);
+    if (cs != NULL && client_sess_usable(cs->session, now)) {
+        sess = cs->session;
+        SSL_SESSION_up_ref(sess);
+    }
+    CRYPTO_THREAD_unlock(cache->lock);
+    if (sess == NULL)
+        goto end;
+
+    if ((l1 = client_cache_l1(cache)) != NULL)
+        client_cache_l1_set(l1, &key, sess);
+
+ found:
+    SSL_SESSION_free(s->session);
+    s->session = sess;
+    s->verify_result = sess->verify_result;
+ end:
+    OPENSSL_free(key.key);
+}
+
+/*
+ * Store the session of |s| for its peer, unless it was taken from the
+ * client session cache in the first place.
+ */
+void ssl_client_cache_add(SSL *s)
+{
+    SSL_CLIENT_CACHE *cache = s->session_ctx->client_cache;
+    SSL_SESSION *sess = s->session;
+    size_t max = s->session_ctx->session_cache_size;
+    SSL_CLIENT_CACHE_L1 *l1;
+    SSL_CLIENT_SESS key, *slot, *cs, *old;
+
+    if (cache == NULL || sess == NULL || sess->not_resumable
+            || !client_sess_key(s, &key))
+        return;
+
+    if ((l1 = client_cache_l1(cache)) != NULL) {
+        slot = &l1->slots[key.hash % SSL_CLIENT_CACHE_L1_SIZE];
+        if (slot->session == sess && slot->hash == key.hash
+                && client_sess_cmp(slot, &key) == 0) {
+            OPENSSL_free(key.key);
+            return;
+        }
+        client_cache_l1_set(l1, &key, sess);
+    }
+
+    if ((cs = OPENSSL_malloc(sizeof(*cs))) == NULL) {
+        OPENSSL_free(key.key);
+        return;
+    }
+    *cs = key;
+    SSL_SESSION_up_ref(sess);
+    cs->session = sess;
+
+    CRYPTO_THREAD_write_lock(cache->lock);
+    old = lh_SSL_CLIENT_SESS_insert(cache->sessions, cs);
+    if (old == NULL && lh_SSL_CLIENT_SESS_error(cache->sessions)) {
+        CRYPTO_THREAD_unlock(cache->lock);
+        client_sess_free(cs);
+        return;
+    }
+    if (old != NULL)
+        client_cache_list_remove(cache, old);
+    client_cache_list_add(cache, cs);
+    while (max > 0 && lh_SSL_CLIENT_SESS_num_items(cache->sessions) > max) {
+        SSL_CLIENT_SESS *tail = cache->tail;
+
+        (void)lh_SSL_CLIENT_SESS_delete(cache->sessions, tail);
+        client_cache_list_remove(cache, tail);
+        client_sess_free(tail);
+    }
+    CRYPTO_THREAD_unlock(cache->lock);
+    if (old != NULL)
+        client_sess_free(old);
+}
+
+int SSL_set1_client_cache_peer(SSL *s, const char *host, unsigned short port)
+{
+    char *tmp = NULL;
+
+    if (host != NULL && (tmp = OPENSSL_strdup(host)) == NULL) {
+        SSLerr(SSL_F_SSL_SET1_CLIENT_CACHE_PEER, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    OPENSSL_free(s->cache_host);
+    s->cache_host = tmp;
+    s->cache_port = port;
+    return 1;
 }
 
 void SSL_CTX_sess_set_new_cb(SSL_CTX *ctx,
@@ -1028,6 +1028,13 @@ int tls_construct_client_hello(SSL *s, WPACKET *pkt)
         return 0;
     }
 
+    if (sess == NULL
+            && (s->session_ctx->session_cache_mode
+                & SSL_SESS_CACHE_CLIENT_AUTO) != 0) {
+        ssl_client_cache_get(s);
+        sess = s->session;
+    }
+
     if ((sess == NULL) || !ssl_version_supported(s, sess->ssl_version) ||
         /*
          * In the case of EAP-FAST, we can have a pre-shared
@@ -3494,19 +3494,21 @@ int tls_construct_new_session_ticket(SSL *s, WPACKET *pkt)
         iv_len = EVP_CIPHER_CTX_iv_length(ctx);
     } else {
         const EVP_CIPHER *cipher = EVP_aes_256_cbc();
+        unsigned char hmac_key[sizeof(tctx->ext.tick_hmac_key)];
+        unsigned char aes_key[sizeof(tctx->ext.tick_aes_key)];
+        int ok;
 
         iv_len = EVP_CIPHER_iv_length(cipher);
         if (RAND_bytes(iv, iv_len) <= 0)
             goto err;
-        if (!EVP_EncryptInit_ex(ctx, cipher, NULL,
-                                tctx->ext.tick_aes_key, iv))
+        tls_get_ticket_key(tctx, key_name, hmac_key, aes_key);
+        ok = EVP_EncryptInit_ex(ctx, cipher, NULL, aes_key, iv)
+             && HMAC_Init_ex(hctx, hmac_key, sizeof(hmac_key), EVP_sha256(),
+                             NULL);
+        OPENSSL_cleanse(hmac_key, sizeof(hmac_key));
+        OPENSSL_cleanse(aes_key, sizeof(aes_key));
+        if (!ok)
             goto err;
-        if (!HMAC_Init_ex(hctx, tctx->ext.tick_hmac_key,
-                          sizeof(tctx->ext.tick_hmac_key),
-                          EVP_sha256(), NULL))
-            goto err;
-        memcpy(key_name, tctx->ext.tick_key_name,
-               sizeof(tctx->ext.tick_key_name));
     }
 
     /*
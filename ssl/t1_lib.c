@@ -17,6 +17,7 @@
 #include <openssl/x509v3.h>
 #include <openssl/dh.h>
 #include <openssl/bn.h>
+#include <openssl/rand.h>
 #include "ssl_locl.h"
 #include <openssl/ct.h>
 
@@ -1248,21 +1249,28 @@ TICKET_RETURN tls_decrypt_ticket(SSL *s, const unsigned char *etick,
         if (rv == 2)
             renew_ticket = 1;
     } else {
-        /* Check key name matches */
-        if (memcmp(etick, tctx->ext.tick_key_name,
-                   sizeof(tctx->ext.tick_key_name)) != 0) {
+        unsigned char hmac_key[sizeof(tctx->ext.tick_hmac_key)];
+        unsigned char aes_key[sizeof(tctx->ext.tick_aes_key)];
+        int found, ok;
+
+        /* Find the key by name */
+        found = eticklen >= TLSEXT_KEYNAME_LENGTH
+                ? tls_lookup_ticket_key(tctx, etick, hmac_key, aes_key) : 0;
+        if (found == 0) {
             ret = TICKET_NO_DECRYPT;
             goto err;
         }
-        if (HMAC_Init_ex(hctx, tctx->ext.tick_hmac_key,
-                         sizeof(tctx->ext.tick_hmac_key),
-                         EVP_sha256(), NULL) <= 0
-            || EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
-                                  tctx->ext.tick_aes_key,
-                                  etick
-                                  + sizeof(tctx->ext.tick_key_name)) <= 0) {
+        /* Replace tickets encrypted with an earlier key */
+        if (found == 1)
+            renew_ticket = 1;
+        ok = HMAC_Init_ex(hctx, hmac_key, sizeof(hmac_key),
+                          EVP_sha256(), NULL) > 0
+             && EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, aes_key,
+                                   etick + TLSEXT_KEYNAME_LENGTH) > 0;
+        OPENSSL_cleanse(hmac_key, sizeof(hmac_key));
+        OPENSSL_cleanse(aes_key, sizeof(aes_key));
+        if (!ok)
             goto err;
-        }
     }
     /*
      * Attempt to process session ticket, first conduct sanity and integrity
@@ -1345,6 +1353,270 @@ TICKET_RETURN tls_decrypt_ticket(SSL *s, const unsigned char *etick,
     return ret;
 }
 
+static unsigned long ssl_ticket_key_hash(const SSL_TICKET_KEY *key)
+{
+    unsigned long h = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(key->name); i++)
+        h = h * 31 + key->name[i];
+    return h;
+}
+
+static int ssl_ticket_key_cmp(const SSL_TICKET_KEY *a, const SSL_TICKET_KEY *b)
+{
+    return memcmp(a->name, b->name, sizeof(a->name));
+}
+
+/* Split |keys| as passed to SSL_CTX_set_tlsext_ticket_keys() into |key| */
+static void ticket_key_parse(SSL_TICKET_KEY *key, const unsigned char *keys)
+{
+    memcpy(key->name, keys, sizeof(key->name));
+    keys += sizeof(key->name);
+    memcpy(key->hmac_key, keys, sizeof(key->hmac_key));
+    keys += sizeof(key->hmac_key);
+    memcpy(key->aes_key, keys, sizeof(key->aes_key));
+}
+
+#define TICKET_KEYS_LENGTH \
+    (TLSEXT_KEYNAME_LENGTH + sizeof(((SSL_TICKET_KEY *)0)->hmac_key) \
+     + sizeof(((SSL_TICKET_KEY *)0)->aes_key))
+
+/*
+ * Returns the earlier ticket key of |ctx| called |name|, or NULL if there is
+ * none. Must be called with the ticket key lock held.
+ */
+static SSL_TICKET_KEY *ticket_key_ring_find(SSL_CTX *ctx,
+                                            const unsigned char *name)
+{
+    SSL_TICKET_KEY tmp;
+
+    if (ctx->ext.tick_keys == NULL)
+        return NULL;
+    memcpy(tmp.name, name, sizeof(tmp.name));
+    return lh_SSL_TICKET_KEY_retrieve(ctx->ext.tick_keys, &tmp);
+}
+
+/* Must be called with the ticket key lock held for writing */
+static void ticket_key_ring_remove(SSL_CTX *ctx, SSL_TICKET_KEY *key)
+{
+    (void)lh_SSL_TICKET_KEY_delete(ctx->ext.tick_keys, key);
+    if (key->prev != NULL)
+        key->prev->next = key->next;
+    else
+        ctx->ext.tick_keys_head = key->next;
+    if (key->next != NULL)
+        key->next->prev = key->prev;
+    else
+        ctx->ext.tick_keys_tail = key->prev;
+    ctx->ext.tick_keys_num--;
+    OPENSSL_clear_free(key, sizeof(*key));
+}
+
+/* Must be called with the ticket key lock held for writing */
+static void ticket_key_ring_trim(SSL_CTX *ctx, size_t max)
+{
+    while (ctx->ext.tick_keys_num > max)
+        ticket_key_ring_remove(ctx, ctx->ext.tick_keys_tail);
+}
+
+/*
+ * Add a copy of |key| to the earlier ticket keys of |ctx| as the newest one,
+ * replacing any key of the same name and dropping the oldest key if there
+ * are too many. Must be called with the ticket key lock held for writing.
+ * Returns 1 on success or 0 on failure.
+ */
+static int ticket_key_ring_add(SSL_CTX *ctx, const SSL_TICKET_KEY *key)
+{
+    SSL_TICKET_KEY *ent;
+
+    if (ctx->ext.tick_keys_max == 0)
+        return 1;
+    if (ctx->ext.tick_keys == NULL) {
+        ctx->ext.tick_keys = lh_SSL_TICKET_KEY_new(ssl_ticket_key_hash,
+                                                   ssl_ticket_key_cmp);
+        if (ctx->ext.tick_keys == NULL)
+            return 0;
+    }
+
+    ent = ticket_key_ring_find(ctx, key->name);
+    if (ent != NULL)
+        ticket_key_ring_remove(ctx, ent);
+
+    ent = OPENSSL_malloc(sizeof(*ent));
+    if (ent == NULL)
+        return 0;
+    memcpy(ent, key, sizeof(*ent));
+    (void)lh_SSL_TICKET_KEY_insert(ctx->ext.tick_keys, ent);
+    if (lh_SSL_TICKET_KEY_error(ctx->ext.tick_keys)) {
+        OPENSSL_clear_free(ent, sizeof(*ent));
+        return 0;
+    }
+
+    ent->prev = NULL;
+    ent->next = ctx->ext.tick_keys_head;
+    if (ent->next != NULL)
+        ent->next->prev = ent;
+    else
+        ctx->ext.tick_keys_tail = ent;
+    ctx->ext.tick_keys_head = ent;
+    ctx->ext.tick_keys_num++;
+
+    ticket_key_ring_trim(ctx, ctx->ext.tick_keys_max);
+    return 1;
+}
+
+/*
+ * Replace the ticket key of |ctx| used for encryption with |keys|, or with a
+ * random key if |keys| is NULL. The key it replaces is still accepted for
+ * decryption until it drops out of the ring of earlier keys.
+ */
+int SSL_CTX_rotate_ticket_keys(SSL_CTX *ctx, const unsigned char *keys,
+                               size_t keylen)
+{
+    SSL_TICKET_KEY key, old;
+    SSL_TICKET_KEY *staged;
+    int ret = 0;
+
+    if (keys == NULL) {
+        if (RAND_bytes(key.name, sizeof(key.name)) <= 0
+                || RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) <= 0
+                || RAND_bytes(key.aes_key, sizeof(key.aes_key)) <= 0)
+            return 0;
+    } else if (keylen != TICKET_KEYS_LENGTH) {
+        SSLerr(SSL_F_SSL_CTX_ROTATE_TICKET_KEYS,
+               SSL_R_INVALID_TICKET_KEYS_LENGTH);
+        return 0;
+    } else {
+        ticket_key_parse(&key, keys);
+    }
+
+    CRYPTO_THREAD_write_lock(ctx->ext.tick_lock);
+    memcpy(old.name, ctx->ext.tick_key_name, sizeof(old.name));
+    memcpy(old.hmac_key, ctx->ext.tick_hmac_key, sizeof(old.hmac_key));
+    memcpy(old.aes_key, ctx->ext.tick_aes_key, sizeof(old.aes_key));
+    if (!ticket_key_ring_add(ctx, &old)) {
+        SSLerr(SSL_F_SSL_CTX_ROTATE_TICKET_KEYS, ERR_R_MALLOC_FAILURE);
+        goto end;
+    }
+    /* The new key may have been added before by SSL_CTX_add_ticket_key() */
+    staged = ticket_key_ring_find(ctx, key.name);
+    if (staged != NULL)
+        ticket_key_ring_remove(ctx, staged);
+
+    memcpy(ctx->ext.tick_key_name, key.name, sizeof(key.name));
+    memcpy(ctx->ext.tick_hmac_key, key.hmac_key, sizeof(key.hmac_key));
+    memcpy(ctx->ext.tick_aes_key, key.aes_key, sizeof(key.aes_key));
+    ret = 1;
+ end:
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    OPENSSL_cleanse(&key, sizeof(key));
+    OPENSSL_cleanse(&old, sizeof(old));
+    return ret;
+}
+
+/*
+ * Add |keys| to the ticket keys of |ctx| that are accepted for decryption,
+ * without using it for encryption.
+ */
+int SSL_CTX_add_ticket_key(SSL_CTX *ctx, const unsigned char *keys,
+                           size_t keylen)
+{
+    SSL_TICKET_KEY key;
+    int ret = 0;
+
+    if (keys == NULL || keylen != TICKET_KEYS_LENGTH) {
+        SSLerr(SSL_F_SSL_CTX_ADD_TICKET_KEY, SSL_R_INVALID_TICKET_KEYS_LENGTH);
+        return 0;
+    }
+    ticket_key_parse(&key, keys);
+
+    CRYPTO_THREAD_write_lock(ctx->ext.tick_lock);
+    if (ctx->ext.tick_keys_max == 0) {
+        SSLerr(SSL_F_SSL_CTX_ADD_TICKET_KEY, SSL_R_NO_TICKET_KEY_RING);
+    } else if (memcmp(key.name, ctx->ext.tick_key_name,
+                      sizeof(key.name)) == 0) {
+        SSLerr(SSL_F_SSL_CTX_ADD_TICKET_KEY, SSL_R_TICKET_KEY_IN_USE);
+    } else if (!ticket_key_ring_add(ctx, &key)) {
+        SSLerr(SSL_F_SSL_CTX_ADD_TICKET_KEY, ERR_R_MALLOC_FAILURE);
+    } else {
+        ret = 1;
+    }
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    OPENSSL_cleanse(&key, sizeof(key));
+    return ret;
+}
+
+int SSL_CTX_remove_ticket_key(SSL_CTX *ctx, const unsigned char *name)
+{
+    SSL_TICKET_KEY *key;
+
+    CRYPTO_THREAD_write_lock(ctx->ext.tick_lock);
+    key = ticket_key_ring_find(ctx, name);
+    if (key != NULL)
+        ticket_key_ring_remove(ctx, key);
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+
+    return key != NULL;
+}
+
+void tls_set_ticket_key_ring_size(SSL_CTX *ctx, size_t max)
+{
+    CRYPTO_THREAD_write_lock(ctx->ext.tick_lock);
+    ctx->ext.tick_keys_max = max;
+    if (ctx->ext.tick_keys != NULL)
+        ticket_key_ring_trim(ctx, max);
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+}
+
+void tls_free_ticket_keys(SSL_CTX *ctx)
+{
+    if (ctx->ext.tick_keys == NULL)
+        return;
+    ticket_key_ring_trim(ctx, 0);
+    lh_SSL_TICKET_KEY_free(ctx->ext.tick_keys);
+    ctx->ext.tick_keys = NULL;
+}
+
+/* Copy the ticket key of |ctx| that is used for encryption */
+void tls_get_ticket_key(SSL_CTX *ctx, unsigned char *name,
+                        unsigned char *hmac_key, unsigned char *aes_key)
+{
+    CRYPTO_THREAD_read_lock(ctx->ext.tick_lock);
+    memcpy(name, ctx->ext.tick_key_name, sizeof(ctx->ext.tick_key_name));
+    memcpy(hmac_key, ctx->ext.tick_hmac_key, sizeof(ctx->ext.tick_hmac_key));
+    memcpy(aes_key, ctx->ext.tick_aes_key, sizeof(ctx->ext.tick_aes_key));
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+}
+
+/*
+ * Copy the HMAC and AES keys of the ticket key of |ctx| called |name|.
+ * Returns 2 if this is the key used for encryption, 1 if it is an earlier
+ * key and 0 if there is no such key.
+ */
+int tls_lookup_ticket_key(SSL_CTX *ctx, const unsigned char *name,
+                          unsigned char *hmac_key, unsigned char *aes_key)
+{
+    SSL_TICKET_KEY *key;
+    int ret = 0;
+
+    CRYPTO_THREAD_read_lock(ctx->ext.tick_lock);
+    if (memcmp(name, ctx->ext.tick_key_name,
+               sizeof(ctx->ext.tick_key_name)) == 0) {
+        memcpy(hmac_key, ctx->ext.tick_hmac_key,
+               sizeof(ctx->ext.tick_hmac_key));
+        memcpy(aes_key, ctx->ext.tick_aes_key, sizeof(ctx->ext.tick_aes_key));
+        ret = 2;
+    } else if ((key = ticket_key_ring_find(ctx, name)) != NULL) {
+        memcpy(hmac_key, key->hmac_key, sizeof(key->hmac_key));
+        memcpy(aes_key, key->aes_key, sizeof(key->aes_key));
+        ret = 1;
+    }
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+
+    return ret;
+}
+
 static int tls12_get_pkey_idx(int sig_nid)
 {
     switch (sig_nid) {
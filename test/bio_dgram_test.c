@@ -0,0 +1,376 @@
+/*
+ * Copyright 2017 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the OpenSSL license (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * Tests for batched datagram I/O, see BIO_dgram_set_recv_batch(3).
+ *
+ * When run as "bio_dgram_test -bench" this also measures the number of
+ * datagrams per second that can be sent and received over the loopback
+ * interface with and without batching.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <openssl/bio.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "ssltestlib.h"
+#include "testutil.h"
+#include "test_main_custom.h"
+
+#if !defined(OPENSSL_SYS_WINDOWS)
+# include <sys/time.h>
+# include <sys/select.h>
+# include <netinet/in.h>
+# include <arpa/inet.h>
+#else
+# include <winsock2.h>
+#endif
+
+static char *cert = NULL;
+static char *privkey = NULL;
+
+#define NUM_DGRAMS      50
+#define BATCH           16
+
+/*
+ * Create a pair of connected UDP sockets on the loopback interface and wrap
+ * them in datagram BIOs. Returns 1 on success or 0 on failure.
+ */
+static int create_dgram_pair(BIO **b1, BIO **b2)
+{
+    struct in_addr loopback;
+    BIO_ADDR *addr1 = BIO_ADDR_new(), *addr2 = BIO_ADDR_new();
+    union BIO_sock_info_u info;
+    int s1 = -1, s2 = -1, ret = 0;
+
+    *b1 = *b2 = NULL;
+    if (addr1 == NULL || addr2 == NULL)
+        goto end;
+
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    s1 = BIO_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, 0);
+    s2 = BIO_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, 0);
+    if (s1 == -1 || s2 == -1
+            || !BIO_ADDR_rawmake(addr1, AF_INET, &loopback,
+                                 sizeof(loopback), 0)
+            || !BIO_ADDR_rawmake(addr2, AF_INET, &loopback,
+                                 sizeof(loopback), 0)
+            || !BIO_listen(s1, addr1, 0)
+            || !BIO_listen(s2, addr2, 0))
+        goto end;
+
+    info.addr = addr1;
+    if (!BIO_sock_info(s1, BIO_SOCK_INFO_ADDRESS, &info))
+        goto end;
+    info.addr = addr2;
+    if (!BIO_sock_info(s2, BIO_SOCK_INFO_ADDRESS, &info))
+        goto end;
+    if (!BIO_connect(s1, addr2, 0) || !BIO_connect(s2, addr1, 0)
+            || !BIO_socket_nbio(s1, 1) || !BIO_socket_nbio(s2, 1))
+        goto end;
+
+    *b1 = BIO_new_dgram(s1, BIO_CLOSE);
+    if (*b1 == NULL)
+        goto end;
+    s1 = -1;
+    *b2 = BIO_new_dgram(s2, BIO_CLOSE);
+    if (*b2 == NULL)
+        goto end;
+    s2 = -1;
+    BIO_ctrl(*b1, BIO_CTRL_DGRAM_SET_CONNECTED, 0, addr2);
+    BIO_ctrl(*b2, BIO_CTRL_DGRAM_SET_CONNECTED, 0, addr1);
+
+    ret = 1;
+ end:
+    if (!ret) {
+        BIO_free(*b1);
+        BIO_free(*b2);
+        *b1 = *b2 = NULL;
+    }
+    if (s1 != -1)
+        BIO_closesocket(s1);
+    if (s2 != -1)
+        BIO_closesocket(s2);
+    BIO_ADDR_free(addr1);
+    BIO_ADDR_free(addr2);
+    return ret;
+}
+
+/*
+ * Wait for the datagrams sent over loopback to arrive. Reads from a non
+ * blocking socket may otherwise fail spuriously.
+ */
+static void dgram_settle(void)
+{
+#if !defined(OPENSSL_SYS_WINDOWS)
+    struct timeval tv;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+    select(0, NULL, NULL, NULL, &tv);
+#endif
+}
+
+/*
+ * Test 0: plain sender, batched receiver
+ * Test 1: batched sender, plain receiver
+ * Test 2: both batched
+ */
+static int test_dgram_batch(int idx)
+{
+    BIO *sbio = NULL, *rbio = NULL;
+    unsigned char buf[1024], expected[1024];
+    int i, len, testresult = 0;
+
+    if (!create_dgram_pair(&sbio, &rbio)) {
+        printf("Unable to create datagram BIO pair\n");
+        goto end;
+    }
+
+    if ((idx == 1 || idx == 2) && !BIO_dgram_set_send_batch(sbio, BATCH)) {
+        printf("Send batching is not supported on this platform\n");
+        testresult = 1;
+        goto end;
+    }
+    if ((idx == 0 || idx == 2) && !BIO_dgram_set_recv_batch(rbio, BATCH)) {
+        printf("Receive batching is not supported on this platform\n");
+        testresult = 1;
+        goto end;
+    }
+    if (BIO_dgram_set_send_batch(sbio, 1000)) {
+        printf("Unexpected success setting an oversized batch\n");
+        goto end;
+    }
+
+    for (i = 0; i < NUM_DGRAMS; i++) {
+        len = 1 + i * 13;
+        memset(buf, i, len);
+        if (BIO_write(sbio, buf, len) != len) {
+            printf("Failed writing datagram %d\n", i);
+            goto end;
+        }
+    }
+    if (BIO_flush(sbio) <= 0) {
+        printf("Failed flushing the datagrams\n");
+        goto end;
+    }
+    dgram_settle();
+
+    for (i = 0; i < NUM_DGRAMS; i++) {
+        len = 1 + i * 13;
+        memset(expected, i, len);
+        if (BIO_read(rbio, buf, sizeof(buf)) != len
+                || memcmp(buf, expected, len) != 0) {
+            printf("Unexpected datagram %d\n", i);
+            goto end;
+        }
+        /* All of a batch of datagrams is pending once the first is read */
+        if (idx != 1 && (i % BATCH) != BATCH - 1 && i != NUM_DGRAMS - 1
+                && BIO_pending(rbio) <= 0) {
+            printf("No datagrams pending after datagram %d\n", i);
+            goto end;
+        }
+    }
+    if (BIO_pending(rbio) != 0) {
+        printf("Unexpected datagrams pending\n");
+        goto end;
+    }
+    if (BIO_read(rbio, buf, sizeof(buf)) > 0
+            || !BIO_should_retry(rbio)) {
+        printf("Unexpected read result on an empty socket\n");
+        goto end;
+    }
+
+    testresult = 1;
+ end:
+    BIO_free(sbio);
+    BIO_free(rbio);
+    return testresult;
+}
+
+#ifndef OPENSSL_NO_DTLS
+/*
+ * Check that a DTLS connection works over batched datagram BIOs and that
+ * SSL_has_pending() reports datagrams received as part of a batch.
+ */
+static int test_dtls_batch(void)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    BIO *sbio = NULL, *cbio = NULL;
+    char msg[100], buf[100];
+    size_t written, readbytes;
+    int i, testresult = 0;
+
+    if (!create_ssl_ctx_pair(DTLS_server_method(), DTLS_client_method(),
+                             &sctx, &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        goto end;
+    }
+    if (!create_dgram_pair(&sbio, &cbio)) {
+        printf("Unable to create datagram BIO pair\n");
+        goto end;
+    }
+    if (!BIO_dgram_set_send_batch(cbio, BATCH)
+            || !BIO_dgram_set_recv_batch(sbio, BATCH)) {
+        printf("Batching is not supported on this platform\n");
+        testresult = 1;
+        goto end;
+    }
+
+    serverssl = SSL_new(sctx);
+    clientssl = SSL_new(cctx);
+    if (serverssl == NULL || clientssl == NULL) {
+        printf("Unable to create SSL objects\n");
+        goto end;
+    }
+    SSL_set_bio(serverssl, sbio, sbio);
+    sbio = NULL;
+    SSL_set_bio(clientssl, cbio, cbio);
+    cbio = NULL;
+
+    if (!create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+
+    for (i = 0; i < NUM_DGRAMS; i++) {
+        BIO_snprintf(msg, sizeof(msg), "message %d", i);
+        if (!SSL_write_ex(clientssl, msg, strlen(msg), &written)) {
+            printf("Failed writing message %d\n", i);
+            goto end;
+        }
+    }
+    if (SSL_flush(clientssl) != 1) {
+        printf("SSL_flush() failed\n");
+        goto end;
+    }
+    dgram_settle();
+
+    for (i = 0; i < NUM_DGRAMS; i++) {
+        BIO_snprintf(msg, sizeof(msg), "message %d", i);
+        if (!SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+                || readbytes != strlen(msg)
+                || memcmp(buf, msg, readbytes) != 0) {
+            printf("Unexpected message %d\n", i);
+            goto end;
+        }
+        if ((i % BATCH) != BATCH - 1 && i != NUM_DGRAMS - 1
+                && !SSL_has_pending(serverssl)) {
+            printf("No records pending after message %d\n", i);
+            goto end;
+        }
+    }
+    if (SSL_has_pending(serverssl)) {
+        printf("Unexpected records pending\n");
+        goto end;
+    }
+
+    testresult = 1;
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    BIO_free(sbio);
+    BIO_free(cbio);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+    return testresult;
+}
+#endif
+
+#if !defined(OPENSSL_SYS_WINDOWS)
+# define BENCH_DGRAMS   1000000
+# define BENCH_BURST    32
+# define BENCH_LEN      200
+
+/*
+ * Send BENCH_DGRAMS datagrams over loopback in bursts of BENCH_BURST and read
+ * them back, handling |batch| datagrams per system call.
+ */
+static int bench_dgram(int batch)
+{
+    BIO *sbio = NULL, *rbio = NULL;
+    unsigned char buf[2048];
+    struct timeval start, end;
+    double secs;
+    long sent = 0, rcvd = 0;
+    int i, ret;
+
+    memset(buf, 'x', sizeof(buf));
+    if (!create_dgram_pair(&sbio, &rbio))
+        goto err;
+    if (batch > 1 && (!BIO_dgram_set_send_batch(sbio, batch)
+                      || !BIO_dgram_set_recv_batch(rbio, batch))) {
+        printf("Batching is not supported on this platform\n");
+        goto err;
+    }
+
+    gettimeofday(&start, NULL);
+    while (rcvd < BENCH_DGRAMS) {
+        for (i = 0; i < BENCH_BURST && sent < BENCH_DGRAMS; i++, sent++) {
+            if (BIO_write(sbio, buf, BENCH_LEN) != BENCH_LEN)
+                goto err;
+        }
+        if (BIO_flush(sbio) <= 0)
+            goto err;
+        while ((ret = BIO_read(rbio, buf, sizeof(buf))) > 0)
+            rcvd++;
+        if (!BIO_should_retry(rbio))
+            goto err;
+    }
+    gettimeofday(&end, NULL);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("batch %2d: %ld datagrams of %d bytes in %.2fs, %.0f packets/s\n",
+           batch, rcvd, BENCH_LEN, secs, rcvd / secs);
+    BIO_free(sbio);
+    BIO_free(rbio);
+    return 1;
+ err:
+    printf("Benchmark with batch %d failed\n", batch);
+    ERR_print_errors_fp(stdout);
+    BIO_free(sbio);
+    BIO_free(rbio);
+    return 0;
+}
+#endif
+
+int test_main(int argc, char *argv[])
+{
+    int testresult = 1;
+
+    if (argc == 2 && strcmp(argv[1], "-bench") == 0) {
+#if !defined(OPENSSL_SYS_WINDOWS)
+        return !bench_dgram(1) || !bench_dgram(BATCH)
+               || !bench_dgram(BENCH_BURST);
+#else
+        printf("The benchmark is not supported on this platform\n");
+        return 1;
+#endif
+    }
+
+    if (argc != 3) {
+        printf("Invalid argument count\n");
+        return 1;
+    }
+
+    cert = argv[1];
+    privkey = argv[2];
+
+    ADD_ALL_TESTS(test_dgram_batch, 3);
+#ifndef OPENSSL_NO_DTLS
+    ADD_TEST(test_dtls_batch);
+#endif
+
+    testresult = run_tests(argv[0]);
+
+    return testresult;
+}
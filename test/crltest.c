@@ -372,7 +372,215 @@ err:
     return status;
 }
 
+/*
+ * Decode |crl| again with d2i_X509_CRL_compact() and check that the result
+ * encodes to the same DER and has the same revoked entries.
+ */
+static X509_CRL *compact_CRL(X509_CRL *crl, X509 *leaf)
+{
+    unsigned char *der = NULL, *der2 = NULL;
+    const unsigned char *p;
+    X509_CRL *ret = NULL;
+    X509_REVOKED *rev = NULL, *rev2 = NULL;
+    int len, len2, found, found2;
+
+    if ((len = i2d_X509_CRL(crl, &der)) <= 0)
+        goto err;
+    p = der;
+    if ((ret = d2i_X509_CRL_compact(NULL, &p, len)) == NULL
+            || p != der + len) {
+        fprintf(stderr, "Failed to decode compact CRL.\n");
+        goto err;
+    }
+    if ((len2 = i2d_X509_CRL(ret, &der2)) != len
+            || memcmp(der, der2, len) != 0) {
+        fprintf(stderr, "Compact CRL encoding differs.\n");
+        goto err;
+    }
+
+    found = X509_CRL_get0_by_cert(crl, &rev, leaf);
+    found2 = X509_CRL_get0_by_cert(ret, &rev2, leaf);
+    if (found != found2
+            || (found
+                && (rev2 == NULL
+                    || ASN1_INTEGER_cmp(X509_REVOKED_get0_serialNumber(rev),
+                                        X509_REVOKED_get0_serialNumber(rev2))
+                       != 0))) {
+        fprintf(stderr, "Compact CRL lookup differs.\n");
+        goto err;
+    }
+
+    OPENSSL_free(der);
+    OPENSSL_free(der2);
+    return ret;
+
+ err:
+    OPENSSL_free(der);
+    OPENSSL_free(der2);
+    X509_CRL_free(ret);
+    return NULL;
+}
+
+static int test_compact_crl()
+{
+    X509 *root = X509_from_strings(kCRLTestRoot);
+    X509 *leaf = X509_from_strings(kCRLTestLeaf);
+    X509_CRL *basic_crl = CRL_from_strings(kBasicCRL);
+    X509_CRL *revoked_crl = CRL_from_strings(kRevokedCRL);
+    X509_CRL *unknown_critical_crl2 = CRL_from_strings(kUnknownCriticalCRL2);
+    X509_CRL *cbasic = NULL, *crevoked = NULL, *ccritical = NULL;
+    int status = 0;
+
+    if (root == NULL || leaf == NULL || basic_crl == NULL
+            || revoked_crl == NULL || unknown_critical_crl2 == NULL) {
+        fprintf(stderr, "Failed to parse certificates and CRLs.\n");
+        goto err;
+    }
+    if ((cbasic = compact_CRL(basic_crl, leaf)) == NULL
+            || (crevoked = compact_CRL(revoked_crl, leaf)) == NULL
+            || (ccritical = compact_CRL(unknown_critical_crl2, leaf)) == NULL)
+        goto err;
+
+    if (verify(leaf, root, make_CRL_stack(cbasic, NULL),
+               X509_V_FLAG_CRL_CHECK) != X509_V_OK) {
+        fprintf(stderr, "Cert with compact CRL didn't verify.\n");
+        goto err;
+    }
+    if (verify(leaf, root, make_CRL_stack(cbasic, crevoked),
+               X509_V_FLAG_CRL_CHECK) != X509_V_ERR_CERT_REVOKED) {
+        fprintf(stderr, "Revoked compact CRL wasn't checked.\n");
+        goto err;
+    }
+    if (verify(leaf, root, make_CRL_stack(ccritical, NULL),
+               X509_V_FLAG_CRL_CHECK) !=
+            X509_V_ERR_UNHANDLED_CRITICAL_CRL_EXTENSION) {
+        fprintf(stderr, "Compact CRL with unknown critical extension was "
+                "accepted.\n");
+        goto err;
+    }
+
+    /* All entries are decoded when they are asked for */
+    if (sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crevoked))
+            != sk_X509_REVOKED_num(X509_CRL_get_REVOKED(revoked_crl))
+            || verify(leaf, root, make_CRL_stack(cbasic, crevoked),
+                      X509_V_FLAG_CRL_CHECK) != X509_V_ERR_CERT_REVOKED) {
+        fprintf(stderr, "Expanded compact CRL differs.\n");
+        goto err;
+    }
+
+    status = 1;
+
+err:
+    X509_free(root);
+    X509_free(leaf);
+    X509_CRL_free(basic_crl);
+    X509_CRL_free(revoked_crl);
+    X509_CRL_free(unknown_critical_crl2);
+    X509_CRL_free(cbasic);
+    X509_CRL_free(crevoked);
+    X509_CRL_free(ccritical);
+    return status;
+}
+
+/*
+ * Check that |crl| read back by a streaming reader has the same encoding and
+ * digest as |orig|.
+ */
+static int same_CRL(X509_CRL *crl, X509_CRL *orig)
+{
+    unsigned char *der = NULL, *der2 = NULL;
+    int len, len2, ret;
+
+    len = i2d_X509_CRL(orig, &der);
+    len2 = i2d_X509_CRL(crl, &der2);
+    ret = len > 0 && len == len2 && memcmp(der, der2, len) == 0
+          && X509_CRL_match(crl, orig) == 0;
+    OPENSSL_free(der);
+    OPENSSL_free(der2);
+    return ret;
+}
+
+static int test_stream_crl()
+{
+    X509 *root = X509_from_strings(kCRLTestRoot);
+    X509 *leaf = X509_from_strings(kCRLTestLeaf);
+    X509_CRL *basic_crl = CRL_from_strings(kBasicCRL);
+    X509_CRL *revoked_crl = CRL_from_strings(kRevokedCRL);
+    X509_CRL *sbasic = NULL, *srevoked = NULL, *tmp = NULL;
+    BIO *b = BIO_new(BIO_s_mem()), *trunc = NULL;
+    unsigned char *der = NULL;
+    int len;
+    int status = 0;
+
+    if (root == NULL || leaf == NULL || basic_crl == NULL
+            || revoked_crl == NULL || b == NULL) {
+        fprintf(stderr, "Failed to parse certificates and CRLs.\n");
+        goto err;
+    }
+
+    /* Other PEM objects between the CRLs are skipped */
+    if (!PEM_write_bio_X509_CRL(b, basic_crl)
+            || !PEM_write_bio_X509(b, root)
+            || !PEM_write_bio_X509_CRL(b, revoked_crl)) {
+        fprintf(stderr, "Failed to write PEM CRLs.\n");
+        goto err;
+    }
+    if ((sbasic = PEM_read_bio_X509_CRL_compact(b, NULL)) == NULL
+            || (srevoked = PEM_read_bio_X509_CRL_compact(b, NULL)) == NULL
+            || !same_CRL(sbasic, basic_crl)
+            || !same_CRL(srevoked, revoked_crl)) {
+        fprintf(stderr, "Streamed PEM CRLs differ.\n");
+        goto err;
+    }
+    if (PEM_read_bio_X509_CRL_compact(b, NULL) != NULL
+            || ERR_GET_REASON(ERR_peek_last_error()) != PEM_R_NO_START_LINE) {
+        fprintf(stderr, "Reading past the last PEM CRL didn't fail.\n");
+        goto err;
+    }
+    ERR_clear_error();
+    if (verify(leaf, root, make_CRL_stack(sbasic, srevoked),
+               X509_V_FLAG_CRL_CHECK) != X509_V_ERR_CERT_REVOKED) {
+        fprintf(stderr, "Revoked streamed CRL wasn't checked.\n");
+        goto err;
+    }
+
+    /* DER, whole and truncated */
+    if (!i2d_X509_CRL_bio(b, revoked_crl)
+            || d2i_X509_CRL_compact_bio(b, &tmp) == NULL
+            || !same_CRL(tmp, revoked_crl)) {
+        fprintf(stderr, "Streamed DER CRL differs.\n");
+        goto err;
+    }
+    if ((len = i2d_X509_CRL(revoked_crl, &der)) <= 0
+            || (trunc = BIO_new_mem_buf(der, len - 1)) == NULL) {
+        fprintf(stderr, "Failed to write truncated CRL.\n");
+        goto err;
+    }
+    if (d2i_X509_CRL_compact_bio(trunc, NULL) != NULL) {
+        fprintf(stderr, "Truncated DER CRL was accepted.\n");
+        goto err;
+    }
+    ERR_clear_error();
+
+    status = 1;
+
+err:
+    BIO_free(b);
+    BIO_free(trunc);
+    OPENSSL_free(der);
+    X509_free(root);
+    X509_free(leaf);
+    X509_CRL_free(basic_crl);
+    X509_CRL_free(revoked_crl);
+    X509_CRL_free(sbasic);
+    X509_CRL_free(srevoked);
+    X509_CRL_free(tmp);
+    return status;
+}
+
 void register_tests(void)
 {
     ADD_TEST(test_crl);
+    ADD_TEST(test_compact_crl);
+    ADD_TEST(test_stream_crl);
 }
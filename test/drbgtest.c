@@ -0,0 +1,193 @@
+/*
+ * Copyright 2017 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the OpenSSL license (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/* Internal tests for the CTR_DRBG of the default RAND method */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include "../crypto/rand/rand_lcl.h"
+#include "testutil.h"
+#include "test_main.h"
+#include "e_os.h"
+
+/*
+ * Known answers for CTR_DRBG with AES-256, no derivation function, no
+ * prediction resistance, nonce, personalization string or additional input,
+ * in the layout of the NIST CAVP response files: the DRBG is instantiated
+ * with EntropyInput, reseeded with EntropyInputReseed if there is one, and
+ * ReturnedBits is the output of the second of two 64 octet requests.
+ */
+static const struct {
+    const char *entropy;
+    const char *entropy_reseed;
+    const char *returned;
+} drbg_kats[] = {
+    {
+        "acc9905d9ce23e1eb7a5a8c917b0b42933bf7a045d72d5d7610382fb59ca9cb0"
+        "cca9f0fd3c42defe5705086977d0d489",
+        NULL,
+        "d2c42381f6f14cdf6ece08177093bcea58fbc6ef7bc04df33a8ccd1aa784a8d7"
+        "a856ef598b9bd71fbeaec4547d63a1a259b9fe4c817e01ea3c80a587a6287e92"
+    },
+    {
+        "7cbb32b930e992d3a20b1af98ef59ed5d2e7965b02395471fe177eed8271deb7"
+        "dc1b9259d0093273026b7a992e557e35",
+        NULL,
+        "7d206d6f5f8efbcd37d2a3f3af521126f5387ab8a6943c3d910105272f60a85c"
+        "b33904ddf66b1bb87a2d78926e80bbd36e72368f71ed565b0040d27beb3af0f8"
+    },
+    {
+        "4c19f411640cfa6869edecdd79ba685d7d0f269ea7fc4f336b1bbe073b141012"
+        "acf954b1c46c9a08c94d4c3d995ac8fd",
+        NULL,
+        "af22baf2c0a8f645445c09d0902de25b6e7038f0ab5800103dea997485bf4425"
+        "c811ba79eace86a7219370511a87ac28694456194c217d4edaf4f51a69c1423f"
+    },
+    {
+        "c46f9a6d58cf46fd70d7c225bc7fb6292827c2194c3ffac9d8dffadd1487e65d"
+        "64cffa0d386fe65d903722851cdfd649",
+        "36e38a15f8db2227eed1da058861121de0bd70895a3f443ba2c7fa97c8f944ef"
+        "16c3aa3598bb42478ef1fa25a841f2fd",
+        "a2b4d2c4163f88ad030a1cf0f47d4b1f1f6bbc061e7fd2b5eee486e093c84292"
+        "3184c784e28130d4340a9872de68d55040716c52902d8bed69dc41ca0b43f3be"
+    },
+    {
+        "f47908cdb48ea6724b3de071c384c4f1cf5fea48f17e395f95dba2abd566ec94"
+        "94d9a86d546e46d2eb9d8011a3246451",
+        "0c340b70990a3dcff4fd2754f55779aabbc7e24eb4d8ca696a8a1f898d0bcee7"
+        "6c142b50b92add2f141dc774d57759ca",
+        "f9ea9992b48ceaa6020e9dbaea526ed04a108600b3dadb7b25b8fda5ef17c28e"
+        "5cdeb45bbc0adc9c77d1ea54794810912a916f06524207c8a63e46f64bb15ab3"
+    },
+    {
+        "b45bfa21c0ed12e7869b820152894e056667ee8f963d4841b247760566c50e6b"
+        "14bb1ac1604db287e6fb22a1f269aee5",
+        "1675bcb38ae1a8a7ded514ab224100b78e0d9413a2c150075ecd4483521178ff"
+        "f6955c93aac18887beb574cb02612097",
+        "6c8464568a76f5b5ee82f8f013873aa1ff91ef03361958d99ea57c71053aae35"
+        "6e0176007edd2fbeef19f25b859a53b10bda14fe01948d430c62100e083625e1"
+    },
+};
+
+#define DRBG_KAT_OUTLEN 64
+
+static int test_drbg_kat(int idx)
+{
+    DRBG_CTX *drbg = NULL;
+    unsigned char *entropy = NULL, *entropy_reseed = NULL, *expected = NULL;
+    unsigned char out[DRBG_KAT_OUTLEN];
+    long len;
+    int ret = 0;
+
+    if ((entropy = OPENSSL_hexstr2buf(drbg_kats[idx].entropy, &len)) == NULL
+            || len != DRBG_SEEDLEN
+            || (drbg_kats[idx].entropy_reseed != NULL
+                && ((entropy_reseed =
+                     OPENSSL_hexstr2buf(drbg_kats[idx].entropy_reseed,
+                                        &len)) == NULL
+                    || len != DRBG_SEEDLEN))
+            || (expected = OPENSSL_hexstr2buf(drbg_kats[idx].returned,
+                                              &len)) == NULL
+            || len != DRBG_KAT_OUTLEN
+            || (drbg = rand_drbg_new()) == NULL)
+        goto end;
+
+    if (!rand_drbg_reseed(drbg, entropy)
+            || (entropy_reseed != NULL
+                && !rand_drbg_reseed(drbg, entropy_reseed))
+            || !rand_drbg_generate(drbg, out, sizeof(out))
+            || !rand_drbg_generate(drbg, out, sizeof(out))) {
+        fprintf(stderr, "DRBG failure in test %d\n", idx);
+        goto end;
+    }
+    if (memcmp(out, expected, sizeof(out)) != 0) {
+        fprintf(stderr, "Unexpected DRBG output in test %d\n", idx);
+        goto end;
+    }
+    ret = 1;
+
+ end:
+    rand_drbg_free(drbg);
+    OPENSSL_free(entropy);
+    OPENSSL_free(entropy_reseed);
+    OPENSSL_free(expected);
+    return ret;
+}
+
+/*
+ * Two DRBGs with the same seed produce the same output, also for requests
+ * that are not a multiple of the block size, and stay in step when both are
+ * reseeded with the same entropy.  A reseed changes the output and mixes the
+ * entropy into the state rather than replacing it.
+ */
+static int test_drbg_reseed(void)
+{
+    DRBG_CTX *a = NULL, *b = NULL, *c = NULL;
+    unsigned char seed[DRBG_SEEDLEN], out_a[100], out_b[100], out_c[100];
+    size_t i;
+    int ret = 0;
+
+    for (i = 0; i < sizeof(seed); i++)
+        seed[i] = (unsigned char)i;
+    if ((a = rand_drbg_new()) == NULL || (b = rand_drbg_new()) == NULL
+            || (c = rand_drbg_new()) == NULL
+            || !rand_drbg_reseed(a, seed) || !rand_drbg_reseed(b, seed)
+            || !rand_drbg_generate(a, out_a, 37)
+            || !rand_drbg_generate(b, out_b, 37))
+        goto end;
+    if (memcmp(out_a, out_b, 37) != 0) {
+        fprintf(stderr, "Equally seeded DRBGs differ\n");
+        goto end;
+    }
+
+    seed[0] ^= 1;
+    if (!rand_drbg_reseed(a, seed) || !rand_drbg_reseed(b, seed)
+            || !rand_drbg_generate(a, out_a, sizeof(out_a))
+            || !rand_drbg_generate(b, out_b, sizeof(out_b)))
+        goto end;
+    if (memcmp(out_a, out_b, sizeof(out_a)) != 0) {
+        fprintf(stderr, "Equally reseeded DRBGs differ\n");
+        goto end;
+    }
+
+    seed[0] ^= 2;
+    if (!rand_drbg_reseed(a, seed)
+            || !rand_drbg_generate(a, out_a, sizeof(out_a))
+            || !rand_drbg_generate(b, out_b, sizeof(out_b)))
+        goto end;
+    if (memcmp(out_a, out_b, sizeof(out_a)) == 0) {
+        fprintf(stderr, "Reseed did not change the output\n");
+        goto end;
+    }
+
+    /* |c| is instantiated with the entropy |a| was last reseeded with */
+    if (!rand_drbg_reseed(c, seed)
+            || !rand_drbg_generate(c, out_c, sizeof(out_c)))
+        goto end;
+    if (memcmp(out_a, out_c, sizeof(out_a)) == 0) {
+        fprintf(stderr, "Reseed replaced the DRBG state\n");
+        goto end;
+    }
+    ret = 1;
+
+ end:
+    rand_drbg_free(a);
+    rand_drbg_free(b);
+    rand_drbg_free(c);
+    return ret;
+}
+
+void register_tests(void)
+{
+    ADD_ALL_TESTS(test_drbg_kat, OSSL_NELEM(drbg_kats));
+    ADD_TEST(test_drbg_reseed);
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2017 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the OpenSSL license (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * Tests for the error queue, see ERR_suppress_start(3), and for the
+ * lookup of error strings.
+ *
+ * When run as "errtest -bench" this also measures the cost of an
+ * ERR_put_error() and ERR_clear_error() pair, and of an error with data
+ * raised while errors are suppressed and while they are not.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <openssl/err.h>
+#include <openssl/crypto.h>
+
+#include "testutil.h"
+#include "test_main_custom.h"
+#include "e_os.h"
+
+#if !defined(OPENSSL_SYS_WINDOWS)
+# include <sys/time.h>
+#endif
+
+static int test_suppress(void)
+{
+    char *data;
+    const char *edata;
+    int flags;
+
+    ERR_clear_error();
+    ERR_put_error(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE, __FILE__, __LINE__);
+
+    /* Errors are queued while suppressed, but no data is attached */
+    if (!ERR_suppress_start() || !ERR_suppress_start()) {
+        printf("Unable to suppress errors\n");
+        return 0;
+    }
+    ERR_put_error(ERR_LIB_X509, 0, ERR_R_INTERNAL_ERROR, __FILE__, __LINE__);
+    ERR_add_error_data(1, "suppressed");
+    if (ERR_peek_last_error()
+            != ERR_PACK(ERR_LIB_X509, 0, ERR_R_INTERNAL_ERROR)) {
+        printf("Error not queued while suppressed\n");
+        return 0;
+    }
+    if (!ERR_suppress_end()) {
+        printf("Unexpected failure of ERR_suppress_end()\n");
+        return 0;
+    }
+    ERR_put_error(ERR_LIB_PEM, 0, ERR_R_PASSED_NULL_PARAMETER, __FILE__,
+                  __LINE__);
+    if ((data = OPENSSL_strdup("suppressed")) == NULL)
+        return 0;
+    ERR_set_error_data(data, ERR_TXT_MALLOCED | ERR_TXT_STRING);
+    if (!ERR_suppress_end() || ERR_suppress_end()) {
+        printf("Unbalanced ERR_suppress_end()\n");
+        return 0;
+    }
+
+    if (ERR_get_error() != ERR_PACK(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE)
+            || ERR_get_error_line_data(NULL, NULL, &edata, &flags)
+               != ERR_PACK(ERR_LIB_X509, 0, ERR_R_INTERNAL_ERROR)
+            || (flags & ERR_TXT_STRING) != 0
+            || ERR_get_error_line_data(NULL, NULL, &edata, &flags)
+               != ERR_PACK(ERR_LIB_PEM, 0, ERR_R_PASSED_NULL_PARAMETER)
+            || (flags & ERR_TXT_STRING) != 0
+            || ERR_get_error() != 0) {
+        printf("Unexpected error queue after suppression\n");
+        return 0;
+    }
+
+    /* Data is attached again once the outermost scope has ended */
+    ERR_put_error(ERR_LIB_X509, 0, ERR_R_INTERNAL_ERROR, __FILE__, __LINE__);
+    ERR_add_error_data(1, "recorded");
+    ERR_peek_last_error_line_data(NULL, NULL, &edata, &flags);
+    if (ERR_peek_last_error()
+            != ERR_PACK(ERR_LIB_X509, 0, ERR_R_INTERNAL_ERROR)
+            || (flags & ERR_TXT_STRING) == 0
+            || strcmp(edata, "recorded") != 0) {
+        printf("Error not recorded after suppression ended\n");
+        return 0;
+    }
+    ERR_clear_error();
+    return 1;
+}
+
+static int test_clear(void)
+{
+    int i;
+
+    ERR_clear_error();
+    /* Wrap around the queue, with data on some of the records */
+    for (i = 0; i < ERR_NUM_ERRORS + 3; i++) {
+        ERR_put_error(ERR_LIB_ASN1, 0, i + 1, __FILE__, __LINE__);
+        if (i % 2 == 0)
+            ERR_add_error_data(1, "data");
+    }
+    if (ERR_get_error() == 0) {
+        printf("Error queue unexpectedly empty\n");
+        return 0;
+    }
+    ERR_clear_error();
+    if (ERR_peek_error() != 0 || ERR_peek_last_error() != 0
+            || ERR_set_mark() != 0) {
+        printf("Error queue not empty after ERR_clear_error()\n");
+        return 0;
+    }
+
+    ERR_put_error(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE, __FILE__, __LINE__);
+    if (ERR_get_error() != ERR_PACK(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE)
+            || ERR_get_error() != 0) {
+        printf("Unexpected error queue after ERR_clear_error()\n");
+        return 0;
+    }
+    return 1;
+}
+
+static ERR_STRING_DATA test_str[] = {
+    {ERR_PACK(0, 1, 0), "test function"},
+    {ERR_PACK(0, 0, 1), "test reason"},
+    {0, NULL}
+};
+
+static int test_strings(void)
+{
+    const char *s;
+    int lib;
+
+    /* Strings of the built-in libraries */
+    if (!OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL))
+        return 0;
+    s = ERR_reason_error_string(ERR_PACK(ERR_LIB_X509, 0,
+                                         ERR_R_MALLOC_FAILURE));
+    if (s == NULL || strcmp(s, "malloc failure") != 0) {
+        printf("Unexpected reason string %s\n", s == NULL ? "(null)" : s);
+        return 0;
+    }
+    s = ERR_lib_error_string(ERR_PACK(ERR_LIB_EVP, 0, 0));
+    if (s == NULL || strcmp(s, "digital envelope routines") != 0) {
+        printf("Unexpected library string %s\n", s == NULL ? "(null)" : s);
+        return 0;
+    }
+
+    /* Strings of a dynamically allocated library can be unloaded */
+    if ((lib = ERR_get_next_error_library()) == 0)
+        return 0;
+    ERR_load_strings(lib, test_str);
+    s = ERR_func_error_string(ERR_PACK(lib, 1, 0));
+    if (s == NULL || strcmp(s, "test function") != 0) {
+        printf("Unexpected function string %s\n", s == NULL ? "(null)" : s);
+        return 0;
+    }
+    s = ERR_reason_error_string(ERR_PACK(lib, 0, 1));
+    if (s == NULL || strcmp(s, "test reason") != 0) {
+        printf("Unexpected reason string %s\n", s == NULL ? "(null)" : s);
+        return 0;
+    }
+    ERR_unload_strings(lib, test_str);
+    if (ERR_func_error_string(ERR_PACK(lib, 1, 0)) != NULL) {
+        printf("Strings still loaded after ERR_unload_strings()\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* A library number below ERR_LIB_USER that no built-in library uses */
+#define TEST_LIB_STATIC         (ERR_LIB_USER - 1)
+
+static ERR_STRING_DATA test_static_str[] = {
+    {ERR_PACK(0, 0, 2), "second reason"},
+    {ERR_PACK(0, 0, 1), "first reason"},
+    {ERR_PACK(0, 0, 2), "duplicate reason"},
+    {0, NULL}
+};
+
+static ERR_STRING_DATA test_static_reload[] = {
+    {ERR_PACK(0, 0, 1), "reloaded reason"},
+    {0, NULL}
+};
+
+static int check_reason(int lib, int reason, const char *expected)
+{
+    const char *s = ERR_reason_error_string(ERR_PACK(lib, 0, reason));
+
+    if (s == NULL || strcmp(s, expected) != 0) {
+        printf("Unexpected reason string %s, expected %s\n",
+               s == NULL ? "(null)" : s, expected);
+        return 0;
+    }
+    return 1;
+}
+
+static int test_static_strings(void)
+{
+    ERR_STRING_DATA saved[OSSL_NELEM(test_static_str)];
+
+    /* The array of the caller is neither sorted nor modified otherwise */
+    memcpy(saved, test_static_str, sizeof(saved));
+    if (!ERR_load_strings(TEST_LIB_STATIC, test_static_str))
+        return 0;
+    if (memcmp(saved, test_static_str, sizeof(saved)) != 0) {
+        printf("ERR_load_strings() modified the string table\n");
+        return 0;
+    }
+
+    /* The string loaded last wins, within a table and across tables */
+    if (!check_reason(TEST_LIB_STATIC, 1, "first reason")
+            || !check_reason(TEST_LIB_STATIC, 2, "duplicate reason"))
+        return 0;
+    if (!ERR_load_strings(TEST_LIB_STATIC, test_static_reload))
+        return 0;
+    if (!check_reason(TEST_LIB_STATIC, 1, "reloaded reason")
+            || !check_reason(TEST_LIB_STATIC, 2, "duplicate reason"))
+        return 0;
+    return 1;
+}
+
+#if !defined(OPENSSL_SYS_WINDOWS)
+# define BENCH_ITERATIONS       10000000
+
+static double bench_elapsed(struct timeval *start)
+{
+    struct timeval end;
+
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start->tv_sec) + (end.tv_usec - start->tv_usec) / 1e6;
+}
+
+static int bench_err(void)
+{
+    struct timeval start;
+    double secs;
+    int i;
+
+    ERR_clear_error();
+    gettimeofday(&start, NULL);
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        ERR_put_error(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE, __FILE__,
+                      __LINE__);
+        ERR_clear_error();
+    }
+    secs = bench_elapsed(&start);
+    printf("ERR_put_error + ERR_clear_error: %.1f ns\n",
+           secs * 1e9 / BENCH_ITERATIONS);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        ERR_put_error(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE, __FILE__,
+                      __LINE__);
+        ERR_add_error_data(2, "Type=", "X509");
+        ERR_clear_error();
+    }
+    secs = bench_elapsed(&start);
+    printf("ERR_put_error + ERR_add_error_data + ERR_clear_error: %.1f ns\n",
+           secs * 1e9 / BENCH_ITERATIONS);
+
+    if (!ERR_suppress_start())
+        return 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        ERR_put_error(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE, __FILE__,
+                      __LINE__);
+        ERR_add_error_data(2, "Type=", "X509");
+        ERR_clear_error();
+    }
+    secs = bench_elapsed(&start);
+    ERR_suppress_end();
+    printf("The same while suppressed: %.1f ns\n",
+           secs * 1e9 / BENCH_ITERATIONS);
+    return 1;
+}
+#endif
+
+int test_main(int argc, char *argv[])
+{
+    if (argc == 2 && strcmp(argv[1], "-bench") == 0) {
+#if !defined(OPENSSL_SYS_WINDOWS)
+        return !bench_err();
+#else
+        printf("The benchmark is not supported on this platform\n");
+        return 1;
+#endif
+    }
+
+    ADD_TEST(test_suppress);
+    ADD_TEST(test_clear);
+    ADD_TEST(test_strings);
+    ADD_TEST(test_static_strings);
+
+    return run_tests(argv[0]);
+}
@@ -358,6 +358,44 @@ static int test_EVP_PKCS82PKEY(void)
 }
 #endif
 
+/* Tests name lookups, and that they see names added or changed later */
+static int test_EVP_get_byname(void)
+{
+    if (EVP_get_cipherbyname("aes128") != EVP_aes_128_cbc()
+            || EVP_get_cipherbyname(SN_aes_128_cbc) != EVP_aes_128_cbc()
+            || EVP_get_cipherbyname(LN_aes_128_cbc) != EVP_aes_128_cbc()
+            || EVP_get_digestbyname(SN_sha256) != EVP_sha256()
+            || EVP_get_digestbyname(SN_sha256WithRSAEncryption)
+               != EVP_sha256()) {
+        fprintf(stderr, "Unexpected result of a built-in name lookup\n");
+        return 0;
+    }
+
+    if (!EVP_add_cipher_alias(SN_aes_256_cbc, "test-alias")
+            || EVP_get_cipherbyname("test-alias") != EVP_aes_256_cbc()) {
+        fprintf(stderr, "Added alias not found\n");
+        return 0;
+    }
+    if (!OBJ_NAME_remove("test-alias", OBJ_NAME_TYPE_CIPHER_METH)
+            || EVP_get_cipherbyname("test-alias") != NULL) {
+        fprintf(stderr, "Removed alias still found\n");
+        return 0;
+    }
+
+    if (!EVP_add_cipher_alias(SN_aes_256_cbc, "aes128")
+            || EVP_get_cipherbyname("aes128") != EVP_aes_256_cbc()) {
+        fprintf(stderr, "Redefined alias not found\n");
+        return 0;
+    }
+    if (!EVP_add_cipher_alias(SN_aes_128_cbc, "aes128")
+            || EVP_get_cipherbyname("aes128") != EVP_aes_128_cbc()
+            || EVP_get_cipherbyname(SN_aes_128_cbc) != EVP_aes_128_cbc()) {
+        fprintf(stderr, "Restored alias not found\n");
+        return 0;
+    }
+    return 1;
+}
+
 int main(void)
 {
     CRYPTO_set_mem_debug(1);
@@ -399,6 +437,11 @@ int main(void)
     }
 #endif
 
+    if (!test_EVP_get_byname()) {
+        fprintf(stderr, "test_EVP_get_byname failed\n");
+        return 1;
+    }
+
 #ifndef OPENSSL_NO_CRYPTO_MDEBUG
     if (CRYPTO_mem_leaks_fp(stderr) <= 0)
         return 1;
@@ -1,5 +1,5 @@
 #! /usr/bin/env perl
-# Copyright 2015-2016 The OpenSSL Project Authors. All Rights Reserved.
+# Copyright 2015-2017 The OpenSSL Project Authors. All Rights Reserved.
 #
 # Licensed under the OpenSSL license (the "License").  You may not use
 # this file except in compliance with the License.  You can obtain a copy
@@ -7,13 +7,19 @@
 # https://www.openssl.org/source/license.html
 
 
+use File::Path 'rmtree';
 use OpenSSL::Test qw/:DEFAULT srctop_file/;
 
 setup("test_verify_extra");
 
 plan tests => 1;
 
+my $dir = "verify_extra_dir";
+rmtree($dir, { safe => 0 });
+mkdir($dir);
+
 ok(run(test(["verify_extra_test",
              srctop_file("test", "certs", "roots.pem"),
              srctop_file("test", "certs", "untrusted.pem"),
-             srctop_file("test", "certs", "bad.pem")])));
+             srctop_file("test", "certs", "bad.pem"),
+             $dir])));
@@ -0,0 +1,20 @@
+#! /usr/bin/env perl
+# Copyright 2017 The OpenSSL Project Authors. All Rights Reserved.
+#
+# Licensed under the OpenSSL license (the "License").  You may not use
+# this file except in compliance with the License.  You can obtain a copy
+# in the file LICENSE in the source distribution or at
+# https://www.openssl.org/source/license.html
+
+use OpenSSL::Test::Utils;
+use OpenSSL::Test qw/:DEFAULT srctop_file/;
+
+setup("test_bio_dgram");
+
+plan skip_all => "No datagram BIO in this OpenSSL build"
+    if disabled("dgram") || disabled("sock");
+
+plan tests => 1;
+
+ok(run(test(["bio_dgram_test", srctop_file("apps", "server.pem"),
+             srctop_file("apps", "server.pem")])), "running bio_dgram_test");
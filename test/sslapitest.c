@@ -14,6 +14,7 @@
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/ocsp.h>
+#include <openssl/err.h>
 
 #include "ssltestlib.h"
 #include "testutil.h"
@@ -1172,6 +1173,976 @@ static int test_session_with_both_cache(void)
     EXECUTE_TEST(execute_test_session, ssl_session_tear_down);
 }
 
+#ifndef OPENSSL_NO_TLS1_2
+# define NUM_SHARDS         8
+# define NUM_SHARD_SESSIONS 64
+
+/*
+ * Test the server side session cache in sharded mode: sessions must still be
+ * resumable, the SSL_CTX_sess_* statistics must cover all shards and the cache
+ * size must be enforced across the shards.
+ */
+static int test_session_cache_shards(void)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    SSL_SESSION *sess = NULL, *tmp;
+    unsigned char sid[SSL_MAX_SSL_SESSION_ID_LENGTH];
+    long full;
+    int testresult = 0, i;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+
+    /* Use session ids rather than tickets so that the server cache is used */
+    SSL_CTX_set_max_proto_version(sctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(sctx, SSL_OP_NO_TICKET);
+    SSL_CTX_sess_set_cache_size(sctx, NUM_SHARDS / 2);
+
+    if (!SSL_CTX_set_session_cache_shards(sctx, NUM_SHARDS)
+            || SSL_CTX_get_session_cache_shards(sctx) != NUM_SHARDS
+            || SSL_CTX_sessions(sctx) != NULL) {
+        printf("Unable to enable session cache sharding\n");
+        goto end;
+    }
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+    sess = SSL_get1_session(clientssl);
+    if (sess == NULL || SSL_CTX_sess_number(sctx) != 1) {
+        printf("Session not added to sharded cache\n");
+        goto end;
+    }
+    SSL_shutdown(clientssl);
+    SSL_shutdown(serverssl);
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    serverssl = clientssl = NULL;
+
+    if (SSL_CTX_set_session_cache_shards(sctx, 1)) {
+        printf("Unexpected success resharding a non-empty cache\n");
+        goto end;
+    }
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !SSL_set_session(clientssl, sess)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create resumed SSL connection\n");
+        goto end;
+    }
+    if (!SSL_session_reused(clientssl) || SSL_CTX_sess_hits(sctx) != 1) {
+        printf("Session not resumed from sharded cache\n");
+        goto end;
+    }
+
+    /* Overflow the cache: every shard may hold one session */
+    for (i = 0; i < NUM_SHARD_SESSIONS; i++) {
+        memset(sid, i + 1, sizeof(sid));
+        if ((tmp = SSL_SESSION_new()) == NULL
+                || !SSL_SESSION_set1_id(tmp, sid, sizeof(sid))
+                || !SSL_CTX_add_session(sctx, tmp)) {
+            SSL_SESSION_free(tmp);
+            printf("Unable to add session to sharded cache\n");
+            goto end;
+        }
+        SSL_SESSION_free(tmp);
+    }
+    if (SSL_CTX_sess_number(sctx) > NUM_SHARDS
+            || SSL_CTX_sess_number(sctx) + SSL_CTX_sess_cache_full(sctx)
+               != NUM_SHARD_SESSIONS + 1) {
+        printf("Sharded cache size not enforced\n");
+        goto end;
+    }
+
+    full = SSL_CTX_sess_cache_full(sctx);
+    SSL_CTX_flush_sessions(sctx, 0);
+    if (SSL_CTX_sess_number(sctx) != 0
+            || !SSL_CTX_set_session_cache_shards(sctx, 1)
+            || SSL_CTX_sessions(sctx) == NULL
+            || SSL_CTX_sess_cache_full(sctx) != full) {
+        printf("Unable to disable session cache sharding\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_SESSION_free(sess);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+#endif
+
+#define NUM_EXPIRY_SESSIONS 16
+
+static SSL_SESSION *expired_sess[NUM_EXPIRY_SESSIONS];
+static int num_expired = 0;
+
+static void expire_session_cb(SSL_CTX *ctx, SSL_SESSION *sess)
+{
+    if (num_expired < NUM_EXPIRY_SESSIONS)
+        expired_sess[num_expired] = sess;
+    num_expired++;
+}
+
+/*
+ * Test that SSL_CTX_expire_sessions() removes expired sessions in order of
+ * their expiry and no more than requested. Test 0 uses a single cache shard,
+ * test 1 a sharded cache.
+ */
+static int test_session_cache_expiry(int idx)
+{
+    SSL_CTX *ctx = NULL;
+    SSL_SESSION *sess[NUM_EXPIRY_SESSIONS];
+    unsigned char sid[SSL_MAX_SSL_SESSION_ID_LENGTH];
+    long now = (long)time(NULL);
+    int testresult = 0, i;
+
+    memset(sess, 0, sizeof(sess));
+    num_expired = 0;
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == NULL
+            || (idx == 1 && !SSL_CTX_set_session_cache_shards(ctx, 4))) {
+        printf("Unable to create SSL_CTX\n");
+        goto end;
+    }
+    SSL_CTX_sess_set_remove_cb(ctx, expire_session_cb);
+
+    /* Session i expires i seconds before |now|, added in random-ish order */
+    for (i = 0; i < NUM_EXPIRY_SESSIONS; i++) {
+        int n = (i * 7) % NUM_EXPIRY_SESSIONS;
+
+        memset(sid, n + 1, sizeof(sid));
+        if ((sess[n] = SSL_SESSION_new()) == NULL
+                || !SSL_SESSION_set1_id(sess[n], sid, sizeof(sid))
+                || !SSL_SESSION_set_time(sess[n], now - 100)
+                || !SSL_SESSION_set_timeout(sess[n], 100 - n - 1)
+                || !SSL_CTX_add_session(ctx, sess[n])) {
+            printf("Unable to add session to cache\n");
+            goto end;
+        }
+    }
+
+    /* Nothing has expired yet */
+    if (SSL_CTX_expire_sessions(ctx, now - NUM_EXPIRY_SESSIONS, 0) != 0) {
+        printf("Unexpected sessions expired\n");
+        goto end;
+    }
+
+    /* Extend the lifetime of the session that would expire first */
+    if (!SSL_SESSION_set_timeout(sess[NUM_EXPIRY_SESSIONS - 1], 1000)) {
+        printf("Unable to set session timeout\n");
+        goto end;
+    }
+
+    if (SSL_CTX_expire_sessions(ctx, now, 4) != 4
+            || SSL_CTX_sess_number(ctx) != NUM_EXPIRY_SESSIONS - 4) {
+        printf("Bounded expiry failed\n");
+        goto end;
+    }
+    /* Within each shard sessions must expire earliest first */
+    for (i = 0; i < num_expired; i++) {
+        if (idx == 0 && expired_sess[i] != sess[NUM_EXPIRY_SESSIONS - 2 - i]) {
+            printf("Sessions not expired in order\n");
+            goto end;
+        }
+    }
+
+    if (SSL_CTX_expire_sessions(ctx, now, 0) != NUM_EXPIRY_SESSIONS - 5
+            || SSL_CTX_sess_number(ctx) != 1
+            || num_expired != NUM_EXPIRY_SESSIONS - 1) {
+        printf("Unbounded expiry failed\n");
+        goto end;
+    }
+    for (i = 0; i < num_expired; i++) {
+        if (expired_sess[i] == sess[NUM_EXPIRY_SESSIONS - 1]) {
+            printf("Session expired despite extended timeout\n");
+            goto end;
+        }
+    }
+
+    testresult = 1;
+
+ end:
+    for (i = 0; i < NUM_EXPIRY_SESSIONS; i++)
+        SSL_SESSION_free(sess[i]);
+    SSL_CTX_free(ctx);
+
+    return testresult;
+}
+
+/*
+ * Test reading application data without copying it out of the record layer.
+ * Test 0 uses the default mode, test 1 uses SSL_MODE_RELEASE_BUFFERS.
+ */
+static int test_zero_copy_read(int idx)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    static const char msg1[] = "Hello", msg2[] = "world!";
+    const unsigned char *data;
+    size_t written, len;
+    int testresult = 0;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+    if (idx == 1)
+        SSL_CTX_set_mode(sctx, SSL_MODE_RELEASE_BUFFERS);
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+
+    /* Each write ends up in a record of its own */
+    if (!SSL_write_ex(clientssl, msg1, strlen(msg1), &written)
+            || !SSL_write_ex(clientssl, msg2, strlen(msg2), &written)) {
+        printf("Failed writing application data\n");
+        goto end;
+    }
+
+    if (!SSL_get0_read_data(serverssl, &data, &len)
+            || len != strlen(msg1) || memcmp(data, msg1, len) != 0) {
+        printf("Unexpected data in first record\n");
+        goto end;
+    }
+
+    /* Without a release we must get the same data again */
+    if (!SSL_get0_read_data(serverssl, &data, &len)
+            || len != strlen(msg1) || memcmp(data, msg1, len) != 0
+            || SSL_pending(serverssl) != (int)len) {
+        printf("Unexpected data when peeking again\n");
+        goto end;
+    }
+
+    /* Partially consume the first record */
+    if (!SSL_release_read_data(serverssl, 2)
+            || !SSL_get0_read_data(serverssl, &data, &len)
+            || len != strlen(msg1) - 2
+            || memcmp(data, msg1 + 2, len) != 0) {
+        printf("Unexpected data after partial release\n");
+        goto end;
+    }
+
+    if (SSL_release_read_data(serverssl, len + 1)) {
+        printf("Unexpected success releasing too much data\n");
+        goto end;
+    }
+    ERR_clear_error();
+
+    if (!SSL_release_read_data(serverssl, len)
+            || !SSL_get0_read_data(serverssl, &data, &len)
+            || len != strlen(msg2) || memcmp(data, msg2, len) != 0
+            || !SSL_release_read_data(serverssl, len)) {
+        printf("Unexpected data in second record\n");
+        goto end;
+    }
+
+    /* Nothing left to read */
+    if (SSL_get0_read_data(serverssl, &data, &len)
+            || SSL_get_error(serverssl, 0) != SSL_ERROR_WANT_READ) {
+        printf("Unexpected data after the last record\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+#ifndef OPENSSL_NO_TLS1_2
+static const char *pipeline_ciphers[] = {
+    "AES128-GCM-SHA256",
+# if !defined(OPENSSL_NO_EC) && !defined(OPENSSL_NO_CHACHA) \
+     && !defined(OPENSSL_NO_POLY1305)
+    "ECDHE-RSA-CHACHA20-POLY1305",
+# endif
+};
+
+static int test_read_pipelining(int idx)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    static const char msg[] = "Hello";
+    unsigned char buf[sizeof(msg)];
+    size_t written, readbytes;
+    int testresult = 0, i;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+
+    if (!SSL_CTX_set_max_proto_version(cctx, TLS1_2_VERSION)
+            || !SSL_CTX_set_cipher_list(cctx, pipeline_ciphers[idx])
+            || !SSL_CTX_set_max_pipelines(sctx, 4)) {
+        printf("Unable to configure SSL_CTX\n");
+        goto end;
+    }
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+
+    /* Queue three records, all of them should be decrypted in one go */
+    for (i = 0; i < 3; i++) {
+        if (!SSL_write_ex(clientssl, msg, sizeof(msg), &written)) {
+            printf("Failed writing application data\n");
+            goto end;
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (!SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+                || readbytes != sizeof(msg)
+                || memcmp(buf, msg, readbytes) != 0) {
+            printf("Failed reading application data\n");
+            goto end;
+        }
+        if ((size_t)SSL_pending(serverssl) != (2 - i) * sizeof(msg)) {
+            printf("Unexpected number of pending bytes\n");
+            goto end;
+        }
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+static int test_large_write(int idx)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    /* Enough for a pack of 8 and one of 4 full records plus a short one */
+    const size_t len = 12 * SSL3_RT_MAX_PLAIN_LENGTH + 1000;
+    unsigned char *msg = NULL, *buf = NULL;
+    size_t written, readbytes, total, i;
+    int testresult = 0;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+
+    msg = OPENSSL_malloc(len);
+    buf = OPENSSL_malloc(len);
+    if (msg == NULL || buf == NULL) {
+        printf("Memory allocation failure\n");
+        goto end;
+    }
+    for (i = 0; i < len; i++)
+        msg[i] = (unsigned char)i;
+
+    if (!SSL_CTX_set_max_proto_version(cctx, TLS1_2_VERSION)
+            || !SSL_CTX_set_cipher_list(cctx, pipeline_ciphers[idx])) {
+        printf("Unable to configure SSL_CTX\n");
+        goto end;
+    }
+    SSL_CTX_set_mode(cctx, SSL_MODE_PACK_RECORDS);
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+
+    if (!SSL_write_ex(clientssl, msg, len, &written) || written != len) {
+        printf("Failed writing application data\n");
+        goto end;
+    }
+
+    for (total = 0; total < len; total += readbytes) {
+        if (!SSL_read_ex(serverssl, buf + total, len - total, &readbytes)) {
+            printf("Failed reading application data\n");
+            goto end;
+        }
+    }
+    if (memcmp(buf, msg, len) != 0) {
+        printf("Unexpected application data\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    OPENSSL_free(msg);
+    OPENSSL_free(buf);
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+#endif
+
+static int test_write_coalescing(void)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    static const char msg[] = "Hello";
+    static const char longmsg[] = "This is a longer message";
+    unsigned char buf[80];
+    size_t written, readbytes;
+    int testresult = 0, i;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+    SSL_CTX_set_mode(cctx, SSL_MODE_COALESCE_WRITES);
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+
+    /* Small writes are held back until flushed */
+    for (i = 0; i < 3; i++) {
+        if (!SSL_write_ex(clientssl, msg, strlen(msg), &written)
+                || written != strlen(msg)) {
+            printf("Failed writing application data\n");
+            goto end;
+        }
+    }
+    if (SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || SSL_get_error(serverssl, 0) != SSL_ERROR_WANT_READ) {
+        printf("Unexpected data before flush\n");
+        goto end;
+    }
+    if (SSL_flush(clientssl) != 1) {
+        printf("Failed flushing application data\n");
+        goto end;
+    }
+    /* All three writes must have been sent in a single record */
+    if (!SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || readbytes != 3 * strlen(msg)
+            || memcmp(buf, "HelloHelloHello", readbytes) != 0) {
+        printf("Unexpected data after flush\n");
+        goto end;
+    }
+
+    /*
+     * With a threshold of 8 the second write sends the first one and a write
+     * of more than 8 bytes sends everything
+     */
+    if (!SSL_set_write_coalesce_threshold(clientssl, 8)
+            || !SSL_write_ex(clientssl, msg, strlen(msg), &written)
+            || !SSL_write_ex(clientssl, msg, strlen(msg), &written)
+            || !SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || readbytes != strlen(msg)
+            || SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || !SSL_write_ex(clientssl, longmsg, strlen(longmsg), &written)
+            || written != strlen(longmsg)
+            || !SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || readbytes != strlen(msg)
+            || !SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || readbytes != strlen(longmsg)
+            || memcmp(buf, longmsg, readbytes) != 0) {
+        printf("Unexpected data with coalescing threshold\n");
+        goto end;
+    }
+
+    /* Shutting down sends any data held back */
+    if (!SSL_write_ex(clientssl, msg, strlen(msg), &written)
+            || SSL_shutdown(clientssl) != 0
+            || !SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+            || readbytes != strlen(msg)
+            || memcmp(buf, msg, readbytes) != 0) {
+        printf("Unexpected data on shutdown\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+/*
+ * SSL_get_error() looks at the error queue, so it must still report an
+ * SSL_ERROR_SSL while errors are suppressed.
+ */
+static int test_get_error_suppressed(void)
+{
+    SSL_CTX *ctx = NULL;
+    SSL *ssl = NULL;
+    int testresult = 0, suppressed = 0;
+
+    if ((ctx = SSL_CTX_new(TLS_method())) == NULL
+            || (ssl = SSL_new(ctx)) == NULL) {
+        printf("Unable to create SSL objects\n");
+        goto end;
+    }
+    ERR_clear_error();
+    if (!ERR_suppress_start())
+        goto end;
+    suppressed = 1;
+
+    /* Neither SSL_set_connect_state() nor SSL_set_accept_state() was called */
+    if (SSL_do_handshake(ssl) != -1
+            || SSL_get_error(ssl, -1) != SSL_ERROR_SSL) {
+        printf("Unexpected SSL_get_error() result while suppressed\n");
+        goto end;
+    }
+
+    testresult = 1;
+ end:
+    if (suppressed)
+        ERR_suppress_end();
+    ERR_clear_error();
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    return testresult;
+}
+
+static int test_buffer_pool(void)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *serverssl = NULL, *clientssl = NULL;
+    static const char msg[] = "Hello";
+    unsigned char buf[sizeof(msg)];
+    size_t written, readbytes;
+    int testresult = 0, i;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+
+    if (SSL_CTX_get_buffer_pool_size(sctx) != 0
+            || SSL_CTX_set_buffer_pool_size(sctx, -1) != 0
+            || SSL_CTX_set_buffer_pool_size(sctx, 4) != 0
+            || SSL_CTX_get_buffer_pool_size(sctx) != 4) {
+        printf("Unexpected buffer pool size\n");
+        goto end;
+    }
+    SSL_CTX_set_mode(sctx, SSL_MODE_RELEASE_BUFFERS);
+
+    for (i = 0; i < 2; i++) {
+        if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL,
+                                NULL)
+                || !create_ssl_connection(serverssl, clientssl,
+                                          SSL_ERROR_NONE)) {
+            printf("Unable to create SSL connection\n");
+            goto end;
+        }
+
+        if (!SSL_write_ex(clientssl, msg, sizeof(msg), &written)
+                || !SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes)
+                || readbytes != sizeof(msg)
+                || memcmp(buf, msg, readbytes) != 0
+                || !SSL_write_ex(serverssl, msg, sizeof(msg), &written)
+                || !SSL_read_ex(clientssl, buf, sizeof(buf), &readbytes)
+                || readbytes != sizeof(msg)) {
+            printf("Failed exchanging application data\n");
+            goto end;
+        }
+
+        SSL_free(serverssl);
+        SSL_free(clientssl);
+        serverssl = clientssl = NULL;
+
+        /* The second connection must be served from the pool */
+        if (i == 0 && SSL_CTX_buffer_pool_misses(sctx) == 0) {
+            printf("Expected buffer pool misses\n");
+            goto end;
+        }
+    }
+
+    if (SSL_CTX_buffer_pool_hits(sctx) == 0) {
+        printf("Expected buffer pool hits\n");
+        goto end;
+    }
+
+    /* The client SSL_CTX does not pool buffers */
+    if (SSL_CTX_buffer_pool_hits(cctx) != 0
+            || SSL_CTX_buffer_pool_misses(cctx) != 0) {
+        printf("Unexpected buffer pool use\n");
+        goto end;
+    }
+
+    if (SSL_CTX_set_buffer_pool_size(sctx, 0) != 4
+            || SSL_CTX_get_buffer_pool_size(sctx) != 0) {
+        printf("Unable to disable the buffer pool\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+/*
+ * Connect using |sess|, if not NULL, and check whether it was resumed as
+ * |expect_reuse| says. On success the new session of the client is returned
+ * in |*newsess|.
+ */
+static int ticket_connect(SSL_CTX *sctx, SSL_CTX *cctx, SSL_SESSION *sess,
+                          int expect_reuse, SSL_SESSION **newsess)
+{
+    SSL *serverssl = NULL, *clientssl = NULL;
+    int ret = 0;
+
+    *newsess = NULL;
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || (sess != NULL && !SSL_set_session(clientssl, sess))
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+    if (SSL_session_reused(clientssl) != expect_reuse) {
+        printf("Session %sresumed unexpectedly\n", expect_reuse ? "not " : "");
+        goto end;
+    }
+    *newsess = SSL_get1_session(clientssl);
+    if (*newsess == NULL || !SSL_SESSION_has_ticket(*newsess)) {
+        printf("No session ticket\n");
+        goto end;
+    }
+    SSL_shutdown(clientssl);
+    SSL_shutdown(serverssl);
+    ret = 1;
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    return ret;
+}
+
+/* Check that the ticket of |sess| is encrypted with the key called |name| */
+static int ticket_key_is(SSL_SESSION *sess, const unsigned char *name)
+{
+    const unsigned char *tick;
+    size_t ticklen;
+
+    SSL_SESSION_get0_ticket(sess, &tick, &ticklen);
+    return ticklen > 16 && memcmp(tick, name, 16) == 0;
+}
+
+static int test_ticket_key_rotation(void)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL_SESSION *sess1 = NULL, *sess2 = NULL, *sess3 = NULL, *tmp = NULL;
+    unsigned char keys[80], staged[80];
+    int testresult = 0;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+    /* Only resume from tickets */
+    SSL_CTX_set_session_cache_mode(sctx, SSL_SESS_CACHE_OFF);
+
+    if (SSL_CTX_get_ticket_key_ring_size(sctx) != 4
+            || SSL_CTX_set_ticket_key_ring_size(sctx, -1)
+            || SSL_CTX_rotate_ticket_keys(sctx, keys, sizeof(keys) - 1)
+            || SSL_CTX_add_ticket_key(sctx, keys, sizeof(keys) - 1)) {
+        printf("Unexpected ticket key ring parameter handling\n");
+        goto end;
+    }
+    ERR_clear_error();
+
+    if (!ticket_connect(sctx, cctx, NULL, 0, &sess1))
+        goto end;
+
+    /* Tickets encrypted with the previous key are accepted and renewed */
+    if (!SSL_CTX_rotate_ticket_keys(sctx, NULL, 0)
+            || !SSL_CTX_get_tlsext_ticket_keys(sctx, keys, sizeof(keys))
+            || !ticket_connect(sctx, cctx, sess1, 1, &sess2)
+            || !ticket_key_is(sess2, keys)) {
+        printf("Ticket not renewed after key rotation\n");
+        goto end;
+    }
+    /* A ticket encrypted with the current key is not renewed */
+    if (!ticket_connect(sctx, cctx, sess2, 1, &tmp)
+            || tmp != sess2) {
+        printf("Ticket unexpectedly renewed\n");
+        goto end;
+    }
+    SSL_SESSION_free(tmp);
+    tmp = NULL;
+
+    /* A key added in advance is accepted before and after rotating to it */
+    memset(staged, 0x5a, sizeof(staged));
+    if (!SSL_CTX_add_ticket_key(sctx, staged, sizeof(staged))
+            || SSL_CTX_add_ticket_key(sctx, keys, sizeof(keys))) {
+        printf("Unable to add a ticket key\n");
+        goto end;
+    }
+    ERR_clear_error();
+    if (!SSL_CTX_rotate_ticket_keys(sctx, staged, sizeof(staged))
+            || !ticket_connect(sctx, cctx, sess2, 1, &sess3)
+            || !ticket_key_is(sess3, staged)
+            || !ticket_connect(sctx, cctx, sess1, 1, &tmp)) {
+        printf("Unable to resume with an earlier ticket key\n");
+        goto end;
+    }
+    SSL_SESSION_free(tmp);
+    tmp = NULL;
+
+    /* Removed keys are no longer accepted */
+    if (!SSL_CTX_remove_ticket_key(sctx, keys)
+            || SSL_CTX_remove_ticket_key(sctx, keys)
+            || SSL_CTX_remove_ticket_key(sctx, staged)
+            || !ticket_connect(sctx, cctx, sess2, 0, &tmp)) {
+        printf("Unexpected resumption with a removed key\n");
+        goto end;
+    }
+    SSL_SESSION_free(tmp);
+    tmp = NULL;
+
+    /* Without a ring tickets of earlier keys are rejected */
+    if (!SSL_CTX_set_ticket_key_ring_size(sctx, 0)
+            || SSL_CTX_get_ticket_key_ring_size(sctx) != 0
+            || SSL_CTX_add_ticket_key(sctx, keys, sizeof(keys))) {
+        printf("Unable to disable the ticket key ring\n");
+        goto end;
+    }
+    ERR_clear_error();
+    if (!ticket_connect(sctx, cctx, sess1, 0, &tmp)) {
+        printf("Unexpected resumption without a key ring\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_SESSION_free(sess1);
+    SSL_SESSION_free(sess2);
+    SSL_SESSION_free(sess3);
+    SSL_SESSION_free(tmp);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+/*
+ * Connect with the client session cache peer |host| and |port|, the SNI name
+ * |sni| and the ALPN protocols |alpn| and check whether the session has been
+ * resumed. The session of the connection is returned in |sess| if not NULL.
+ */
+static int cache_connect(SSL_CTX *sctx, SSL_CTX *cctx, const char *host,
+                         unsigned short port, const char *sni,
+                         const char *alpn, int expect_reuse,
+                         SSL_SESSION **sess)
+{
+    SSL *serverssl = NULL, *clientssl = NULL;
+    int ret = 0;
+
+    if (!create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL, NULL)
+            || !SSL_set1_client_cache_peer(clientssl, host, port)
+            || (sni != NULL && !SSL_set_tlsext_host_name(clientssl, sni))
+            || (alpn != NULL
+                && SSL_set_alpn_protos(clientssl, (const unsigned char *)alpn,
+                                       strlen(alpn)) != 0)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)) {
+        printf("Unable to create SSL connection\n");
+        goto end;
+    }
+    if (SSL_session_reused(clientssl) != expect_reuse) {
+        printf("Session to %s:%u %sresumed unexpectedly\n",
+               host != NULL ? host : sni, port, expect_reuse ? "not " : "");
+        goto end;
+    }
+    if (sess != NULL)
+        *sess = SSL_get1_session(clientssl);
+    SSL_shutdown(clientssl);
+    SSL_shutdown(serverssl);
+    ret = 1;
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    return ret;
+}
+
+static int test_client_session_cache(void)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL *ssl = NULL, *serverssl = NULL, *clientssl = NULL;
+    SSL_SESSION *sess = NULL;
+    int testresult = 0;
+
+    if (!create_ssl_ctx_pair(TLS_server_method(), TLS_client_method(), &sctx,
+                             &cctx, cert, privkey)) {
+        printf("Unable to create SSL_CTX pair\n");
+        return 0;
+    }
+
+    SSL_CTX_set_session_cache_mode(cctx, SSL_SESS_CACHE_CLIENT_AUTO);
+    if (SSL_CTX_get_session_cache_mode(cctx) != SSL_SESS_CACHE_CLIENT_AUTO) {
+        printf("Unable to enable the client session cache\n");
+        goto end;
+    }
+
+    /* Sessions are offered again to the same peer only */
+    if (!cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 1, NULL)
+            || !cache_connect(sctx, cctx, "a.test", 8443, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, "b.test", 443, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, "a.test", NULL, 0,
+                              NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, NULL, "\x02h2", 0,
+                              NULL)
+            || !cache_connect(sctx, cctx, "a.test", 8443, NULL, NULL, 1, NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, "a.test", NULL, 1,
+                              NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, NULL, "\x02h2", 1,
+                              NULL)) {
+        printf("Unexpected client session cache lookup\n");
+        goto end;
+    }
+
+    /* Without a host or SNI name nothing is cached, with SNI only it is */
+    if (!cache_connect(sctx, cctx, NULL, 0, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, NULL, 0, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, NULL, 0, "c.test", NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, NULL, 0, "c.test", NULL, 1, NULL)) {
+        printf("Unexpected client session cache lookup without a host\n");
+        goto end;
+    }
+
+    /* The peer is copied by SSL_dup() */
+    if ((ssl = SSL_new(cctx)) == NULL
+            || !SSL_set1_client_cache_peer(ssl, "a.test", 443)
+            || (clientssl = SSL_dup(ssl)) == NULL
+            || clientssl == ssl
+            || !create_ssl_objects(sctx, cctx, &serverssl, &clientssl, NULL,
+                                   NULL)
+            || !create_ssl_connection(serverssl, clientssl, SSL_ERROR_NONE)
+            || !SSL_session_reused(clientssl)) {
+        printf("Client session cache peer not copied by SSL_dup()\n");
+        goto end;
+    }
+    SSL_shutdown(clientssl);
+    SSL_shutdown(serverssl);
+
+    /* A session that has been removed is no longer offered */
+    if (!cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 1, &sess)) {
+        printf("Unable to get a cached session\n");
+        goto end;
+    }
+    SSL_CTX_remove_session(cctx, sess);
+    if (!cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 1,
+                              NULL)) {
+        printf("Removed session offered again\n");
+        goto end;
+    }
+
+    /* Nor is one that has been flushed from the cache */
+    SSL_CTX_flush_sessions(cctx, 0);
+    if (!cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 0, NULL)
+            || !cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 1,
+                              NULL)) {
+        printf("Flushed session offered again\n");
+        goto end;
+    }
+
+    /* Sessions are cached for the lifetime of the SSL_CTX only */
+    SSL_CTX_free(cctx);
+    cctx = SSL_CTX_new(TLS_client_method());
+    if (cctx == NULL
+            || !cache_connect(sctx, cctx, "a.test", 443, NULL, NULL, 0,
+                              NULL)) {
+        printf("Unexpected resumption without a client session cache\n");
+        goto end;
+    }
+
+    testresult = 1;
+
+ end:
+    SSL_free(ssl);
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_SESSION_free(sess);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+/* More than the usual limit of 1024 thread local keys per process */
+#define CLIENT_CACHE_NUM_CTX    1100
+
+/*
+ * The client session caches of all SSL_CTXs share a single thread local
+ * key, so enabling many of them at once must not fail.
+ */
+static int test_client_session_cache_many(void)
+{
+    SSL_CTX **ctxs;
+    int i, testresult = 0;
+
+    if ((ctxs = OPENSSL_zalloc(CLIENT_CACHE_NUM_CTX * sizeof(*ctxs))) == NULL)
+        return 0;
+    for (i = 0; i < CLIENT_CACHE_NUM_CTX; i++) {
+        if ((ctxs[i] = SSL_CTX_new(TLS_client_method())) == NULL) {
+            printf("Failed to allocate SSL_CTX\n");
+            goto end;
+        }
+        SSL_CTX_set_session_cache_mode(ctxs[i], SSL_SESS_CACHE_CLIENT_AUTO);
+        if (SSL_CTX_get_session_cache_mode(ctxs[i])
+                != SSL_SESS_CACHE_CLIENT_AUTO) {
+            printf("Unable to enable client session cache %d\n", i);
+            goto end;
+        }
+    }
+    testresult = 1;
+
+ end:
+    for (i = 0; i < CLIENT_CACHE_NUM_CTX; i++)
+        SSL_CTX_free(ctxs[i]);
+    OPENSSL_free(ctxs);
+    return testresult;
+}
+
 #define USE_NULL    0
 #define USE_BIO_1   1
 #define USE_BIO_2   2
@@ -2206,6 +3177,21 @@ int test_main(int argc, char *argv[])
     ADD_TEST(test_session_with_only_int_cache);
     ADD_TEST(test_session_with_only_ext_cache);
     ADD_TEST(test_session_with_both_cache);
+#ifndef OPENSSL_NO_TLS1_2
+    ADD_TEST(test_session_cache_shards);
+#endif
+    ADD_ALL_TESTS(test_session_cache_expiry, 2);
+    ADD_ALL_TESTS(test_zero_copy_read, 2);
+#ifndef OPENSSL_NO_TLS1_2
+    ADD_ALL_TESTS(test_read_pipelining, OSSL_NELEM(pipeline_ciphers));
+    ADD_ALL_TESTS(test_large_write, OSSL_NELEM(pipeline_ciphers));
+#endif
+    ADD_TEST(test_get_error_suppressed);
+    ADD_TEST(test_buffer_pool);
+    ADD_TEST(test_ticket_key_rotation);
+    ADD_TEST(test_client_session_cache);
+    ADD_TEST(test_client_session_cache_many);
+    ADD_TEST(test_write_coalescing);
     ADD_ALL_TESTS(test_ssl_set_bio, TOTAL_SSL_SET_BIO_TESTS);
     ADD_TEST(test_ssl_bio_pop_next_bio);
     ADD_TEST(test_ssl_bio_pop_ssl_bio);
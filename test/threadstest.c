@@ -12,8 +12,10 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 
 #include <openssl/crypto.h>
+#include <openssl/rand.h>
 
 #if !defined(OPENSSL_THREADS) || defined(CRYPTO_TDEBUG)
 
@@ -230,6 +232,83 @@ static int test_thread_local(void)
     return 1;
 }
 
+#define RAND_THREADS    4
+#define RAND_CALLS      50
+
+static CRYPTO_RWLOCK *rand_lock = NULL;
+static int rand_thread_index = 0;
+static int rand_thread_ok[RAND_THREADS + 1];
+static unsigned char rand_out[RAND_THREADS + 1][RAND_CALLS][16];
+
+/*
+ * Each thread, the main one included, alternates small and large requests
+ * and adds seed material now and then, which makes all per thread DRBGs
+ * reseed from the shared master.
+ */
+static void rand_thread_cb(void)
+{
+    unsigned char large[1000];
+    int idx, i;
+
+    if (!CRYPTO_atomic_add(&rand_thread_index, 1, &idx, rand_lock))
+        return;
+    idx--;
+    for (i = 0; i < RAND_CALLS; i++) {
+        if (RAND_bytes(rand_out[idx][i], sizeof(rand_out[idx][i])) != 1
+                || RAND_bytes(large, sizeof(large)) != 1)
+            return;
+        if (i % 10 == 0)
+            RAND_seed(&i, sizeof(i));
+    }
+    rand_thread_ok[idx] = 1;
+}
+
+static int test_rand_threads(void)
+{
+    thread_t threads[RAND_THREADS];
+    int i, j, k, l;
+
+    if ((rand_lock = CRYPTO_THREAD_lock_new()) == NULL) {
+        fprintf(stderr, "CRYPTO_THREAD_lock_new() failed\n");
+        return 0;
+    }
+
+    for (i = 0; i < RAND_THREADS; i++) {
+        if (!run_thread(&threads[i], rand_thread_cb)) {
+            fprintf(stderr, "run_thread() failed\n");
+            return 0;
+        }
+    }
+    rand_thread_cb();
+    for (i = 0; i < RAND_THREADS; i++) {
+        if (!wait_for_thread(threads[i])) {
+            fprintf(stderr, "wait_for_thread() failed\n");
+            return 0;
+        }
+    }
+    CRYPTO_THREAD_lock_free(rand_lock);
+
+    for (i = 0; i <= RAND_THREADS; i++) {
+        if (!rand_thread_ok[i]) {
+            fprintf(stderr, "RAND_bytes() failed in thread %d\n", i);
+            return 0;
+        }
+    }
+
+    /* No two requests, in the same thread or not, return the same octets */
+    for (i = 0; i <= RAND_THREADS; i++)
+        for (j = 0; j < RAND_CALLS; j++)
+            for (k = i; k <= RAND_THREADS; k++)
+                for (l = k == i ? j + 1 : 0; l < RAND_CALLS; l++)
+                    if (memcmp(rand_out[i][j], rand_out[k][l],
+                               sizeof(rand_out[i][j])) == 0) {
+                        fprintf(stderr, "RAND_bytes() repeated its output\n");
+                        return 0;
+                    }
+
+    return 1;
+}
+
 int main(int argc, char **argv)
 {
     if (!test_lock())
@@ -241,6 +320,9 @@ int main(int argc, char **argv)
     if (!test_thread_local())
       return 1;
 
+    if (!test_rand_threads())
+      return 1;
+
     printf("PASS\n");
     return 0;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright 2015-2016 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2015-2017 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the OpenSSL license (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -12,6 +12,8 @@
 #include <openssl/bio.h>
 #include <openssl/x509.h>
 #include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/dsa.h>
 #include <openssl/err.h>
 
 static STACK_OF(X509) *load_certs_from_file(const char *filename)
@@ -137,13 +139,635 @@ static int test_alt_chains_cert_forgery(const char *roots_f,
     return ret;
 }
 
+/*
+ * Test the lookup of objects in an X509_STORE by name: |roots_f| and
+ * |untrusted_f| contain two different certificates with the subject
+ * subinterCA, the certificate leaf is in |untrusted_f| only.
+ */
+static int test_store_lookup(const char *roots_f, const char *untrusted_f)
+{
+    int ret = 0;
+    X509 *issuer = NULL, *leaf;
+    STACK_OF(X509) *untrusted = NULL, *certs = NULL;
+    X509_STORE_CTX *sctx = NULL;
+    X509_STORE *store = NULL;
+    X509_LOOKUP *lookup = NULL;
+
+    store = X509_STORE_new();
+    if (store == NULL)
+        goto err;
+
+    lookup = X509_STORE_add_lookup(store, X509_LOOKUP_file());
+    if (lookup == NULL)
+        goto err;
+    if (!X509_LOOKUP_load_file(lookup, roots_f, X509_FILETYPE_PEM))
+        goto err;
+
+    untrusted = load_certs_from_file(untrusted_f);
+    if (untrusted == NULL || sk_X509_num(untrusted) != 2)
+        goto err;
+    leaf = sk_X509_value(untrusted, 1);
+
+    /* A certificate can only be added once */
+    if (!X509_STORE_add_cert(store, sk_X509_value(untrusted, 0))
+            || X509_STORE_add_cert(store, sk_X509_value(untrusted, 0))
+            || sk_X509_OBJECT_num(X509_STORE_get0_objects(store)) != 3) {
+        fprintf(stderr, "Duplicate certificate added to the store\n");
+        goto err;
+    }
+    ERR_clear_error();
+
+    sctx = X509_STORE_CTX_new();
+    if (sctx == NULL || !X509_STORE_CTX_init(sctx, store, leaf, NULL))
+        goto err;
+
+    certs = X509_STORE_CTX_get1_certs(sctx, X509_get_issuer_name(leaf));
+    if (certs == NULL || sk_X509_num(certs) != 2) {
+        fprintf(stderr, "Certificates with the same subject not found\n");
+        goto err;
+    }
+    sk_X509_pop_free(certs, X509_free);
+    certs = X509_STORE_CTX_get1_certs(sctx, X509_get_subject_name(leaf));
+    if (certs != NULL) {
+        fprintf(stderr, "Certificate not in the store found\n");
+        goto err;
+    }
+
+    if (X509_STORE_CTX_get1_issuer(&issuer, sctx, leaf) != 1
+            || X509_NAME_cmp(X509_get_subject_name(issuer),
+                             X509_get_issuer_name(leaf)) != 0) {
+        fprintf(stderr, "Issuer not found in the store\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    X509_free(issuer);
+    sk_X509_pop_free(certs, X509_free);
+    X509_STORE_CTX_free(sctx);
+    sk_X509_pop_free(untrusted, X509_free);
+    X509_STORE_free(store);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+
+/*
+ * X509_load_cert_file() finds the end of a PEM file by peeking at the error
+ * raised for the missing start line, which must still be queued while errors
+ * are suppressed.
+ */
+static int test_load_suppressed(const char *roots_f)
+{
+    int ret = 0, suppressed = 0;
+    X509_STORE *store = NULL;
+    X509_LOOKUP *lookup;
+
+    store = X509_STORE_new();
+    if (store == NULL
+            || (lookup = X509_STORE_add_lookup(store,
+                                               X509_LOOKUP_file())) == NULL
+            || !ERR_suppress_start())
+        goto err;
+    suppressed = 1;
+
+    ERR_put_error(ERR_LIB_ASN1, 0, ERR_R_MALLOC_FAILURE, __FILE__, __LINE__);
+    if (X509_load_cert_file(lookup, roots_f, X509_FILETYPE_PEM) <= 0) {
+        fprintf(stderr, "Loading certificates failed while suppressed\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    if (suppressed)
+        ERR_suppress_end();
+    ERR_clear_error();
+    X509_STORE_free(store);
+    return ret;
+}
+
+/*
+ * Test the snapshot of the directory listing kept by the hashed directory
+ * lookup: the issuer of the leaf in |untrusted_f| is added to the empty
+ * directory |dir| after a failed lookup, and only found once the snapshot is
+ * no longer used.
+ */
+static int test_dir_cache(const char *untrusted_f, const char *dir)
+{
+    int ret = 0;
+    X509 *issuer = NULL, *leaf;
+    STACK_OF(X509) *untrusted = NULL;
+    X509_STORE_CTX *sctx = NULL;
+    X509_STORE *store = NULL;
+    X509_LOOKUP *lookup = NULL;
+    BIO *bio = NULL;
+    char path[1024];
+
+    untrusted = load_certs_from_file(untrusted_f);
+    if (untrusted == NULL || sk_X509_num(untrusted) != 2)
+        goto err;
+    leaf = sk_X509_value(untrusted, 1);
+
+    store = X509_STORE_new();
+    if (store == NULL)
+        goto err;
+    lookup = X509_STORE_add_lookup(store, X509_LOOKUP_hash_dir());
+    if (lookup == NULL
+            || !X509_LOOKUP_add_dir(lookup, dir, X509_FILETYPE_PEM)
+            || !X509_LOOKUP_set_dir_cache_ttl(lookup, 3600))
+        goto err;
+    sctx = X509_STORE_CTX_new();
+    if (sctx == NULL || !X509_STORE_CTX_init(sctx, store, leaf, NULL))
+        goto err;
+
+    if (X509_STORE_CTX_get1_issuer(&issuer, sctx, leaf) != 0) {
+        fprintf(stderr, "Issuer found in an empty directory\n");
+        goto err;
+    }
+
+    BIO_snprintf(path, sizeof(path), "%s/%08lx.0", dir,
+                 X509_NAME_hash(X509_get_issuer_name(leaf)));
+    if ((bio = BIO_new_file(path, "w")) == NULL
+            || !PEM_write_bio_X509(bio, sk_X509_value(untrusted, 0)))
+        goto err;
+    BIO_free(bio);
+    bio = NULL;
+
+    if (X509_STORE_CTX_get1_issuer(&issuer, sctx, leaf) != 0) {
+        fprintf(stderr, "Directory snapshot not used\n");
+        goto err;
+    }
+    if (!X509_LOOKUP_set_dir_cache_ttl(lookup, 0)
+            || X509_STORE_CTX_get1_issuer(&issuer, sctx, leaf) != 1) {
+        fprintf(stderr, "Issuer not found in the directory\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    BIO_free(bio);
+    X509_free(issuer);
+    X509_STORE_CTX_free(sctx);
+    sk_X509_pop_free(untrusted, X509_free);
+    X509_STORE_free(store);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+
+/*
+ * Verify the leaf in |untrusted| and set |*issuer| to the certificate that
+ * ends up in the chain as its issuer.
+ */
+static int cache_verify(X509_STORE *store, STACK_OF(X509) *untrusted,
+                        unsigned long flags, const char *host, X509 **issuer)
+{
+    int ret = -1;
+    X509_STORE_CTX *sctx = NULL;
+
+    *issuer = NULL;
+    sctx = X509_STORE_CTX_new();
+    if (sctx == NULL
+            || !X509_STORE_CTX_init(sctx, store, sk_X509_value(untrusted, 1),
+                                    untrusted))
+        goto err;
+    X509_VERIFY_PARAM_set_flags(X509_STORE_CTX_get0_param(sctx), flags);
+    if (host != NULL
+            && !X509_VERIFY_PARAM_set1_host(X509_STORE_CTX_get0_param(sctx),
+                                            host, 0))
+        goto err;
+
+    ret = X509_verify_cert(sctx);
+    if (ret > 0)
+        *issuer = sk_X509_value(X509_STORE_CTX_get0_chain(sctx), 1);
+ err:
+    X509_STORE_CTX_free(sctx);
+    return ret;
+}
+
+/*
+ * Test the verified chain cache of an X509_STORE.  The leaf in |untrusted_f|
+ * is verified with two different copies of its untrusted issuer: the issuer
+ * in the chain tells whether the chain was built or taken from the cache.
+ */
+static int test_verify_cache(const char *roots_f, const char *untrusted_f)
+{
+    int ret = 0;
+    X509 *issuer, *issuer1, *issuer2;
+    STACK_OF(X509) *roots = NULL, *untrusted1 = NULL, *untrusted2 = NULL;
+    X509_STORE *store = NULL;
+
+    /*
+     * Only trust interCA, the self-signed subinterCA in |roots_f| would
+     * otherwise be preferred to the one in |untrusted_f|.
+     */
+    roots = load_certs_from_file(roots_f);
+    store = X509_STORE_new();
+    if (roots == NULL || store == NULL
+            || !X509_STORE_add_cert(store, sk_X509_value(roots, 0))
+            || !X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN)
+            || !X509_STORE_set_verify_cache_size(store, 16))
+        goto err;
+
+    untrusted1 = load_certs_from_file(untrusted_f);
+    untrusted2 = load_certs_from_file(untrusted_f);
+    if (untrusted1 == NULL || sk_X509_num(untrusted1) != 2
+            || untrusted2 == NULL || sk_X509_num(untrusted2) != 2)
+        goto err;
+    issuer1 = sk_X509_value(untrusted1, 0);
+    issuer2 = sk_X509_value(untrusted2, 0);
+
+    if (cache_verify(store, untrusted1, 0, NULL, &issuer) != 1
+            || issuer != issuer1) {
+        fprintf(stderr, "Verification failed\n");
+        goto err;
+    }
+    if (cache_verify(store, untrusted2, 0, NULL, &issuer) != 1
+            || issuer != issuer1) {
+        fprintf(stderr, "Cached chain not used\n");
+        goto err;
+    }
+    if (cache_verify(store, untrusted2, 0, "example.com", &issuer) != 0) {
+        fprintf(stderr, "Host name not checked for a cached chain\n");
+        goto err;
+    }
+    if (cache_verify(store, untrusted2, X509_V_FLAG_CHECK_SS_SIGNATURE,
+                     NULL, &issuer) != 1
+            || issuer != issuer2) {
+        fprintf(stderr, "Cached chain used with different flags\n");
+        goto err;
+    }
+
+    X509_STORE_flush_verify_cache(store);
+    if (cache_verify(store, untrusted2, 0, NULL, &issuer) != 1
+            || issuer != issuer2
+            || cache_verify(store, untrusted1, 0, NULL, &issuer) != 1
+            || issuer != issuer2) {
+        fprintf(stderr, "Cache not flushed\n");
+        goto err;
+    }
+
+    if (!X509_STORE_set_verify_cache_size(store, 0)
+            || cache_verify(store, untrusted1, 0, NULL, &issuer) != 1
+            || issuer != issuer1) {
+        fprintf(stderr, "Cache not disabled\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    sk_X509_pop_free(roots, X509_free);
+    sk_X509_pop_free(untrusted1, X509_free);
+    sk_X509_pop_free(untrusted2, X509_free);
+    X509_STORE_free(store);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+
+/*
+ * Test that a signature remembered as good is checked again once the
+ * certificate is signed by a different key.
+ */
+static int test_signature_memo(const char *roots_f, const char *untrusted_f)
+{
+    int ret = 0;
+    STACK_OF(X509) *roots = NULL, *untrusted = NULL;
+    X509_STORE *store = NULL;
+    X509_STORE_CTX *sctx = NULL;
+    EVP_PKEY_CTX *kctx = NULL;
+    EVP_PKEY *pkey = NULL;
+    X509 *leaf;
+
+    roots = load_certs_from_file(roots_f);
+    untrusted = load_certs_from_file(untrusted_f);
+    store = X509_STORE_new();
+    if (roots == NULL || untrusted == NULL || sk_X509_num(untrusted) != 2
+            || store == NULL
+            || !X509_STORE_add_cert(store, sk_X509_value(roots, 0))
+            || !X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN))
+        goto err;
+    leaf = sk_X509_value(untrusted, 1);
+
+    sctx = X509_STORE_CTX_new();
+    if (sctx == NULL
+            || !X509_STORE_CTX_init(sctx, store, leaf, untrusted)
+            || X509_verify_cert(sctx) != 1) {
+        fprintf(stderr, "Verification failed\n");
+        goto err;
+    }
+    X509_STORE_CTX_cleanup(sctx);
+
+    kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    if (kctx == NULL
+            || EVP_PKEY_keygen_init(kctx) <= 0
+            || EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 1024) <= 0
+            || EVP_PKEY_keygen(kctx, &pkey) <= 0
+            || !X509_sign(leaf, pkey, EVP_sha256()))
+        goto err;
+
+    if (!X509_STORE_CTX_init(sctx, store, leaf, untrusted)
+            || X509_verify_cert(sctx) != 0
+            || X509_STORE_CTX_get_error(sctx)
+               != X509_V_ERR_CERT_SIGNATURE_FAILURE) {
+        fprintf(stderr, "Signature of a re-signed certificate not checked\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    EVP_PKEY_free(pkey);
+    EVP_PKEY_CTX_free(kctx);
+    X509_STORE_CTX_free(sctx);
+    sk_X509_pop_free(roots, X509_free);
+    sk_X509_pop_free(untrusted, X509_free);
+    X509_STORE_free(store);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+
+/* Verify |leaf| and return 1 if the result and error are as expected */
+static int verify_expect(X509_STORE *store, X509 *leaf,
+                         STACK_OF(X509) *untrusted, int expect_ok,
+                         int expect_err)
+{
+    X509_STORE_CTX *sctx = X509_STORE_CTX_new();
+    int ret = 0;
+
+    if (sctx != NULL && X509_STORE_CTX_init(sctx, store, leaf, untrusted))
+        ret = X509_verify_cert(sctx) == expect_ok
+              && X509_STORE_CTX_get_error(sctx) == expect_err;
+    X509_STORE_CTX_free(sctx);
+    return ret;
+}
+
+/*
+ * Test that changes to the validity period of a decoded certificate are
+ * taken into account, both through X509_set1_notAfter() and through the
+ * pointer returned by X509_getm_notAfter().
+ */
+static int test_validity_change(const char *roots_f, const char *untrusted_f)
+{
+    int ret = 0;
+    STACK_OF(X509) *roots = NULL, *untrusted = NULL;
+    X509_STORE *store = NULL;
+    ASN1_TIME *past = NULL, *orig = NULL;
+    X509 *leaf;
+
+    roots = load_certs_from_file(roots_f);
+    untrusted = load_certs_from_file(untrusted_f);
+    store = X509_STORE_new();
+    past = X509_gmtime_adj(NULL, -86400);
+    if (roots == NULL || untrusted == NULL || sk_X509_num(untrusted) != 2
+            || store == NULL || past == NULL
+            || !X509_STORE_add_cert(store, sk_X509_value(roots, 0))
+            || !X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN))
+        goto err;
+    leaf = sk_X509_value(untrusted, 1);
+    if ((orig = ASN1_STRING_dup(X509_get0_notAfter(leaf))) == NULL)
+        goto err;
+
+    if (!verify_expect(store, leaf, untrusted, 1, X509_V_OK)) {
+        fprintf(stderr, "Verification failed\n");
+        goto err;
+    }
+
+    if (!X509_set1_notAfter(leaf, past)
+            || !verify_expect(store, leaf, untrusted, 0,
+                              X509_V_ERR_CERT_HAS_EXPIRED)) {
+        fprintf(stderr, "Expiry set with X509_set1_notAfter() missed\n");
+        goto err;
+    }
+
+    if (!X509_set1_notAfter(leaf, orig)
+            || !verify_expect(store, leaf, untrusted, 1, X509_V_OK)) {
+        fprintf(stderr, "Restored notAfter not used\n");
+        goto err;
+    }
+
+    if (X509_gmtime_adj(X509_getm_notAfter(leaf), -86400) == NULL
+            || !verify_expect(store, leaf, untrusted, 0,
+                              X509_V_ERR_CERT_HAS_EXPIRED)) {
+        fprintf(stderr, "Expiry set through X509_getm_notAfter() missed\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    ASN1_TIME_free(past);
+    ASN1_TIME_free(orig);
+    sk_X509_pop_free(roots, X509_free);
+    sk_X509_pop_free(untrusted, X509_free);
+    X509_STORE_free(store);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+
+#ifndef OPENSSL_NO_DSA
+/* Make a certificate for |pkey| with subject |subj|, signed by |signer| */
+static X509 *make_cert(const char *subj, const char *iss, EVP_PKEY *pkey,
+                       EVP_PKEY *signer)
+{
+    X509 *x = X509_new();
+    X509_NAME *subject = X509_NAME_new(), *issuer = X509_NAME_new();
+
+    if (x == NULL || subject == NULL || issuer == NULL
+            || !X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC,
+                                           (const unsigned char *)subj,
+                                           -1, -1, 0)
+            || !X509_NAME_add_entry_by_txt(issuer, "CN", MBSTRING_ASC,
+                                           (const unsigned char *)iss,
+                                           -1, -1, 0)
+            || !X509_set_subject_name(x, subject)
+            || !X509_set_issuer_name(x, issuer)
+            || !ASN1_INTEGER_set(X509_get_serialNumber(x), 1)
+            || X509_gmtime_adj(X509_getm_notBefore(x), -3600) == NULL
+            || X509_gmtime_adj(X509_getm_notAfter(x), 3600) == NULL
+            || !X509_set_pubkey(x, pkey)
+            || !X509_sign(x, signer, EVP_sha256())) {
+        X509_free(x);
+        x = NULL;
+    }
+    X509_NAME_free(subject);
+    X509_NAME_free(issuer);
+    return x;
+}
+
+/*
+ * Test that a signature remembered as good is not taken as good for an
+ * issuer with the same public key value but other domain parameters.
+ */
+static int test_signature_memo_params(void)
+{
+    int ret = 0;
+    DSA *dsa1 = NULL, *dsa2 = NULL;
+    const BIGNUM *p, *q, *g, *pub;
+    BIGNUM *p2 = NULL, *q2 = NULL, *g2 = NULL, *pub2 = NULL;
+    BN_CTX *bnctx = NULL;
+    EVP_PKEY *pkey1 = NULL, *pkey2 = NULL;
+    X509 *ca1 = NULL, *ca2 = NULL, *leaf = NULL;
+    X509_STORE *store1 = NULL, *store2 = NULL;
+    X509_STORE_CTX *sctx = NULL;
+
+    /* The second key has the same value with a generator of g^2 */
+    dsa1 = DSA_new();
+    dsa2 = DSA_new();
+    bnctx = BN_CTX_new();
+    pkey1 = EVP_PKEY_new();
+    pkey2 = EVP_PKEY_new();
+    if (dsa1 == NULL || dsa2 == NULL || bnctx == NULL || pkey1 == NULL
+            || pkey2 == NULL
+            || !DSA_generate_parameters_ex(dsa1, 1024, NULL, 0, NULL, NULL,
+                                           NULL)
+            || !DSA_generate_key(dsa1))
+        goto err;
+    DSA_get0_pqg(dsa1, &p, &q, &g);
+    DSA_get0_key(dsa1, &pub, NULL);
+    p2 = BN_dup(p);
+    q2 = BN_dup(q);
+    g2 = BN_new();
+    pub2 = BN_dup(pub);
+    if (p2 == NULL || q2 == NULL || g2 == NULL || pub2 == NULL
+            || !BN_mod_sqr(g2, g, p, bnctx)
+            || !DSA_set0_pqg(dsa2, p2, q2, g2))
+        goto err;
+    p2 = q2 = g2 = NULL;
+    if (!DSA_set0_key(dsa2, pub2, NULL))
+        goto err;
+    pub2 = NULL;
+    if (!EVP_PKEY_assign_DSA(pkey1, dsa1))
+        goto err;
+    dsa1 = NULL;
+    if (!EVP_PKEY_assign_DSA(pkey2, dsa2))
+        goto err;
+    dsa2 = NULL;
+
+    ca1 = make_cert("memo CA", "memo CA", pkey1, pkey1);
+    ca2 = make_cert("memo CA", "memo CA", pkey2, pkey1);
+    leaf = make_cert("memo leaf", "memo CA", pkey1, pkey1);
+    store1 = X509_STORE_new();
+    store2 = X509_STORE_new();
+    sctx = X509_STORE_CTX_new();
+    if (ca1 == NULL || ca2 == NULL || leaf == NULL || store1 == NULL
+            || store2 == NULL || sctx == NULL
+            || !X509_STORE_add_cert(store1, ca1)
+            || !X509_STORE_add_cert(store2, ca2))
+        goto err;
+
+    if (!X509_STORE_CTX_init(sctx, store1, leaf, NULL)
+            || X509_verify_cert(sctx) != 1) {
+        fprintf(stderr, "Verification failed\n");
+        goto err;
+    }
+    X509_STORE_CTX_cleanup(sctx);
+
+    if (!X509_STORE_CTX_init(sctx, store2, leaf, NULL)
+            || X509_verify_cert(sctx) != 0
+            || X509_STORE_CTX_get_error(sctx)
+               != X509_V_ERR_CERT_SIGNATURE_FAILURE) {
+        fprintf(stderr, "Signature memo reused for other key parameters\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    DSA_free(dsa1);
+    DSA_free(dsa2);
+    BN_free(p2);
+    BN_free(q2);
+    BN_free(g2);
+    BN_free(pub2);
+    BN_CTX_free(bnctx);
+    EVP_PKEY_free(pkey1);
+    EVP_PKEY_free(pkey2);
+    X509_free(ca1);
+    X509_free(ca2);
+    X509_free(leaf);
+    X509_STORE_CTX_free(sctx);
+    X509_STORE_free(store1);
+    X509_STORE_free(store2);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+#endif
+
+/*
+ * Test batch verification: the leaf in |untrusted_f| is verified twice with
+ * separately loaded copies of its untrusted issuer, which the batch should
+ * share, and once without, which should fail on its own.
+ */
+static int test_verify_batch(const char *roots_f, const char *untrusted_f)
+{
+    int ret = 0, i, res[3];
+    STACK_OF(X509) *roots = NULL, *untrusted1 = NULL, *untrusted2 = NULL;
+    X509_STORE *store = NULL;
+    X509_STORE_CTX *sctx[3] = { NULL, NULL, NULL };
+    X509 *issuer1, *issuer2;
+
+    roots = load_certs_from_file(roots_f);
+    store = X509_STORE_new();
+    if (roots == NULL || store == NULL
+            || !X509_STORE_add_cert(store, sk_X509_value(roots, 0))
+            || !X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN))
+        goto err;
+
+    untrusted1 = load_certs_from_file(untrusted_f);
+    untrusted2 = load_certs_from_file(untrusted_f);
+    if (untrusted1 == NULL || sk_X509_num(untrusted1) != 2
+            || untrusted2 == NULL || sk_X509_num(untrusted2) != 2)
+        goto err;
+    for (i = 0; i < 3; i++) {
+        if ((sctx[i] = X509_STORE_CTX_new()) == NULL)
+            goto err;
+    }
+    if (!X509_STORE_CTX_init(sctx[0], store, sk_X509_value(untrusted1, 1),
+                             untrusted1)
+            || !X509_STORE_CTX_init(sctx[1], store,
+                                    sk_X509_value(untrusted2, 1), untrusted2)
+            || !X509_STORE_CTX_init(sctx[2], store,
+                                    sk_X509_value(untrusted2, 1), NULL))
+        goto err;
+
+    if (X509_verify_cert_batch(sctx, res, 3) != 0
+            || res[0] != 1 || res[1] != 1 || res[2] != 0
+            || X509_STORE_CTX_get_error(sctx[2])
+               != X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT_LOCALLY) {
+        fprintf(stderr, "Unexpected batch verification results\n");
+        goto err;
+    }
+
+    issuer1 = sk_X509_value(X509_STORE_CTX_get0_chain(sctx[0]), 1);
+    issuer2 = sk_X509_value(X509_STORE_CTX_get0_chain(sctx[1]), 1);
+    if (issuer1 != issuer2
+            || sk_X509_value(untrusted2, 0) == issuer2) {
+        fprintf(stderr, "Untrusted certificates not shared\n");
+        goto err;
+    }
+
+    ret = 1;
+ err:
+    for (i = 0; i < 3; i++)
+        X509_STORE_CTX_free(sctx[i]);
+    sk_X509_pop_free(roots, X509_free);
+    sk_X509_pop_free(untrusted1, X509_free);
+    sk_X509_pop_free(untrusted2, X509_free);
+    X509_STORE_free(store);
+    if (ret != 1)
+        ERR_print_errors_fp(stderr);
+    return ret;
+}
+
 int main(int argc, char **argv)
 {
     CRYPTO_set_mem_debug(1);
     CRYPTO_mem_ctrl(CRYPTO_MEM_CHECK_ON);
 
-    if (argc != 4) {
-        fprintf(stderr, "usage: verify_extra_test roots.pem untrusted.pem bad.pem\n");
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "usage: verify_extra_test roots.pem untrusted.pem "
+                "bad.pem [emptydir]\n");
         return 1;
     }
 
@@ -152,6 +776,48 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (!test_store_lookup(argv[1], argv[2])) {
+        fprintf(stderr, "Test store lookup failed\n");
+        return 1;
+    }
+
+    if (!test_verify_cache(argv[1], argv[2])) {
+        fprintf(stderr, "Test verify cache failed\n");
+        return 1;
+    }
+
+    if (!test_signature_memo(argv[1], argv[2])) {
+        fprintf(stderr, "Test signature memo failed\n");
+        return 1;
+    }
+
+    if (!test_validity_change(argv[1], argv[2])) {
+        fprintf(stderr, "Test validity change failed\n");
+        return 1;
+    }
+
+#ifndef OPENSSL_NO_DSA
+    if (!test_signature_memo_params()) {
+        fprintf(stderr, "Test signature memo parameters failed\n");
+        return 1;
+    }
+#endif
+
+    if (!test_verify_batch(argv[1], argv[2])) {
+        fprintf(stderr, "Test verify batch failed\n");
+        return 1;
+    }
+
+    if (!test_load_suppressed(argv[1])) {
+        fprintf(stderr, "Test load suppressed failed\n");
+        return 1;
+    }
+
+    if (argc == 5 && !test_dir_cache(argv[2], argv[4])) {
+        fprintf(stderr, "Test directory cache failed\n");
+        return 1;
+    }
+
 #ifndef OPENSSL_NO_CRYPTO_MDEBUG
     if (CRYPTO_mem_leaks_fp(stderr) <= 0)
         return 1;
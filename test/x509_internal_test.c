@@ -53,7 +53,98 @@ static int test_standard_exts()
     return good;
 }
 
+/**********************************************************************
+ *
+ * Test of X509_NAME hashing and comparison
+ *
+ ***/
+
+/*
+ * Names with up to two entries and their X509_NAME_hash() values, which
+ * are the names of the links created by c_rehash and must not change
+ */
+static const struct {
+    const char *field1, *value1, *field2, *value2;
+    unsigned long hash;
+} name_hashes[] = {
+    { NULL, NULL, NULL, NULL, 0xeea339daUL },
+    { "CN", "Test Root CA", NULL, NULL, 0x43203952UL },
+    /* the canonical encoding ignores case and repeated spaces */
+    { "CN", "test   root  ca", NULL, NULL, 0x43203952UL },
+    { "O", "OpenSSL Group", "CN", "Test", 0x65a8e558UL },
+    { "CN", "a", NULL, NULL, 0x20b69a40UL },
+    { "CN", "b", NULL, NULL, 0xfc27cf0fUL },
+};
+
+static X509_NAME *make_name(const char *field1, const char *value1,
+                            const char *field2, const char *value2)
+{
+    X509_NAME *nm = X509_NAME_new();
+
+    if (nm == NULL
+            || (field1 != NULL
+                && !X509_NAME_add_entry_by_txt(nm, field1, MBSTRING_ASC,
+                                               (const unsigned char *)value1,
+                                               -1, -1, 0))
+            || (field2 != NULL
+                && !X509_NAME_add_entry_by_txt(nm, field2, MBSTRING_ASC,
+                                               (const unsigned char *)value2,
+                                               -1, -1, 0))) {
+        X509_NAME_free(nm);
+        return NULL;
+    }
+    return nm;
+}
+
+static int test_name_hash(int idx)
+{
+    X509_NAME *nm = make_name(name_hashes[idx].field1, name_hashes[idx].value1,
+                              name_hashes[idx].field2, name_hashes[idx].value2);
+    unsigned long hash;
+    int ret = 0;
+
+    if (nm == NULL)
+        return 0;
+    hash = X509_NAME_hash(nm);
+    if (hash != name_hashes[idx].hash)
+        fprintf(stderr, "Name %d hash %08lx, expected %08lx\n", idx, hash,
+                name_hashes[idx].hash);
+    else
+        ret = 1;
+    X509_NAME_free(nm);
+    return ret;
+}
+
+/*
+ * Names of the same length are ordered by their canonical encodings. The
+ * fingerprint of "CN=a" is larger than that of "CN=c", so this also checks
+ * that the order does not depend on it.
+ */
+static int test_name_cmp()
+{
+    X509_NAME *a = make_name("CN", "a", NULL, NULL);
+    X509_NAME *c = make_name("CN", "c", NULL, NULL);
+    X509_NAME *c2 = make_name("CN", "C", NULL, NULL);
+    int ret = 0;
+
+    if (a == NULL || c == NULL || c2 == NULL)
+        goto end;
+    if (X509_NAME_cmp(a, c) >= 0 || X509_NAME_cmp(c, a) <= 0
+            || X509_NAME_cmp(c, c2) != 0) {
+        fprintf(stderr, "Unexpected order of names\n");
+        goto end;
+    }
+    ret = 1;
+ end:
+    X509_NAME_free(a);
+    X509_NAME_free(c);
+    X509_NAME_free(c2);
+    return ret;
+}
+
 void register_tests()
 {
     ADD_TEST(test_standard_exts);
+    ADD_ALL_TESTS(test_name_hash, OSSL_NELEM(name_hashes));
+    ADD_TEST(test_name_cmp);
 }